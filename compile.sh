@@ -1,11 +1,41 @@
 #!/bin/bash
 
-mpicxx -mtune=native -march=native -O3 phpmagic_sha1_openmpi.cpp sha1.cpp -o phpmagic_sha1_openmpi 1>./last-compile-stdout.txt 2>./last-compile-stderr.txt
+# The search engine is built as a library (libphpmagic.a and libphpmagic.so, see "phpmagic_search.h"),
+# and the Open MPI application is linked with the static one
+LIB_SOURCES="sha1.cpp md5.cpp phpmagic_predicate.cpp phpmagic_chain.cpp phpmagic_layout.cpp phpmagic_verify.cpp phpmagic_wordlist.cpp phpmagic_targets.cpp phpmagic_checksum.cpp phpmagic_opencl.cpp phpmagic_jit.cpp phpmagic_token.cpp phpmagic_search.cpp"
+FLAGS="-mtune=native -march=native -O3 -pthread"
+
+build()
+{
+    OBJECTS=""
+    for SOURCE in $LIB_SOURCES
+    do
+        mpicxx $FLAGS $1 -fPIC -c $SOURCE -o ${SOURCE%.cpp}.o || return 1
+        OBJECTS="$OBJECTS ${SOURCE%.cpp}.o"
+    done
+    rm -f libphpmagic.a
+    ar rcs libphpmagic.a $OBJECTS || return 1
+    mpicxx $FLAGS -shared $OBJECTS -o libphpmagic.so || return 1
+    mpicxx $FLAGS $1 phpmagic_merge.cpp phpmagic_shard.cpp libphpmagic.a -o phpmagic_merge || return 1
+    mpicxx $FLAGS $1 phpmagic_sha1_openmpi.cpp phpmagic_daemon.cpp phpmagic_tolerant.cpp phpmagic_tune.cpp phpmagic_sweep.cpp phpmagic_node.cpp phpmagic_smt.cpp phpmagic_shard.cpp phpmagic_validate.cpp libphpmagic.a -o phpmagic_sha1_openmpi
+}
+
+# Build without MPI, for the tasks of a job array on hosts without Open MPI (see "--shard" in README.md):
+#   ./compile.sh nompi && ./phpmagic_sha1_nompi --shard auto
+if [ "$1" = "nompi" ]
+then
+    CXX=${CXX:-g++}
+    $CXX $FLAGS -DDISABLE_MPI $LIB_SOURCES phpmagic_sha1_openmpi.cpp phpmagic_daemon.cpp phpmagic_tolerant.cpp phpmagic_tune.cpp phpmagic_sweep.cpp phpmagic_node.cpp phpmagic_smt.cpp phpmagic_shard.cpp phpmagic_validate.cpp -ldl -o phpmagic_sha1_nompi || exit 1
+    $CXX $FLAGS $LIB_SOURCES phpmagic_merge.cpp phpmagic_shard.cpp -ldl -o phpmagic_merge
+    exit $?
+fi
+
+build "" 1>./last-compile-stdout.txt 2>./last-compile-stderr.txt
 
 if [ $? -ne 0 ]
 then
     echo "The CPU does not support the SHA extensions";
-    mpicxx -DDISABLE_SHA_CPU_EXTENSIONS -mtune=native -march=native -O3 phpmagic_sha1_openmpi.cpp sha1.cpp -o phpmagic_sha1_openmpi 1>>./last-compile-stdout.txt 2>>./last-compile-stderr.txt
+    build "-DDISABLE_SHA_CPU_EXTENSIONS" 1>>./last-compile-stdout.txt 2>>./last-compile-stderr.txt
     if [ $? -ne 0 ]
     then
         cp ./last-compile-stderr.txt /dev/stderr
@@ -14,4 +44,3 @@ then
 else
     echo "The CPU supports the SHA extensions";
 fi
-
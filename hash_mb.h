@@ -0,0 +1,153 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Multi-buffer SHA-1 and MD5.
+
+The compression functions are written once over a lane type V. With V = uint32_t they hash one message,
+with V = mb_u32 they hash CMbLanes independent messages at once: 16 with AVX-512, 8 with AVX2, 4 with SSE2.
+The message and the state are given as words, already in the byte order of the algorithm
+(big-endian for SHA-1, little-endian for MD5), so the callers never go through bytes in memory.
+*/
+
+#ifndef HASH_MB_H
+#define HASH_MB_H
+
+#include <stdint.h>
+
+#if defined(__AVX512F__)
+typedef uint32_t mb_u32 __attribute__((vector_size(64)));
+#elif defined(__AVX2__)
+typedef uint32_t mb_u32 __attribute__((vector_size(32)));
+#else
+typedef uint32_t mb_u32 __attribute__((vector_size(16)));
+#endif
+
+const unsigned int CMbLanes = sizeof(mb_u32) / sizeof(uint32_t);
+
+template <typename V>
+static inline V mb_rol(const V x, const int bits)
+{
+    return (x << bits) | (x >> (32 - bits));
+}
+
+template <typename V>
+static inline V mb_bswap(const V x)
+{
+    return ((x >> 24) & 0xff) | ((x >> 8) & 0xff00) | ((x << 8) & 0xff0000) | (x << 24);
+}
+
+template <typename V>
+static inline V mb_load(const uint32_t* lanes)
+{
+    V v;
+    __builtin_memcpy(&v, lanes, sizeof(v));
+    return v;
+}
+
+template <typename V>
+static inline void mb_store(uint32_t* lanes, const V v)
+{
+    __builtin_memcpy(lanes, &v, sizeof(v));
+}
+
+/* ================ SHA-1 ================ */
+
+const uint32_t CSha1Init[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+#define MB_SHA1_EXPAND(i) (w[(i) & 15] = mb_rol(w[((i) + 13) & 15] ^ w[((i) + 8) & 15] ^ w[((i) + 2) & 15] ^ w[(i) & 15], 1))
+#define MB_SHA1_STEP(f, k, wi) \
+    { \
+        const V t = mb_rol(a, 5) + (f) + e + (k) + (wi); \
+        e = d; d = c; c = mb_rol(b, 30); b = a; a = t; \
+    }
+
+template <typename V>
+static inline void sha1_compress_mb(V state[5], const V block[16])
+{
+    V w[16];
+    for (int i = 0; i < 16; ++i) w[i] = block[i];
+    V a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; ++i) MB_SHA1_STEP(((b & (c ^ d)) ^ d), 0x5A827999, w[i]);
+#pragma GCC unroll 4
+    for (int i = 16; i < 20; ++i) MB_SHA1_STEP(((b & (c ^ d)) ^ d), 0x5A827999, MB_SHA1_EXPAND(i));
+#pragma GCC unroll 20
+    for (int i = 20; i < 40; ++i) MB_SHA1_STEP((b ^ c ^ d), 0x6ED9EBA1, MB_SHA1_EXPAND(i));
+#pragma GCC unroll 20
+    for (int i = 40; i < 60; ++i) MB_SHA1_STEP(((b & c) | (d & (b | c))), 0x8F1BBCDC, MB_SHA1_EXPAND(i));
+#pragma GCC unroll 20
+    for (int i = 60; i < 80; ++i) MB_SHA1_STEP((b ^ c ^ d), 0xCA62C1D6, MB_SHA1_EXPAND(i));
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+// The first "rounds" rounds (at most 16) of a block, without the feed-forward: for a JIT kernel (see "phpmagic_jit.h")
+// that starts after the rounds over constant words
+template <typename V>
+static inline void sha1_rounds_mb(V state[5], const V block[16], const unsigned int rounds)
+{
+    V a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (unsigned int i = 0; i < rounds; ++i) MB_SHA1_STEP(((b & (c ^ d)) ^ d), 0x5A827999, block[i]);
+    state[0] = a;
+    state[1] = b;
+    state[2] = c;
+    state[3] = d;
+    state[4] = e;
+}
+
+#undef MB_SHA1_STEP
+#undef MB_SHA1_EXPAND
+
+/* ================ MD5 ================ */
+
+const uint32_t CMd5Init[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+
+const uint32_t CMd5K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+const int CMd5Shift[4][4] = { { 7, 12, 17, 22 }, { 5, 9, 14, 20 }, { 4, 11, 16, 23 }, { 6, 10, 15, 21 } };
+
+#define MB_MD5_STEP(f, g, i) \
+    { \
+        const V t = b + mb_rol(a + (f) + CMd5K[i] + block[g], CMd5Shift[(i) >> 4][(i) & 3]); \
+        a = d; d = c; c = b; b = t; \
+    }
+
+template <typename V>
+static inline void md5_compress_mb(V state[4], const V block[16])
+{
+    V a = state[0], b = state[1], c = state[2], d = state[3];
+
+#pragma GCC unroll 16
+    for (int i = 0; i < 16; ++i) MB_MD5_STEP((d ^ (b & (c ^ d))), i, i);
+#pragma GCC unroll 16
+    for (int i = 16; i < 32; ++i) MB_MD5_STEP((c ^ (d & (b ^ c))), (5 * i + 1) & 15, i);
+#pragma GCC unroll 16
+    for (int i = 32; i < 48; ++i) MB_MD5_STEP((b ^ c ^ d), (3 * i + 5) & 15, i);
+#pragma GCC unroll 16
+    for (int i = 48; i < 64; ++i) MB_MD5_STEP((c ^ (b | ~d)), (7 * i) & 15, i);
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+#undef MB_MD5_STEP
+
+#endif
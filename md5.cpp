@@ -0,0 +1,76 @@
+/*
+MD5 in C, after RFC 1321 (the RSA Data Security, Inc. MD5 Message-Digest Algorithm).
+*/
+
+#include <string.h>
+#include "md5.h"
+#include "hash_mb.h"
+
+static uint32_t load_le32(const unsigned char* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void MD5TransformWords(uint32_t state[4], const uint32_t block[16])
+{
+    md5_compress_mb<uint32_t>(state, block);
+}
+
+void MD5Transform(uint32_t state[4], const unsigned char buffer[64])
+{
+    uint32_t block[16];
+    for (int i = 0; i < 16; ++i)
+    {
+        block[i] = load_le32(&buffer[4 * i]);
+    }
+    md5_compress_mb<uint32_t>(state, block);
+}
+
+void MD5Init(MD5_CTX* context)
+{
+    memcpy(context->state, CMd5Init, sizeof(context->state));
+    context->count[0] = context->count[1] = 0;
+}
+
+void MD5Update(MD5_CTX* context, const unsigned char* data, uint32_t len)
+{
+    uint32_t i;
+    uint32_t j;
+
+    j = context->count[0];
+    if ((context->count[0] += len << 3) < j)
+        context->count[1]++;
+    context->count[1] += (len >> 29);
+    j = (j >> 3) & 63;
+    if ((j + len) > 63) {
+        memcpy(&context->buffer[j], data, (i = 64 - j));
+        MD5Transform(context->state, context->buffer);
+        for (; i + 63 < len; i += 64) {
+            MD5Transform(context->state, &data[i]);
+        }
+        j = 0;
+    }
+    else i = 0;
+    memcpy(&context->buffer[j], &data[i], len - i);
+}
+
+void MD5Final(unsigned char digest[16], MD5_CTX* context)
+{
+    uint32_t used = (context->count[0] >> 3) & 63;
+    context->buffer[used++] = 0x80;
+    if (used > 56) {
+        memset(&context->buffer[used], 0, 64 - used);
+        MD5Transform(context->state, context->buffer);
+        used = 0;
+    }
+    memset(&context->buffer[used], 0, 56 - used);
+    for (int i = 0; i < 4; ++i) {
+        context->buffer[56 + i] = (unsigned char)(context->count[0] >> (8 * i));
+        context->buffer[60 + i] = (unsigned char)(context->count[1] >> (8 * i));
+    }
+    MD5Transform(context->state, context->buffer);
+    for (int i = 0; i < 16; ++i) {
+        digest[i] = (unsigned char)(context->state[i >> 2] >> (8 * (i & 3)));
+    }
+    memset(context, '\0', sizeof(*context));
+}
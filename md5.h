@@ -0,0 +1,24 @@
+/*
+MD5 in C, after RFC 1321 (the RSA Data Security, Inc. MD5 Message-Digest Algorithm), with the same interface as "sha1.h".
+The compression function is the one from "hash_mb.h", so it is shared with the multi-buffer engine.
+*/
+
+#ifndef MD5_H
+#define MD5_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t state[4];
+    uint32_t count[2];
+    unsigned char buffer[64];
+} MD5_CTX;
+
+// The block is given as 16 little-endian words
+void MD5TransformWords(uint32_t state[4], const uint32_t block[16]);
+void MD5Transform(uint32_t state[4], const unsigned char buffer[64]);
+void MD5Init(MD5_CTX* context);
+void MD5Update(MD5_CTX* context, const unsigned char* data, uint32_t len);
+void MD5Final(unsigned char digest[16], MD5_CTX* context);
+
+#endif
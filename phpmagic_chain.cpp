@@ -0,0 +1,195 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Hash chains, see "phpmagic_chain.h".
+*/
+
+#include <string.h>
+#include "phpmagic_chain.h"
+
+static const char* algorithm_name(const HashAlgorithm algorithm)
+{
+    return (algorithm == hash_sha1) ? "sha1" : "md5";
+}
+
+bool chain_parse(const std::string& text, HashChain* chain, std::string* error)
+{
+    // "md5(sha1($x))" is read from the outside in, so the names come outermost first
+    HashAlgorithm outermost_first[CChainMaxDepth];
+    unsigned int depth = 0;
+    unsigned int open = 0;
+    std::string::size_type i = 0;
+    while (true)
+    {
+        std::string::size_type j = text.find_first_of("()", i);
+        const std::string name = text.substr(i, (j == std::string::npos) ? std::string::npos : j - i);
+        if ((name == "sha1") || (name == "md5"))
+        {
+            if (depth == CChainMaxDepth)
+            {
+                *error = "at most " + std::to_string(CChainMaxDepth) + " algorithms can be chained";
+                return false;
+            }
+            outermost_first[depth++] = (name == "sha1") ? hash_sha1 : hash_md5;
+        }
+        else if (!(((name == "$x") || (name == "x")) && (depth > 0)))
+        {
+            *error = "unknown algorithm '" + name + "', use sha1 or md5, e.g. md5(sha1($x))";
+            return false;
+        }
+        if ((j == std::string::npos) || (text[j] == ')'))
+        {
+            i = j;
+            break;
+        }
+        if (name[0] == 'x' || name[0] == '$')
+        {
+            *error = "'$x' cannot be hashed by itself";
+            return false;
+        }
+        ++open;
+        i = j + 1;
+    }
+    // the rest must close all the parentheses
+    const std::string::size_type closing = (i == std::string::npos) ? 0 : text.length() - i;
+    if ((depth == 0) || (closing != open) || ((closing > 0) && (text.find_first_not_of(')', i) != std::string::npos)))
+    {
+        *error = "unbalanced parentheses in '" + text + "'";
+        return false;
+    }
+    chain->depth = depth;
+    chain->hmac = hmac_none;
+    for (unsigned int k = 0; k < depth; ++k)
+    {
+        chain->algorithm[k] = outermost_first[depth - 1 - k];
+    }
+    return true;
+}
+
+std::string chain_name(const HashChain* chain)
+{
+    if (chain->hmac == hmac_fixed_key)
+        return std::string("hash_hmac('") + algorithm_name(chain->algorithm[0]) + "', $x, $key)";
+    if (chain->hmac == hmac_varying_key)
+        return std::string("hash_hmac('") + algorithm_name(chain->algorithm[0]) + "', $message, $x)";
+    std::string name = "$x";
+    for (unsigned int k = 0; k < chain->depth; ++k)
+    {
+        name = std::string(algorithm_name(chain->algorithm[k])) + "(" + name + ")";
+    }
+    return name;
+}
+
+unsigned int chain_digest_nibbles(const HashChain* chain)
+{
+    return (chain->algorithm[chain->depth - 1] == hash_sha1) ? 40 : 32;
+}
+
+static unsigned int reference_digest(const HashAlgorithm algorithm, const unsigned char* a, uint32_t a_len, const unsigned char* b, uint32_t b_len, unsigned char bytes[20])
+{
+    if (algorithm == hash_sha1)
+    {
+        SHA1_STREAM stream;
+        SHA1StreamInit(&stream, 0);
+        SHA1StreamUpdate(&stream, a, a_len);
+        SHA1StreamUpdate(&stream, b, b_len);
+        SHA1StreamFinal(bytes, &stream);
+        return 20;
+    }
+    MD5_CTX ctx;
+    MD5Init(&ctx);
+    MD5Update(&ctx, a, a_len);
+    MD5Update(&ctx, b, b_len);
+    MD5Final(bytes, &ctx);
+    return 16;
+}
+
+static void bytes_to_words(const unsigned char* bytes, unsigned int len, uint32_t digest[CChainMaxDigestWords])
+{
+    for (unsigned int i = 0; i < len / 4; ++i)
+    {
+        digest[i] = ((uint32_t)bytes[4 * i] << 24) | ((uint32_t)bytes[4 * i + 1] << 16) | ((uint32_t)bytes[4 * i + 2] << 8) | bytes[4 * i + 3];
+    }
+}
+
+std::string hmac_key_block(const HashAlgorithm algorithm, const std::string& key)
+{
+    std::string block = key;
+    if (block.length() > 64)
+    {
+        unsigned char bytes[20];
+        const unsigned int len = reference_digest(algorithm, (const unsigned char*)key.data(), (uint32_t)key.length(), 0, 0, bytes);
+        block.assign((const char*)bytes, len);
+    }
+    block.resize(64, '\0');
+    return block;
+}
+
+bool chain_set_hmac(HashChain* chain, const HmacMode mode, const std::string& key, std::string* error)
+{
+    if (chain->depth != 1)
+    {
+        *error = "HMAC is supported for a single algorithm, sha1 or md5";
+        return false;
+    }
+    chain->hmac = mode;
+    if (mode == hmac_fixed_key)
+    {
+        const std::string block = hmac_key_block(chain->algorithm[0], key);
+        const bool big_endian = chain_big_endian(chain);
+        uint32_t words[16];
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            const unsigned char* p = (const unsigned char*)block.data() + 4 * i;
+            words[i] = (big_endian ? (((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3])
+                : ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24))) ^ CHmacOpad;
+        }
+        memset(chain->hmac_outer, 0, sizeof(chain->hmac_outer));
+        if (chain->algorithm[0] == hash_sha1)
+        {
+            memcpy(chain->hmac_outer, CSha1Init, sizeof(CSha1Init));
+            SHA1TransformWords(chain->hmac_outer, words);
+        }
+        else
+        {
+            memcpy(chain->hmac_outer, CMd5Init, sizeof(CMd5Init));
+            MD5TransformWords(chain->hmac_outer, words);
+        }
+    }
+    return true;
+}
+
+void hmac_reference(const HashAlgorithm algorithm, const std::string& key, const std::string& message, uint32_t digest[CChainMaxDigestWords])
+{
+    const std::string block = hmac_key_block(algorithm, key);
+    unsigned char pad[64];
+    unsigned char inner[20];
+    unsigned char outer[20];
+    for (unsigned int i = 0; i < 64; ++i) pad[i] = (unsigned char)block[i] ^ 0x36;
+    const unsigned int len = reference_digest(algorithm, pad, 64, (const unsigned char*)message.data(), (uint32_t)message.length(), inner);
+    for (unsigned int i = 0; i < 64; ++i) pad[i] = (unsigned char)block[i] ^ 0x5c;
+    reference_digest(algorithm, pad, 64, inner, len, outer);
+    bytes_to_words(outer, len, digest);
+}
+
+void chain_reference(const HashChain* chain, const unsigned char* message, uint32_t len, uint32_t digest[CChainMaxDigestWords])
+{
+    static const char dec2hex[16 + 1] = "0123456789abcdef";
+    unsigned char bytes[20];
+    unsigned char hex[40];
+    unsigned int digest_len = 0;
+    for (unsigned int step = 0; step < chain->depth; ++step)
+    {
+        const unsigned char* input = (step == 0) ? message : hex;
+        const uint32_t input_len = (step == 0) ? len : 2 * digest_len;
+        digest_len = reference_digest(chain->algorithm[step], input, input_len, 0, 0, bytes);
+        for (unsigned int i = 0; i < digest_len; ++i)
+        {
+            hex[2 * i] = dec2hex[bytes[i] >> 4];
+            hex[2 * i + 1] = dec2hex[bytes[i] & 15];
+        }
+    }
+    bytes_to_words(bytes, digest_len, digest);
+}
@@ -0,0 +1,212 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Hash chains such as md5(sha1($x)) or sha1(md5($x)), where each inner digest is hex-encoded (as PHP does by default) and hashed again.
+
+The candidate's message is hashed by the innermost algorithm (see "phpmagic_layout.h"); the inner digest is then converted to lowercase
+hexadecimal characters right in the state words (4 nibbles at a time, spread into bytes with SWAR arithmetic) and these words,
+with the constant padding and length, are the single block of the next algorithm. The predicate is applied to the final digest only.
+The same code runs over one message (V = uint32_t, SHA-1 through SHA1TransformWords, so with the SHA CPU instructions if enabled)
+or over all the lanes of the multi-buffer engine (V = mb_u32), and nothing leaves the registers between the steps.
+*/
+
+#ifndef PHPMAGIC_CHAIN_H
+#define PHPMAGIC_CHAIN_H
+
+#include <string>
+#include <stdint.h>
+#include "sha1.h"
+#include "md5.h"
+#include "hash_mb.h"
+
+enum HashAlgorithm { hash_sha1, hash_md5 };
+
+// HMAC, e.g. hash_hmac('sha1', $x, $key) with a fixed key or hash_hmac('sha1', $message, $x) with the candidate as the key
+enum HmacMode { hmac_none, hmac_fixed_key, hmac_varying_key };
+
+const unsigned int CChainMaxDepth = 4;
+const unsigned int CChainMaxDigestWords = 5;
+const uint32_t CHmacIpad = 0x36363636;
+const uint32_t CHmacOpad = 0x5c5c5c5c;
+
+typedef struct {
+    unsigned int depth;
+    HashAlgorithm algorithm[CChainMaxDepth]; // the innermost first
+    HmacMode hmac;
+    uint32_t hmac_outer[5]; // the state after the K ^ opad block, for hmac_fixed_key
+} HashChain;
+
+// Parses "sha1", "md5", "md5(sha1)", "sha1(md5($x))", etc.
+bool chain_parse(const std::string& text, HashChain* chain, std::string* error);
+std::string chain_name(const HashChain* chain);
+unsigned int chain_digest_nibbles(const HashChain* chain);
+
+// The innermost algorithm decides the byte order of the candidate's message words
+static inline bool chain_big_endian(const HashChain* chain)
+{
+    return chain->algorithm[0] == hash_sha1;
+}
+
+// Reference implementation through the byte-oriented SHA1StreamUpdate/MD5Update, used to re-verify the solutions; the digest is returned as big-endian words
+void chain_reference(const HashChain* chain, const unsigned char* message, uint32_t len, uint32_t digest[CChainMaxDigestWords]);
+void hmac_reference(const HashAlgorithm algorithm, const std::string& key, const std::string& message, uint32_t digest[CChainMaxDigestWords]);
+
+// The key as a 64-byte block: hashed first if it is longer than a block, then padded with zeros
+std::string hmac_key_block(const HashAlgorithm algorithm, const std::string& key);
+
+// Turns a single-algorithm chain into HMAC; for a fixed key, the K ^ ipad block is to be prepended to the message by the caller
+// and the state after the K ^ opad block is precomputed here
+bool chain_set_hmac(HashChain* chain, const HmacMode mode, const std::string& key, std::string* error);
+
+static inline void chain_sha1_block(uint32_t state[5], const uint32_t block[16])
+{
+    SHA1TransformWords(state, block);
+}
+
+static inline void chain_sha1_block(mb_u32 state[5], const mb_u32 block[16])
+{
+    sha1_compress_mb(state, block);
+}
+
+// The four nibbles of x (the first character in bits 12-15) as four hexadecimal characters, the first character in the top byte
+template <typename V>
+static inline V chain_hex4_be(const V x)
+{
+    const V t = ((x & 0xf000) << 12) | ((x & 0x0f00) << 8) | ((x & 0x00f0) << 4) | (x & 0x000f);
+    return t + 0x30303030 + (((t + 0x06060606) >> 4) & 0x01010101) * 0x27;
+}
+
+// Same as above, but the first character in the bottom byte
+template <typename V>
+static inline V chain_hex4_le(const V x)
+{
+    const V t = ((x & 0xf000) >> 12) | (x & 0x0f00) | ((x & 0x00f0) << 12) | ((x & 0x000f) << 24);
+    return t + 0x30303030 + (((t + 0x06060606) >> 4) & 0x01010101) * 0x27;
+}
+
+// Builds the padded block of the outer algorithm from the state of the inner one
+template <typename V>
+static inline void chain_hex_block(const HashAlgorithm inner, const V state[5], const HashAlgorithm outer, V block[16])
+{
+    const unsigned int inner_words = (inner == hash_sha1) ? 5 : 4;
+    for (unsigned int i = 0; i < inner_words; ++i)
+    {
+        V first, second; // the characters of a digest word in 16-bit groups, the first character in the top nibble
+        if (inner == hash_sha1)
+        {
+            first = state[i] >> 16;
+            second = state[i] & 0xffff;
+        }
+        else
+        {
+            first = ((state[i] & 0xff) << 8) | ((state[i] >> 8) & 0xff);
+            second = ((state[i] >> 8) & 0xff00) | (state[i] >> 24);
+        }
+        if (outer == hash_sha1)
+        {
+            block[2 * i] = chain_hex4_be(first);
+            block[2 * i + 1] = chain_hex4_be(second);
+        }
+        else
+        {
+            block[2 * i] = chain_hex4_le(first);
+            block[2 * i + 1] = chain_hex4_le(second);
+        }
+    }
+    const unsigned int bits = inner_words * 8 * 8;
+    for (unsigned int i = 2 * inner_words; i < 16; ++i) block[i] = V();
+    if (outer == hash_sha1)
+    {
+        block[2 * inner_words] += 0x80000000;
+        block[15] += bits;
+    }
+    else
+    {
+        block[2 * inner_words] += 0x80;
+        block[14] += bits;
+    }
+}
+
+template <typename V>
+static inline void chain_compress(const HashAlgorithm algorithm, V state[5], const V block[16])
+{
+    if (algorithm == hash_sha1)
+        chain_sha1_block(state, block);
+    else
+        md5_compress_mb(state, block);
+}
+
+// The outer hash of HMAC: the raw inner digest is the single block after the K ^ opad block, which is either precomputed
+// or, for a varying key, derived in registers from the K ^ ipad block of the inner hash
+template <typename V>
+static inline void chain_hmac_outer(const HashChain* chain, V state[5], const V* key_block)
+{
+    const HashAlgorithm algorithm = chain->algorithm[0];
+    const unsigned int words = (algorithm == hash_sha1) ? 5 : 4;
+    V block[16];
+    for (unsigned int i = 0; i < words; ++i) block[i] = state[i];
+    for (unsigned int i = words; i < 16; ++i) block[i] = V();
+    const unsigned int bits = (64 + 4 * words) * 8;
+    if (chain->hmac == hmac_fixed_key)
+    {
+        for (unsigned int i = 0; i < 5; ++i) state[i] = V() + chain->hmac_outer[i];
+    }
+    else
+    {
+        V opad_block[16];
+        for (unsigned int i = 0; i < 16; ++i) opad_block[i] = key_block[i] ^ (CHmacIpad ^ CHmacOpad);
+        for (unsigned int i = 0; i < 5; ++i) state[i] = V() + ((algorithm == hash_sha1) ? CSha1Init[i] : ((i < 4) ? CMd5Init[i] : 0));
+        chain_compress(algorithm, state, opad_block);
+    }
+    if (algorithm == hash_sha1)
+    {
+        block[words] += 0x80000000;
+        block[15] += bits;
+    }
+    else
+    {
+        block[words] += 0x80;
+        block[14] += bits;
+    }
+    chain_compress(algorithm, state, block);
+}
+
+// Takes the state of the innermost algorithm after the last block of the candidate's message and hashes it through the outer algorithms
+// (or the HMAC outer hash, then "key_block" is the K ^ ipad block for a varying key); the final digest is returned as big-endian words
+template <typename V>
+static inline void chain_finish(const HashChain* chain, V state[5], V digest[CChainMaxDigestWords], const V* key_block = 0)
+{
+    HashAlgorithm algorithm = chain->algorithm[0];
+    if (chain->hmac != hmac_none)
+    {
+        chain_hmac_outer(chain, state, key_block);
+    }
+    for (unsigned int step = 1; step < chain->depth; ++step)
+    {
+        V block[16];
+        chain_hex_block(algorithm, state, chain->algorithm[step], block);
+        algorithm = chain->algorithm[step];
+        if (algorithm == hash_sha1)
+        {
+            for (unsigned int i = 0; i < 5; ++i) state[i] = V() + CSha1Init[i];
+        }
+        else
+        {
+            for (unsigned int i = 0; i < 4; ++i) state[i] = V() + CMd5Init[i];
+        }
+        chain_compress(algorithm, state, block);
+    }
+    if (algorithm == hash_sha1)
+    {
+        for (unsigned int i = 0; i < 5; ++i) digest[i] = state[i];
+    }
+    else
+    {
+        for (unsigned int i = 0; i < 4; ++i) digest[i] = mb_bswap(state[i]);
+        digest[4] = V();
+    }
+}
+
+#endif
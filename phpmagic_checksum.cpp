@@ -0,0 +1,555 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+The non-cryptographic algorithms of PHP's hash(), see "phpmagic_checksum.h".
+*/
+
+#include <string.h>
+#include <algorithm>
+#include "phpmagic_checksum.h"
+#include "hash_mb.h"
+
+const uint32_t CAdlerMod = 65521;
+const uint32_t CFnv32Offset = 0x811c9dc5;
+const uint32_t CFnv32Prime = 0x01000193;
+const uint64_t CFnv64Offset = 0xcbf29ce484222325ULL;
+const uint64_t CFnv64Prime = 0x00000100000001b3ULL;
+
+// The 64-bit lanes of a vector of 32-bit lanes, for fnv1a64; they are twice the vector width of the build, so they are written to an
+// out-parameter rather than returned, which would change the ABI and warn (-Wpsabi)
+typedef uint64_t mb_u64 __attribute__((vector_size(2 * sizeof(mb_u32))));
+
+template <typename V> struct ChecksumWide;
+
+template <> struct ChecksumWide<uint32_t> {
+    typedef uint64_t type;
+    static void widen(const uint32_t x, type* wide) { *wide = x; }
+    static uint32_t high(const type& x) { return (uint32_t)(x >> 32); }
+    static uint32_t low(const type& x) { return (uint32_t)x; }
+};
+
+template <> struct ChecksumWide<mb_u32> {
+    typedef mb_u64 type;
+    static void widen(const mb_u32 x, type* wide) { *wide = __builtin_convertvector(x, mb_u64); }
+    static mb_u32 high(const type& x) { return __builtin_convertvector(x >> 32, mb_u32); }
+    static mb_u32 low(const type& x) { return __builtin_convertvector(x, mb_u32); }
+};
+
+typedef struct CrcTable {
+    uint32_t entry[256];
+    CrcTable()
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (unsigned int k = 0; k < 8; ++k)
+            {
+                c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : c >> 1;
+            }
+            entry[i] = c;
+        }
+    }
+} CrcTable;
+
+static const CrcTable CCrcTable;
+
+ChecksumAlgorithm checksum_parse(const std::string& text)
+{
+    if (text == "crc32b") return checksum_crc32b;
+    if (text == "adler32") return checksum_adler32;
+    if (text == "fnv1a32") return checksum_fnv1a32;
+    if (text == "fnv1a64") return checksum_fnv1a64;
+    if (text == "joaat") return checksum_joaat;
+    return checksum_none;
+}
+
+const char* checksum_name(const ChecksumAlgorithm algorithm)
+{
+    switch (algorithm)
+    {
+    case checksum_crc32b: return "crc32b";
+    case checksum_adler32: return "adler32";
+    case checksum_fnv1a32: return "fnv1a32";
+    case checksum_fnv1a64: return "fnv1a64";
+    case checksum_joaat: return "joaat";
+    default: return "";
+    }
+}
+
+unsigned int checksum_digest_nibbles(const ChecksumAlgorithm algorithm)
+{
+    return (algorithm == checksum_fnv1a64) ? 16 : 8;
+}
+
+// The running state: the CRC register, "a" and "b" of adler32 (b in the high half), or the hash value
+static uint64_t checksum_init(const ChecksumAlgorithm algorithm)
+{
+    switch (algorithm)
+    {
+    case checksum_crc32b: return 0xffffffff;
+    case checksum_adler32: return 1;
+    case checksum_fnv1a32: return CFnv32Offset;
+    case checksum_fnv1a64: return CFnv64Offset;
+    default: return 0;
+    }
+}
+
+static inline uint64_t checksum_step(const ChecksumAlgorithm algorithm, const uint64_t state, const unsigned char byte)
+{
+    switch (algorithm)
+    {
+    case checksum_crc32b:
+        return (state >> 8) ^ CCrcTable.entry[(state ^ byte) & 0xff];
+    case checksum_adler32:
+    {
+        const uint64_t a = ((state & 0xffffffff) + byte) % CAdlerMod;
+        const uint64_t b = ((state >> 32) + a) % CAdlerMod;
+        return (b << 32) | a;
+    }
+    case checksum_fnv1a32:
+        return (uint32_t)((state ^ byte) * CFnv32Prime);
+    case checksum_fnv1a64:
+        return (state ^ byte) * CFnv64Prime;
+    default:
+    {
+        uint32_t h = (uint32_t)state + byte;
+        h += h << 10;
+        h ^= h >> 6;
+        return h;
+    }
+    }
+}
+
+static void checksum_final(const ChecksumAlgorithm algorithm, const uint64_t state, uint32_t digest[2])
+{
+    digest[1] = 0;
+    switch (algorithm)
+    {
+    case checksum_crc32b:
+        digest[0] = ~(uint32_t)state;
+        break;
+    case checksum_adler32:
+        digest[0] = (uint32_t)(((state >> 32) << 16) | (state & 0xffff));
+        break;
+    case checksum_fnv1a64:
+        digest[0] = (uint32_t)(state >> 32);
+        digest[1] = (uint32_t)state;
+        break;
+    case checksum_joaat:
+    {
+        uint32_t h = (uint32_t)state;
+        h += h << 3;
+        h ^= h >> 11;
+        h += h << 15;
+        digest[0] = h;
+        break;
+    }
+    default:
+        digest[0] = (uint32_t)state;
+    }
+}
+
+static uint64_t checksum_update(const ChecksumAlgorithm algorithm, uint64_t state, const unsigned char* data, const size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        state = checksum_step(algorithm, state, data[i]);
+    }
+    return state;
+}
+
+void checksum_reference(const ChecksumAlgorithm algorithm, const unsigned char* message, const size_t len, uint32_t digest[2])
+{
+    checksum_final(algorithm, checksum_update(algorithm, checksum_init(algorithm), message, len), digest);
+}
+
+/* ================ crc32b solver ================ */
+
+// Inverts a 32x32 matrix over GF(2) given by its columns; false if it is singular
+static bool gf2_invert(const uint32_t columns[32], uint32_t inverse[32])
+{
+    // the rows of [A | I], reduced to [I | A^-1]
+    uint32_t rows[32];
+    uint32_t augmented[32];
+    for (unsigned int r = 0; r < 32; ++r)
+    {
+        rows[r] = 0;
+        for (unsigned int i = 0; i < 32; ++i)
+        {
+            rows[r] |= ((columns[i] >> r) & 1) << i;
+        }
+        augmented[r] = 1u << r;
+    }
+    for (unsigned int i = 0; i < 32; ++i)
+    {
+        unsigned int pivot = i;
+        while ((pivot < 32) && !((rows[pivot] >> i) & 1)) ++pivot;
+        if (pivot == 32) return false;
+        std::swap(rows[i], rows[pivot]);
+        std::swap(augmented[i], augmented[pivot]);
+        for (unsigned int r = 0; r < 32; ++r)
+        {
+            if ((r != i) && ((rows[r] >> i) & 1))
+            {
+                rows[r] ^= rows[i];
+                augmented[r] ^= augmented[i];
+            }
+        }
+    }
+    for (unsigned int r = 0; r < 32; ++r)
+    {
+        inverse[r] = 0;
+        for (unsigned int i = 0; i < 32; ++i)
+        {
+            inverse[r] |= ((augmented[i] >> r) & 1) << i;
+        }
+    }
+    return true;
+}
+
+static inline uint32_t gf2_apply(const uint32_t columns[32], uint32_t v)
+{
+    uint32_t result = 0;
+    while (v)
+    {
+        result ^= columns[__builtin_ctz(v)];
+        v &= v - 1;
+    }
+    return result;
+}
+
+// The matrix from the 32 bits of the last 4 candidate bytes to the CRC, from the CRC of a zero message with each bit set alone
+static bool prepare_solver(ChecksumSearch* search, const Predicate* predicate)
+{
+    search->solver = false;
+    search->digests.clear();
+    search->solved.clear();
+    if ((search->algorithm != checksum_crc32b) || (search->length < 4)) return false;
+    if (!predicate_enumerate(predicate, CChecksumMaxSolved, &search->digests)) return false;
+
+    std::string message(search->prefix.length() + search->length + search->suffix.length(), '\0');
+    const size_t window = search->prefix.length() + search->length - 4;
+    uint32_t zero[2];
+    checksum_reference(checksum_crc32b, (const unsigned char*)message.data(), message.length(), zero);
+    uint32_t columns[32];
+    for (unsigned int i = 0; i < 32; ++i)
+    {
+        message[window + i / 8] = (char)(1 << (i % 8));
+        uint32_t digest[2];
+        checksum_reference(checksum_crc32b, (const unsigned char*)message.data(), message.length(), digest);
+        columns[i] = digest[0] ^ zero[0];
+        message[window + i / 8] = 0;
+    }
+    if (!gf2_invert(columns, search->inverse)) return false;
+    search->solved.resize(search->digests.size());
+    for (size_t t = 0; t < search->digests.size(); ++t)
+    {
+        search->solved[t] = gf2_apply(search->inverse, search->digests[t]);
+    }
+    search->solver = true;
+    return true;
+}
+
+bool checksum_prepare(ChecksumSearch* search, const ChecksumAlgorithm algorithm, const bool multibuffer, const std::string& prefix,
+    const std::string& charset, const unsigned int length, const std::string& suffix, const Predicate* predicate, std::string* error)
+{
+    if (length > CChecksumMaxCandidate)
+    {
+        *error = "the candidate is longer than " + std::to_string(CChecksumMaxCandidate) + " characters";
+        return false;
+    }
+    search->algorithm = algorithm;
+    search->multibuffer = multibuffer;
+    search->prefix = prefix;
+    search->suffix = suffix;
+    search->charset = charset;
+    search->length = length;
+    search->state_prefix = checksum_update(algorithm, checksum_init(algorithm), (const unsigned char*)prefix.data(), prefix.length());
+
+    const size_t padded = (charset.length() + CMbLanes - 1) / CMbLanes * CMbLanes;
+    search->lane_chars.assign(padded, (unsigned char)charset[0]);
+    search->lane_delta.assign(padded, 0);
+    for (int i = 0; i < 256; ++i)
+    {
+        search->charset_digit[i] = -1;
+    }
+    // the contribution of a character in the last position does not depend on the rest of the message of the same length
+    std::string zero(length + suffix.length(), '\0');
+    uint32_t zero_digest[2];
+    checksum_reference(checksum_crc32b, (const unsigned char*)zero.data(), zero.length(), zero_digest);
+    for (size_t k = 0; k < charset.length(); ++k)
+    {
+        const unsigned char c = (unsigned char)charset[k];
+        search->lane_chars[k] = c;
+        search->charset_digit[c] = (int)k;
+        if ((algorithm == checksum_crc32b) && (length > 0))
+        {
+            zero[length - 1] = (char)c;
+            uint32_t digest[2];
+            checksum_reference(checksum_crc32b, (const unsigned char*)zero.data(), zero.length(), digest);
+            search->lane_delta[k] = digest[0] ^ zero_digest[0];
+            zero[length - 1] = 0;
+        }
+        else if (algorithm == checksum_adler32)
+        {
+            search->lane_delta[k] = (uint32_t)((uint64_t)(suffix.length() + 1) * c % CAdlerMod);
+        }
+    }
+    prepare_solver(search, predicate);
+    return true;
+}
+
+/* ================ Row by row ================ */
+
+// A row: the candidates that differ in the last character
+typedef struct {
+    uint64_t state;  // after the prefix and the other characters
+    uint64_t zero;   // crc32b and adler32: the final state with a zero byte for the last character
+} ChecksumRow;
+
+// The digests of the characters "first" to "first" + lanes - 1 of the character set in the last position
+template <typename V>
+static void hash_lanes(const ChecksumSearch* search, const ChecksumRow* row, const unsigned int first, uint32_t high[CMbLanes], uint32_t low[CMbLanes])
+{
+    const V c = mb_load<V>(&search->lane_chars[first]);
+    const unsigned char* suffix = (const unsigned char*)search->suffix.data();
+    const size_t suffix_len = search->suffix.length();
+    switch (search->algorithm)
+    {
+    case checksum_crc32b:
+        mb_store(high, ~((V() + (uint32_t)row->zero) ^ mb_load<V>(&search->lane_delta[first])));
+        break;
+    case checksum_adler32:
+    {
+        V a = (V() + (uint32_t)(row->zero & 0xffffffff)) + c;
+        a = (a >= CAdlerMod) ? a - CAdlerMod : a;
+        V b = (V() + (uint32_t)(row->zero >> 32)) + mb_load<V>(&search->lane_delta[first]);
+        b = (b >= CAdlerMod) ? b - CAdlerMod : b;
+        mb_store(high, (b << 16) | a);
+        break;
+    }
+    case checksum_fnv1a32:
+    {
+        V h = ((V() + (uint32_t)row->state) ^ c) * CFnv32Prime;
+        for (size_t i = 0; i < suffix_len; ++i)
+        {
+            h = (h ^ (uint32_t)suffix[i]) * CFnv32Prime;
+        }
+        mb_store(high, h);
+        break;
+    }
+    case checksum_fnv1a64:
+    {
+        typedef ChecksumWide<V> W;
+        typename W::type h, wide_c;
+        W::widen(V(), &h);
+        W::widen(c, &wide_c);
+        h = ((h + row->state) ^ wide_c) * CFnv64Prime;
+        for (size_t i = 0; i < suffix_len; ++i)
+        {
+            h = (h ^ (uint64_t)suffix[i]) * CFnv64Prime;
+        }
+        mb_store(high, W::high(h));
+        mb_store(low, W::low(h));
+        break;
+    }
+    default:
+    {
+        V h = (V() + (uint32_t)row->state) + c;
+        h += h << 10;
+        h ^= h >> 6;
+        for (size_t i = 0; i < suffix_len; ++i)
+        {
+            h += (uint32_t)suffix[i];
+            h += h << 10;
+            h ^= h >> 6;
+        }
+        h += h << 3;
+        h ^= h >> 11;
+        h += h << 15;
+        mb_store(high, h);
+    }
+    }
+}
+
+// Searches the candidates "from" to "to" - 1; false once a hit does not fit
+static bool search_rows(const ChecksumSearch* search, const Predicate* predicate, const uint64_t from, const uint64_t to, const uint64_t start,
+    ChecksumHit* hits, const unsigned int capacity, unsigned int* found, uint64_t* hashed)
+{
+    const ChecksumAlgorithm algorithm = search->algorithm;
+    const unsigned int length = search->length;
+    const unsigned int radix = (unsigned int)search->charset.length();
+    const unsigned int lanes = search->multibuffer ? CMbLanes : 1;
+    unsigned int digits[CChecksumMaxCandidate];
+    uint64_t index = from;
+    for (unsigned int i = length; i > 0; --i)
+    {
+        digits[i - 1] = (unsigned int)(index % radix);
+        index /= radix;
+    }
+    uint64_t states[CChecksumMaxCandidate];
+    states[0] = search->state_prefix;
+    for (unsigned int i = 0; i + 1 < length; ++i)
+    {
+        states[i + 1] = checksum_step(algorithm, states[i], (unsigned char)search->charset[digits[i]]);
+    }
+
+    alignas(64) uint32_t high[CMbLanes];
+    alignas(64) uint32_t low[CMbLanes];
+    memset(low, 0, sizeof(low));
+    index = from;
+    while (index < to)
+    {
+        ChecksumRow row;
+        row.state = states[length - 1];
+        row.zero = checksum_update(algorithm, checksum_step(algorithm, row.state, 0), (const unsigned char*)search->suffix.data(), search->suffix.length());
+        const unsigned int first_char = digits[length - 1];
+        const unsigned int end_char = (to - index < radix - first_char) ? first_char + (unsigned int)(to - index) : radix;
+        for (unsigned int k = first_char / lanes * lanes; k < end_char; k += lanes)
+        {
+            if (search->multibuffer)
+                hash_lanes<mb_u32>(search, &row, k, high, low);
+            else
+                hash_lanes<uint32_t>(search, &row, k, high, low);
+            uint32_t gate = predicate_gate_lanes(predicate, high, lanes);
+            for (unsigned int lane = 0; gate && (lane < lanes); ++lane)
+            {
+                if (!((gate >> lane) & 1) || (k + lane < first_char) || (k + lane >= end_char)) continue;
+                const uint32_t digest[2] = { high[lane], low[lane] };
+                const uint32_t matched = predicate_match(predicate, digest);
+                if (!matched) continue;
+                const uint64_t hit_index = index + (k + lane - first_char);
+                if (*found == capacity)
+                {
+                    *hashed = hit_index - start;
+                    return false;
+                }
+                ChecksumHit* hit = &hits[*found];
+                hit->index = hit_index;
+                hit->digest[0] = digest[0];
+                hit->digest[1] = digest[1];
+                hit->patterns = matched;
+                ++*found;
+            }
+        }
+        index += end_char - first_char;
+
+        // the next row, the states are updated from the changed character on
+        digits[length - 1] = 0;
+        unsigned int changed = length - 1;
+        while (changed > 0)
+        {
+            if (++digits[changed - 1] < radix) break;
+            digits[changed - 1] = 0;
+            --changed;
+        }
+        if (changed == 0) break;
+        for (unsigned int i = changed - 1; i + 1 < length; ++i)
+        {
+            states[i + 1] = checksum_step(algorithm, states[i], (unsigned char)search->charset[digits[i]]);
+        }
+    }
+    return true;
+}
+
+// Solves the block of the candidates that share all but the last 4 characters, from "from" to "to" - 1: each listed digest gives one candidate
+static bool solve_block(const ChecksumSearch* search, const Predicate* predicate, const uint64_t block, const uint64_t from, const uint64_t to,
+    const uint64_t start, std::vector<ChecksumHit>& pending, ChecksumHit* hits, const unsigned int capacity, unsigned int* found, uint64_t* hashed)
+{
+    const unsigned int length = search->length;
+    const uint64_t radix = search->charset.length();
+    const uint64_t block_size = radix * radix * radix * radix;
+    const uint64_t block_base = block * block_size;
+    unsigned char lead[CChecksumMaxCandidate];
+    uint64_t rest = block;
+    for (unsigned int i = length - 4; i > 0; --i)
+    {
+        lead[i - 1] = (unsigned char)search->charset[rest % radix];
+        rest /= radix;
+    }
+    uint64_t state = checksum_update(checksum_crc32b, search->state_prefix, lead, length - 4);
+    const unsigned char zero[4] = { 0, 0, 0, 0 };
+    state = checksum_update(checksum_crc32b, state, zero, 4);
+    state = checksum_update(checksum_crc32b, state, (const unsigned char*)search->suffix.data(), search->suffix.length());
+    const uint32_t base = gf2_apply(search->inverse, ~(uint32_t)state);
+
+    pending.clear();
+    const int* digit = search->charset_digit;
+    for (size_t t = 0; t < search->solved.size(); ++t)
+    {
+        const uint32_t x = search->solved[t] ^ base;
+        const int d0 = digit[x & 0xff];
+        const int d1 = digit[(x >> 8) & 0xff];
+        const int d2 = digit[(x >> 16) & 0xff];
+        const int d3 = digit[x >> 24];
+        if ((d0 | d1 | d2 | d3) < 0) continue;
+        const uint64_t index = block_base + (((uint64_t)d0 * radix + d1) * radix + d2) * radix + d3;
+        if ((index < from) || (index >= to)) continue;
+        ChecksumHit hit;
+        hit.index = index;
+        hit.digest[0] = search->digests[t];
+        hit.digest[1] = 0;
+        hit.patterns = predicate_match(predicate, hit.digest);
+        pending.push_back(hit);
+    }
+    std::sort(pending.begin(), pending.end(), [](const ChecksumHit& a, const ChecksumHit& b) { return a.index < b.index; });
+    for (size_t i = 0; i < pending.size(); ++i)
+    {
+        if (*found == capacity)
+        {
+            *hashed = pending[i].index - start;
+            return false;
+        }
+        hits[(*found)++] = pending[i];
+    }
+    return true;
+}
+
+void checksum_search(const ChecksumSearch* search, const Predicate* predicate, const uint64_t start, const uint64_t count,
+    ChecksumHit* hits, const unsigned int capacity, unsigned int* found, uint64_t* hashed)
+{
+    *found = 0;
+    *hashed = count;
+    if (count == 0) return;
+    if (search->length == 0)
+    {
+        // the only candidate is empty
+        const std::string message = search->prefix + search->suffix;
+        ChecksumHit hit;
+        hit.index = 0;
+        checksum_reference(search->algorithm, (const unsigned char*)message.data(), message.length(), hit.digest);
+        hit.patterns = predicate_match(predicate, hit.digest);
+        if (!hit.patterns) return;
+        if (capacity == 0)
+        {
+            *hashed = 0;
+            return;
+        }
+        hits[(*found)++] = hit;
+        return;
+    }
+    if (!search->solver)
+    {
+        search_rows(search, predicate, start, start + count, start, hits, capacity, found, hashed);
+        return;
+    }
+    // block by block, solved if it has more candidates in the range than there are digests and its hits are expected to fit: a block whose hits
+    // do not fit would be solved again from the first one that did not
+    const uint64_t radix = search->charset.length();
+    const uint64_t block_size = radix * radix * radix * radix;
+    std::vector<ChecksumHit> pending;
+    uint64_t index = start;
+    while (index < start + count)
+    {
+        const uint64_t block = index / block_size;
+        const uint64_t end = ((block + 1) * block_size < start + count) ? (block + 1) * block_size : start + count;
+        const bool solve = (end - index > search->solved.size()) && ((double)(end - index) * predicate->probability <= (double)(capacity - *found));
+        const bool more = solve
+            ? solve_block(search, predicate, block, index, end, start, pending, hits, capacity, found, hashed)
+            : search_rows(search, predicate, index, end, start, hits, capacity, found, hashed);
+        if (!more) return;
+        index = end;
+    }
+}
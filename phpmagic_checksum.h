@@ -0,0 +1,78 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+The non-cryptographic algorithms of PHP's hash(): crc32b, adler32, fnv1a32, fnv1a64 and joaat, with their hexadecimal output as PHP prints it.
+
+The candidates are searched row by row, a row being the candidates that differ in the last character only: the state after the rest of the
+message is kept per character position and updated from the changed one on, and the last character is taken for all the lanes at once
+(CMbLanes characters of the character set per vector). The algorithms are cheap enough that this is far faster than SHA-1:
+- crc32b and adler32 are linear in the message bytes for a fixed length, so a row is hashed once with a zero byte in place of the last
+  character and each candidate adds the precomputed contribution of its character: an XOR (crc32b) or two additions modulo 65521 (adler32);
+- fnv1a32, fnv1a64 and joaat take the last character and the suffix through their steps in the lanes.
+
+crc32b is also solved algebraically. Over GF(2), the CRC of a message of a fixed length is an affine function of the bits of any 4 bytes of it,
+and a bijective one, so the last 4 characters of a candidate that give a digest are found from the digest by a 32x32 bit matrix. The digests
+that match the patterns are listed once (if there are not too many of them, see CChecksumMaxSolved), and for each 4-character block of the
+keyspace each listed digest gives its only candidate, a hit if its 4 bytes are in the character set. A block is solved rather than hashed
+when it has more candidates in the range than there are listed digests, e.g. a 78-character set and "0+e[0-9]*" give 37 million candidates
+per block against 1.1 million digests.
+*/
+
+#ifndef PHPMAGIC_CHECKSUM_H
+#define PHPMAGIC_CHECKSUM_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include "phpmagic_predicate.h"
+
+enum ChecksumAlgorithm { checksum_none, checksum_crc32b, checksum_adler32, checksum_fnv1a32, checksum_fnv1a64, checksum_joaat };
+
+const unsigned int CChecksumMaxCandidate = 64;
+const uint64_t CChecksumMaxSolved = 1 << 22;  // digests listed for the crc32b solver
+
+// "crc32b", "adler32", "fnv1a32", "fnv1a64" or "joaat"; checksum_none for the others
+ChecksumAlgorithm checksum_parse(const std::string& text);
+const char* checksum_name(const ChecksumAlgorithm algorithm);
+unsigned int checksum_digest_nibbles(const ChecksumAlgorithm algorithm);
+
+// Byte by byte, as PHP computes it; the digest is returned as big-endian words, as for the other algorithms
+void checksum_reference(const ChecksumAlgorithm algorithm, const unsigned char* message, const size_t len, uint32_t digest[2]);
+
+// A configured search: the constant parts of the message and what is precomputed from them
+typedef struct {
+    ChecksumAlgorithm algorithm;
+    bool multibuffer;
+    std::string prefix;            // the salt prefix and the base
+    std::string suffix;            // the salt suffix
+    std::string charset;
+    unsigned int length;           // of the candidate
+    uint64_t state_prefix;         // the state after the prefix
+    std::vector<uint32_t> lane_chars;  // the character set, padded to a multiple of CMbLanes
+    std::vector<uint32_t> lane_delta;  // per character in the last position, crc32b: its CRC difference; adler32: its addition to "b"
+    // the crc32b solver
+    bool solver;
+    uint32_t inverse[32];           // the columns of the matrix that gives the 4 last bytes from a CRC difference
+    std::vector<uint32_t> digests;  // that match the patterns
+    std::vector<uint32_t> solved;   // the digests through the inverse matrix
+    int charset_digit[256];         // -1 for the bytes out of the character set
+} ChecksumSearch;
+
+bool checksum_prepare(ChecksumSearch* search, const ChecksumAlgorithm algorithm, const bool multibuffer, const std::string& prefix,
+    const std::string& charset, const unsigned int length, const std::string& suffix, const Predicate* predicate, std::string* error);
+
+typedef struct {
+    uint64_t index;
+    uint32_t digest[2];
+    uint32_t patterns;
+} ChecksumHit;
+
+// Searches the candidates from "start" on, at most "count" of them, in the order of their indexes until "capacity" hits are stored;
+// "hashed" is then the number of the candidates before the first one not stored
+void checksum_search(const ChecksumSearch* search, const Predicate* predicate, const uint64_t start, const uint64_t count,
+    ChecksumHit* hits, const unsigned int capacity, unsigned int* found, uint64_t* hashed);
+
+#endif
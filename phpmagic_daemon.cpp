@@ -0,0 +1,666 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Persistent search service, see "phpmagic_daemon.h".
+*/
+
+#ifndef DISABLE_MPI
+#include <mpi.h>
+#endif
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "phpmagic_daemon.h"
+#include "phpmagic_search.h"
+
+const uint64_t CDaemonUnit = 1 << 20;
+const unsigned int CDaemonMaxHits = 64;  // per unit, the rest of the unit is handed out again
+const int CDaemonIdleWait = 200;         // milliseconds of poll() when there is nothing to hash
+
+const int CDaemonTagSpec = 1;
+const int CDaemonTagUnit = 2;
+const int CDaemonTagForget = 3;
+const int CDaemonTagStop = 4;
+const int CDaemonTagResult = 5;
+
+// A job line parsed into the options of the library
+typedef struct {
+    std::string hash;
+    std::vector<std::string> patterns;
+    std::vector<const char*> pattern_texts;
+    std::string charset;
+    std::string token;
+    std::string base;
+    std::string salt_prefix;
+    std::string salt_suffix;
+    std::string hmac_key;
+    std::string hmac_message;
+    std::string targets;
+    bool hmac_fixed;
+    bool hmac_varying;
+    int engine;
+    int jit;
+    unsigned int length;
+    uint64_t start;
+    uint64_t quota;
+    uint64_t max_hits;
+    phpmagic_options options;
+} DaemonSpec;
+
+// The result of a unit, followed by "hit_count" hits
+typedef struct {
+    uint64_t job;
+    uint64_t start;
+    uint64_t count;
+    uint64_t hashes;
+    uint32_t hit_count;
+    int32_t status;  // -1 if the engine disagreed with the reference implementation on the hit after the others
+} DaemonResult;
+
+typedef struct {
+    uint64_t id;
+    int fd;
+    std::string line;
+    DaemonSpec spec;
+    phpmagic_config* config;
+    std::deque<std::pair<uint64_t, uint64_t> > ranges;  // not handed out yet, [begin, end)
+    uint64_t hashes;
+    uint64_t hits;
+    unsigned int outstanding;
+    std::chrono::high_resolution_clock::time_point time_begin;
+} DaemonJob;
+
+typedef struct {
+    std::string input;
+    uint64_t job;  // 0 until the client sends its job
+} DaemonClient;
+
+static bool parse_number(const std::string& text, uint64_t* value)
+{
+    char* end = 0;
+    errno = 0;
+    *value = strtoull(text.c_str(), &end, 10);
+    return !text.empty() && (errno == 0) && (*end == 0) && (text[0] != '-');
+}
+
+static bool daemon_parse(const std::string& line, DaemonSpec* spec, std::string* error)
+{
+    spec->hash = "sha1";
+    spec->hmac_fixed = false;
+    spec->hmac_varying = false;
+    spec->engine = PHPMAGIC_ENGINE_AUTO;
+    spec->jit = 0;
+    spec->length = 0;
+    spec->start = 0;
+    spec->quota = UINT64_MAX;
+    spec->max_hits = 1;
+    bool has_length = false;
+    std::string::size_type i = 0;
+    while (i < line.length())
+    {
+        std::string::size_type j = line.find('\t', i);
+        if (j == std::string::npos) j = line.length();
+        const std::string field = line.substr(i, j - i);
+        i = j + 1;
+        if (field.empty()) continue;
+        const std::string::size_type eq = field.find('=');
+        if (eq == std::string::npos)
+        {
+            *error = "expected key=value, got '" + field + "'";
+            return false;
+        }
+        const std::string key = field.substr(0, eq);
+        const std::string value = field.substr(eq + 1);
+        uint64_t number = 0;
+        if (key == "hash") spec->hash = value;
+        else if (key == "pattern") spec->patterns.push_back(value);
+        else if (key == "charset") spec->charset = value;
+        else if (key == "token") spec->token = value;
+        else if (key == "base") spec->base = value;
+        else if (key == "salt-prefix") spec->salt_prefix = value;
+        else if (key == "salt-suffix") spec->salt_suffix = value;
+        else if (key == "targets") spec->targets = value;
+        else if (key == "hmac-key") { spec->hmac_key = value; spec->hmac_fixed = true; }
+        else if (key == "hmac-message") { spec->hmac_message = value; spec->hmac_varying = true; }
+        else if ((key == "engine") && ((value == "single") || (value == "multibuffer")))
+            spec->engine = (value == "single") ? PHPMAGIC_ENGINE_SINGLE : PHPMAGIC_ENGINE_MULTIBUFFER;
+        else if ((key == "jit") && ((value == "0") || (value == "1"))) spec->jit = (value == "1") ? 1 : 0;
+        else if ((key == "length") && parse_number(value, &number) && (number <= PHPMAGIC_MAX_CANDIDATE)) { spec->length = (unsigned int)number; has_length = true; }
+        else if ((key == "start") && parse_number(value, &number)) spec->start = number;
+        else if ((key == "quota") && parse_number(value, &number)) spec->quota = number;
+        else if ((key == "hits") && parse_number(value, &number)) spec->max_hits = number;
+        else
+        {
+            *error = "unknown or invalid field '" + field + "'";
+            return false;
+        }
+    }
+    if (spec->token.empty() && (spec->charset.empty() || !has_length))
+    {
+        *error = "charset and length, or token, are required";
+        return false;
+    }
+    for (std::vector<std::string>::size_type p = 0; p < spec->patterns.size(); ++p)
+    {
+        spec->pattern_texts.push_back(spec->patterns[p].c_str());
+    }
+    memset(&spec->options, 0, sizeof(spec->options));
+    spec->options.hash = spec->hash.c_str();
+    spec->options.patterns = spec->pattern_texts.empty() ? 0 : &(spec->pattern_texts[0]);
+    spec->options.pattern_count = (unsigned int)spec->pattern_texts.size();
+    spec->options.charset = spec->charset.c_str();
+    spec->options.length = spec->length;
+    spec->options.token = spec->token.empty() ? 0 : spec->token.c_str();
+    spec->options.base = spec->base.c_str();
+    spec->options.salt_prefix = spec->salt_prefix.c_str();
+    spec->options.salt_suffix = spec->salt_suffix.c_str();
+    spec->options.hmac_key = spec->hmac_fixed ? spec->hmac_key.c_str() : 0;
+    spec->options.hmac_message = spec->hmac_varying ? spec->hmac_message.c_str() : 0;
+    spec->options.engine = spec->engine;
+    spec->options.jit = spec->jit;
+    spec->options.targets = spec->targets.empty() ? 0 : spec->targets.c_str();
+    return true;
+}
+
+// Hashes a unit until CDaemonMaxHits hits are found
+static void daemon_work(const phpmagic_config* config, const uint64_t job, const uint64_t start, const uint64_t count, DaemonResult* result, phpmagic_hit* hits)
+{
+    result->job = job;
+    result->start = start;
+    result->count = count;
+    result->hashes = 0;
+    result->hit_count = 0;
+    result->status = 0;
+    phpmagic_results results;
+    while ((result->hashes < count) && (result->hit_count < CDaemonMaxHits))
+    {
+        results.hits = hits + result->hit_count;
+        results.capacity = CDaemonMaxHits - result->hit_count;
+        const int status = phpmagic_search_range(config, start + result->hashes, count - result->hashes, &results);
+        result->hit_count += results.count;
+        result->hashes += results.hashes;
+        if (status != 0)
+        {
+            result->status = status;
+            return;
+        }
+        if (results.hashes == 0) break;
+    }
+}
+
+static void send_line(const int fd, const std::string& line)
+{
+    std::string::size_type done = 0;
+    while (done < line.length())
+    {
+        const ssize_t sent = send(fd, line.data() + done, line.length() - done, MSG_NOSIGNAL);
+        if (sent <= 0)
+        {
+            if ((sent < 0) && (errno == EINTR)) continue;
+            if ((sent < 0) && (errno == EAGAIN))
+            {
+                struct pollfd p = { fd, POLLOUT, 0 };
+                poll(&p, 1, 100);
+                continue;
+            }
+            return;
+        }
+        done += (std::string::size_type)sent;
+    }
+}
+
+class DaemonCoordinator
+{
+public:
+    DaemonCoordinator(const int mpi_total) : mpi_total(mpi_total), next_id(1), last_scheduled(0), idle(mpi_total, true), known(mpi_total) {}
+
+    int run(const std::string& socket_path);
+
+private:
+    int mpi_total;
+    uint64_t next_id;
+    uint64_t last_scheduled;
+    std::map<uint64_t, DaemonJob*> jobs;   // in the order they came
+    std::map<int, DaemonClient> clients;
+    std::vector<bool> idle;                // the processors without a unit
+    std::vector<std::set<uint64_t> > known; // the jobs whose configuration a processor has
+
+    void accept_line(const int fd, const std::string& line, bool* running);
+    DaemonJob* next_job();
+    bool take_unit(DaemonJob* job, uint64_t* start, uint64_t* count);
+    void dispatch();
+    void handle_result(const DaemonResult* result, const phpmagic_hit* hits);
+    void finish(DaemonJob* job, const std::string& line);
+    void drop_client(const int fd);
+};
+
+void DaemonCoordinator::accept_line(const int fd, const std::string& line, bool* running)
+{
+    if (line == "shutdown")
+    {
+        send_line(fd, "ok\n");
+        *running = false;
+        drop_client(fd);
+        return;
+    }
+    DaemonJob* job = new DaemonJob;
+    std::string error;
+    if (daemon_parse(line, &job->spec, &error))
+    {
+        char config_error[256];
+        job->config = phpmagic_config_new(&job->spec.options, config_error, sizeof(config_error));
+        if (!job->config) error = config_error;
+    }
+    if (!error.empty())
+    {
+        send_line(fd, "error\t" + error + "\n");
+        delete job;
+        drop_client(fd);
+        return;
+    }
+    job->id = next_id++;
+    job->fd = fd;
+    job->line = line;
+    job->hashes = 0;
+    job->hits = 0;
+    job->outstanding = 0;
+    job->time_begin = std::chrono::high_resolution_clock::now();
+    const uint64_t keyspace = phpmagic_keyspace(job->config);
+    const uint64_t begin = (job->spec.start < keyspace) ? job->spec.start : keyspace;
+    const uint64_t end = (job->spec.quota < keyspace - begin) ? begin + job->spec.quota : keyspace;
+    if (end > begin)
+    {
+        job->ranges.push_back(std::make_pair(begin, end));
+    }
+    jobs[job->id] = job;
+    clients[fd].job = job->id;
+    send_line(fd, "queued\t" + std::to_string(job->id) + "\t" + std::to_string(end - begin) + "\n");
+    if (end == begin)
+    {
+        finish(job, "");
+    }
+}
+
+// The jobs are taken in turn, a unit each
+DaemonJob* DaemonCoordinator::next_job()
+{
+    std::map<uint64_t, DaemonJob*>::iterator it = jobs.upper_bound(last_scheduled);
+    for (unsigned int pass = 0; pass < 2; ++pass)
+    {
+        for (; it != jobs.end(); ++it)
+        {
+            if (!it->second->ranges.empty())
+            {
+                last_scheduled = it->first;
+                return it->second;
+            }
+        }
+        it = jobs.begin();
+    }
+    return 0;
+}
+
+bool DaemonCoordinator::take_unit(DaemonJob* job, uint64_t* start, uint64_t* count)
+{
+    std::pair<uint64_t, uint64_t>& range = job->ranges.front();
+    *start = range.first;
+    *count = (range.second - range.first > CDaemonUnit) ? CDaemonUnit : range.second - range.first;
+    range.first += *count;
+    if (range.first == range.second)
+    {
+        job->ranges.pop_front();
+    }
+    ++job->outstanding;
+    return true;
+}
+
+void DaemonCoordinator::dispatch()
+{
+#ifndef DISABLE_MPI
+    for (int w = 1; w < mpi_total; ++w)
+    {
+        if (!idle[w]) continue;
+        DaemonJob* job = next_job();
+        if (!job) break;
+        uint64_t unit[3];
+        unit[0] = job->id;
+        take_unit(job, &unit[1], &unit[2]);
+        if (known[w].insert(job->id).second)
+        {
+            std::string spec(sizeof(uint64_t), '\0');
+            memcpy(&spec[0], &job->id, sizeof(uint64_t));
+            spec += job->line;
+            MPI_Send(&spec[0], (int)spec.length(), MPI_BYTE, w, CDaemonTagSpec, MPI_COMM_WORLD);
+        }
+        MPI_Send(unit, sizeof(unit), MPI_BYTE, w, CDaemonTagUnit, MPI_COMM_WORLD);
+        idle[w] = false;
+    }
+#endif
+    if (mpi_total == 1)
+    {
+        DaemonJob* job = next_job();
+        if (!job) return;
+        std::vector<unsigned char> buffer(sizeof(DaemonResult) + CDaemonMaxHits * sizeof(phpmagic_hit));
+        DaemonResult* result = (DaemonResult*)&buffer[0];
+        phpmagic_hit* hits = (phpmagic_hit*)&buffer[sizeof(DaemonResult)];
+        uint64_t start, count;
+        take_unit(job, &start, &count);
+        daemon_work(job->config, job->id, start, count, result, hits);
+        handle_result(result, hits);
+    }
+}
+
+void DaemonCoordinator::handle_result(const DaemonResult* result, const phpmagic_hit* hits)
+{
+    std::map<uint64_t, DaemonJob*>::iterator it = jobs.find(result->job);
+    if (it == jobs.end())
+    {
+        // finished or cancelled meanwhile
+        return;
+    }
+    DaemonJob* job = it->second;
+    --job->outstanding;
+    job->hashes += result->hashes;
+    static const char dec2hex[16 + 1] = "0123456789abcdef";
+    const unsigned int digest_nibbles = phpmagic_digest_nibbles(job->config);
+    for (uint32_t h = 0; h < result->hit_count; ++h)
+    {
+        if ((job->spec.max_hits > 0) && (job->hits >= job->spec.max_hits)) break;
+        std::string line = "hit\t" + std::to_string(hits[h].index) + "\t" + hits[h].message + "\t";
+        for (unsigned int i = 0; i < digest_nibbles; i++)
+        {
+            line += dec2hex[(hits[h].digest[i / 8] >> (28 - 4 * (i % 8))) & 15];
+        }
+        send_line(job->fd, line + "\n");
+        ++job->hits;
+    }
+    if (result->status != 0)
+    {
+        finish(job, std::string("error\tengine error: the digest of '") + hits[result->hit_count].message + "' does not match the reference implementation\n");
+        return;
+    }
+    if (result->hashes < result->count)
+    {
+        // the unit stopped at a hit that did not fit
+        job->ranges.push_front(std::make_pair(result->start + result->hashes, result->start + result->count));
+    }
+    if (((job->spec.max_hits > 0) && (job->hits >= job->spec.max_hits)) || (job->ranges.empty() && (job->outstanding == 0)))
+    {
+        finish(job, "");
+    }
+}
+
+// Ends a job with "line", or with the "done" line if it is empty
+void DaemonCoordinator::finish(DaemonJob* job, const std::string& line)
+{
+    if (job->fd >= 0)
+    {
+        auto ms_count = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - job->time_begin).count();
+        send_line(job->fd, line.empty() ? "done\t" + std::to_string(job->hashes) + "\t" + std::to_string(job->hits) + "\t" + std::to_string(ms_count) + "\n" : line);
+        const int fd = job->fd;
+        job->fd = -1;
+        drop_client(fd);
+    }
+#ifndef DISABLE_MPI
+    for (int w = 1; w < mpi_total; ++w)
+    {
+        if (known[w].erase(job->id))
+        {
+            MPI_Send(&job->id, sizeof(job->id), MPI_BYTE, w, CDaemonTagForget, MPI_COMM_WORLD);
+        }
+    }
+#endif
+    jobs.erase(job->id);
+    phpmagic_config_free(job->config);
+    delete job;
+}
+
+void DaemonCoordinator::drop_client(const int fd)
+{
+    std::map<int, DaemonClient>::iterator it = clients.find(fd);
+    if (it == clients.end()) return;
+    const uint64_t id = it->second.job;
+    clients.erase(it);
+    close(fd);
+    std::map<uint64_t, DaemonJob*>::iterator job = jobs.find(id);
+    if ((job != jobs.end()) && (job->second->fd == fd))
+    {
+        // the client went away before its job ended
+        job->second->fd = -1;
+        finish(job->second, "");
+    }
+}
+
+int DaemonCoordinator::run(const std::string& socket_path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.length() >= sizeof(address.sun_path))
+    {
+        std::cerr << "The socket path '" << socket_path << "' is too long" << std::endl;
+        return 1;
+    }
+    memcpy(address.sun_path, socket_path.c_str(), socket_path.length());
+    struct stat st;
+    if ((lstat(socket_path.c_str(), &st) == 0) && S_ISSOCK(st.st_mode))
+    {
+        // left by a previous daemon
+        unlink(socket_path.c_str());
+    }
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((listener < 0) || (bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0) || (listen(listener, 64) != 0))
+    {
+        std::cerr << "Cannot listen on '" << socket_path << "': " << strerror(errno) << std::endl;
+        if (listener >= 0) close(listener);
+        return 1;
+    }
+    fcntl(listener, F_SETFL, O_NONBLOCK);
+
+    bool running = true;
+    while (running)
+    {
+        std::vector<struct pollfd> fds;
+        struct pollfd listen_fd = { listener, POLLIN, 0 };
+        fds.push_back(listen_fd);
+        for (std::map<int, DaemonClient>::iterator it = clients.begin(); it != clients.end(); ++it)
+        {
+            // after its job line, a client is only watched for hanging up
+            struct pollfd client_fd = { it->first, (short)((it->second.job == 0) ? POLLIN : 0), 0 };
+            fds.push_back(client_fd);
+        }
+        bool working = false;
+        for (std::map<uint64_t, DaemonJob*>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+        {
+            working = working || !it->second->ranges.empty() || (it->second->outstanding > 0);
+        }
+        // with other processors, their results are polled for every millisecond
+        const int timeout = working ? ((mpi_total == 1) ? 0 : 1) : CDaemonIdleWait;
+        if (poll(&fds[0], fds.size(), timeout) < 0)
+        {
+            if (errno == EINTR) continue;
+            std::cerr << "poll error: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int fd;
+            while ((fd = accept(listener, 0, 0)) >= 0)
+            {
+                fcntl(fd, F_SETFL, O_NONBLOCK);
+                clients[fd].job = 0;
+            }
+        }
+        for (std::vector<struct pollfd>::size_type i = 1; running && (i < fds.size()); ++i)
+        {
+            const int fd = fds[i].fd;
+            if (clients.find(fd) == clients.end()) continue;
+            // a client with a job cancels it by hanging up; one without is read first, so that a line sent just before closing is not lost,
+            // and dropped when recv() finds the end of its input
+            const bool hung_up = (fds[i].revents & (POLLHUP | POLLERR)) != 0;
+            if (hung_up && (clients[fd].job != 0))
+            {
+                drop_client(fd);
+                continue;
+            }
+            if (!(fds[i].revents & POLLIN) && !hung_up) continue;
+            char buffer[4096];
+            const ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0)
+            {
+                if ((received < 0) && ((errno == EAGAIN) || (errno == EINTR))) continue;
+                drop_client(fd);
+                continue;
+            }
+            DaemonClient& client = clients[fd];
+            client.input.append(buffer, (std::string::size_type)received);
+            const std::string::size_type newline = client.input.find('\n');
+            if (newline != std::string::npos)
+            {
+                std::string line = client.input.substr(0, newline);
+                if (!line.empty() && (line[line.length() - 1] == '\r')) line.erase(line.length() - 1);
+                client.input.clear();
+                accept_line(fd, line, &running);
+            }
+            else if (client.input.length() > 65536)
+            {
+                send_line(fd, "error\tthe job line is too long\n");
+                drop_client(fd);
+            }
+        }
+
+#ifndef DISABLE_MPI
+        int flag = 1;
+        while (flag)
+        {
+            MPI_Status status;
+            MPI_Iprobe(MPI_ANY_SOURCE, CDaemonTagResult, MPI_COMM_WORLD, &flag, &status);
+            if (!flag) break;
+            int len = 0;
+            MPI_Get_count(&status, MPI_BYTE, &len);
+            std::vector<unsigned char> buffer(len);
+            MPI_Recv(&buffer[0], len, MPI_BYTE, status.MPI_SOURCE, CDaemonTagResult, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            idle[status.MPI_SOURCE] = true;
+            handle_result((const DaemonResult*)&buffer[0], (const phpmagic_hit*)&buffer[sizeof(DaemonResult)]);
+        }
+#endif
+        dispatch();
+    }
+
+    // the units in flight are waited for, then the workers are stopped
+    while (!clients.empty())
+    {
+        drop_client(clients.begin()->first);
+    }
+#ifndef DISABLE_MPI
+    for (int w = 1; w < mpi_total; ++w)
+    {
+        if (!idle[w])
+        {
+            MPI_Status status;
+            MPI_Probe(w, CDaemonTagResult, MPI_COMM_WORLD, &status);
+            int len = 0;
+            MPI_Get_count(&status, MPI_BYTE, &len);
+            std::vector<unsigned char> buffer(len);
+            MPI_Recv(&buffer[0], len, MPI_BYTE, w, CDaemonTagResult, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+        MPI_Send(0, 0, MPI_BYTE, w, CDaemonTagStop, MPI_COMM_WORLD);
+    }
+#endif
+    close(listener);
+    unlink(socket_path.c_str());
+    return 0;
+}
+
+#ifndef DISABLE_MPI
+// The other processors hash the units they are given, with the configurations of the jobs kept between the units
+static int daemon_worker()
+{
+    std::map<uint64_t, phpmagic_config*> configs;
+    std::vector<unsigned char> buffer(sizeof(DaemonResult) + CDaemonMaxHits * sizeof(phpmagic_hit));
+    DaemonResult* result = (DaemonResult*)&buffer[0];
+    phpmagic_hit* hits = (phpmagic_hit*)&buffer[sizeof(DaemonResult)];
+    while (true)
+    {
+        MPI_Status status;
+        MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        int len = 0;
+        MPI_Get_count(&status, MPI_BYTE, &len);
+        std::vector<char> message(len + 1);
+        MPI_Recv(&message[0], len, MPI_BYTE, 0, status.MPI_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        uint64_t id = 0;
+        if (len >= (int)sizeof(id))
+        {
+            memcpy(&id, &message[0], sizeof(id));
+        }
+        if (status.MPI_TAG == CDaemonTagSpec)
+        {
+            // processor 0 has checked the line already
+            DaemonSpec spec;
+            std::string error;
+            const std::string line(&message[sizeof(id)], len - sizeof(id));
+            configs[id] = daemon_parse(line, &spec, &error) ? phpmagic_config_new(&spec.options, 0, 0) : 0;
+        }
+        else if (status.MPI_TAG == CDaemonTagUnit)
+        {
+            uint64_t unit[3];
+            memcpy(unit, &message[0], sizeof(unit));
+            const phpmagic_config* config = configs[unit[0]];
+            if (config)
+            {
+                daemon_work(config, unit[0], unit[1], unit[2], result, hits);
+            }
+            else
+            {
+                memset(result, 0, sizeof(*result));
+                result->job = unit[0];
+            }
+            MPI_Send(&buffer[0], (int)(sizeof(DaemonResult) + result->hit_count * sizeof(phpmagic_hit)), MPI_BYTE, 0, CDaemonTagResult, MPI_COMM_WORLD);
+        }
+        else if (status.MPI_TAG == CDaemonTagForget)
+        {
+            phpmagic_config_free(configs[id]);
+            configs.erase(id);
+        }
+        else
+        {
+            break;
+        }
+    }
+    for (std::map<uint64_t, phpmagic_config*>::iterator it = configs.begin(); it != configs.end(); ++it)
+    {
+        phpmagic_config_free(it->second);
+    }
+    return 0;
+}
+#endif
+
+int daemon_run(const std::string& socket_path, const int mpi_current, const int mpi_total, const std::string& processor_name)
+{
+#ifndef DISABLE_MPI
+    if (mpi_current != 0)
+    {
+        return daemon_worker();
+    }
+#endif
+    std::cout << "Daemon mode. Processor " << mpi_current << " (" << processor_name << ") takes the jobs on '" << socket_path << "', "
+        << ((mpi_total > 1) ? std::to_string(mpi_total - 1) + " processor(s) hash them." : std::string("and hashes them.")) << std::endl;
+    DaemonCoordinator coordinator(mpi_total);
+    return coordinator.run(socket_path);
+}
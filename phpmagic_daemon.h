@@ -0,0 +1,31 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Persistent search service: "--daemon SOCKET" keeps the processes up and takes search jobs over a local UNIX socket.
+
+Processor 0 accepts the connections, queues the jobs and hands their keyspaces out in units of CDaemonUnit candidates, taking the jobs in turn,
+so a short job does not wait for a long one; the other processors keep the configuration of every job they have seen, so a new unit
+starts hashing at once. With a single processor, processor 0 hashes the units itself.
+
+A client sends one line of tab-separated key=value fields:
+
+    hash=md5(sha1($x))  pattern=0e[0-9]*  pattern=00e[0-9]*  charset=0123456789  length=12  base=prefix
+    salt-prefix=...  salt-suffix=...  hmac-key=...  hmac-message=...  engine=single|multibuffer  jit=0|1  targets=FILE
+    start=INDEX  quota=CANDIDATES  hits=N (stop after N hits, 1 by default, 0 for no limit)  token=SPEC
+
+"charset" and "length" are required, or "token", a structured token of one fixed width, see "phpmagic_token.h". The daemon answers "queued<tab>ID<tab>CANDIDATES", then "hit<tab>INDEX<tab>MESSAGE<tab>DIGEST" for every hit
+and finally "done<tab>HASHES<tab>HITS<tab>MILLISECONDS", or "error<tab>REASON". The job is cancelled if the client disconnects.
+The line "shutdown" stops the daemon.
+*/
+
+#ifndef PHPMAGIC_DAEMON_H
+#define PHPMAGIC_DAEMON_H
+
+#include <string>
+
+// Runs the service on every processor until a client sends "shutdown"; returns the exit code of the application
+int daemon_run(const std::string& socket_path, const int mpi_current, const int mpi_total, const std::string& processor_name);
+
+#endif
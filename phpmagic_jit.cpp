@@ -0,0 +1,906 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Run-time compiled SHA-1 kernels, see "phpmagic_jit.h".
+*/
+
+#include <string.h>
+#include <map>
+#include <vector>
+#include "phpmagic_jit.h"
+#include "hash_mb.h"
+
+#ifdef USE_JIT
+#include <sys/mman.h>
+#endif
+
+void jit_init(JitKernel* jit)
+{
+    jit->target = jit_none;
+    jit->first_round = 0;
+    jit->code = 0;
+    jit->code_size = 0;
+    jit->kernel = 0;
+}
+
+const char* jit_target_name(const JitTarget target)
+{
+    switch (target)
+    {
+    case jit_scalar: return "JIT 32-bit registers";
+    case jit_sha_ni: return "JIT SHA CPU instructions";
+    case jit_avx2: return "JIT AVX2";
+    case jit_avx512: return "JIT AVX-512";
+    default: return "none";
+    }
+}
+
+void jit_free(JitKernel* jit)
+{
+#ifdef USE_JIT
+    if (jit->code)
+    {
+        munmap(jit->code, jit->code_size);
+    }
+#endif
+    jit_init(jit);
+}
+
+#ifdef USE_JIT
+
+const uint32_t CJitRoundK[4] = { 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6 };
+
+enum { jit_rax = 0, jit_rcx = 1, jit_rdx = 2, jit_rbx = 3, jit_rsp = 4, jit_rbp = 5, jit_rsi = 6, jit_rdi = 7, jit_r8 = 8, jit_r9 = 9, jit_r10 = 10, jit_r11 = 11 };
+
+// The kernel's arguments (System V): rdi = message, rsi = cached state, rdx = state
+const int CJitMessage = jit_rdi;
+const int CJitCached = jit_rsi;
+const int CJitState = jit_rdx;
+
+// A memory operand: [base + disp], or a constant of the pool (RIP-relative) if "pool" is not negative
+typedef struct {
+    int base;
+    int32_t disp;
+    long pool;
+} JitMem;
+
+static JitMem jit_mem(const int base, const int32_t disp)
+{
+    JitMem m = { base, disp, -1 };
+    return m;
+}
+
+// A register or memory operand
+typedef struct {
+    bool is_reg;
+    int reg;
+    JitMem mem;
+} JitOperand;
+
+static JitOperand jit_reg_operand(const int reg)
+{
+    JitOperand o;
+    o.is_reg = true;
+    o.reg = reg;
+    o.mem = jit_mem(0, 0);
+    return o;
+}
+
+static JitOperand jit_mem_operand(const JitMem& mem)
+{
+    JitOperand o;
+    o.is_reg = false;
+    o.reg = 0;
+    o.mem = mem;
+    return o;
+}
+
+// The x86-64 encoder: the code and its constant pool, which is placed after the code and addressed relative to RIP
+class JitAssembler
+{
+public:
+    std::vector<unsigned char> code;
+
+    JitAssembler() : open_fixups(0) {}
+
+    // A constant of the pool, shared with the same constants
+    JitMem constant(const void* data, const size_t size, const size_t align)
+    {
+        const std::vector<unsigned char> key((const unsigned char*)data, (const unsigned char*)data + size);
+        std::map<std::vector<unsigned char>, size_t>::const_iterator it = pool_index.find(key);
+        size_t offset;
+        if (it != pool_index.end())
+        {
+            offset = it->second;
+        }
+        else
+        {
+            while (pool.size() % align) pool.push_back(0);
+            offset = pool.size();
+            pool.insert(pool.end(), key.begin(), key.end());
+            pool_index[key] = offset;
+        }
+        JitMem m = { 0, 0, (long)offset };
+        return m;
+    }
+
+    void byte(const unsigned int b) { code.push_back((unsigned char)b); }
+
+    void dword(const uint32_t v)
+    {
+        for (unsigned int i = 0; i < 4; ++i) byte((v >> (8 * i)) & 0xff);
+    }
+
+    // Ends an instruction: the RIP-relative displacements in it count from here
+    void end()
+    {
+        for (; open_fixups < fixups.size(); ++open_fixups) fixups[open_fixups].end = code.size();
+    }
+
+    void modrm_reg(const int reg, const int rm)
+    {
+        byte(0xc0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    void modrm_mem(const int reg, const JitMem& m)
+    {
+        if (m.pool >= 0)
+        {
+            byte(((reg & 7) << 3) | 5);
+            JitFixup fixup = { code.size(), 0, (size_t)m.pool };
+            fixups.push_back(fixup);
+            dword(0);
+            return;
+        }
+        byte(0x80 | ((reg & 7) << 3) | (m.base & 7));
+        if ((m.base & 7) == jit_rsp)
+        {
+            byte(0x24);
+        }
+        dword((uint32_t)m.disp);
+    }
+
+    static int mem_base(const JitMem& m) { return (m.pool >= 0) ? 0 : m.base; }
+
+    void rex(const int w, const int reg, const int base, const bool force = false)
+    {
+        const unsigned int r = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2) | ((base >> 3) & 1);
+        if ((r != 0x40) || force) byte(r);
+    }
+
+    // 32-bit general-purpose instructions; "op" is the opcode of "op r/m32, r32" (add 01, or 09, and 21, xor 31, mov 89)
+    void alu_rr(const unsigned int op, const int dst, const int src) { rex(0, src, dst); byte(op); modrm_reg(src, dst); end(); }
+    // "op r32, r/m32" (add 03, or 0B, and 23, xor 33, mov 8B)
+    void alu_rm(const unsigned int op, const int dst, const JitMem& m) { rex(0, dst, mem_base(m)); byte(op); modrm_mem(dst, m); end(); }
+    void mov_mr(const JitMem& m, const int src) { rex(0, src, mem_base(m)); byte(0x89); modrm_mem(src, m); end(); }
+    // "op r/m32, imm32" with the extension of 81 (add 0, or 1, and 4, xor 6)
+    void alu_ri(const int ext, const int dst, const uint32_t imm) { rex(0, 0, dst); byte(0x81); modrm_reg(ext, dst); dword(imm); end(); }
+    void rol_ri(const int dst, const unsigned int bits) { rex(0, 0, dst); byte(0xc1); modrm_reg(0, dst); byte(bits); end(); }
+    void push(const int r) { rex(0, 0, r); byte(0x50 + (r & 7)); end(); }
+    void pop(const int r) { rex(0, 0, r); byte(0x58 + (r & 7)); end(); }
+    void ret() { byte(0xc3); end(); }
+    void vzeroupper() { byte(0xc5); byte(0xf8); byte(0x77); end(); }
+
+    // AVX2: VEX.256; "map" 1 = 0F, 2 = 0F38, 3 = 0F3A; "pp" 0 = none, 1 = 66, 2 = F3, 3 = F2
+    void vex(const int map, const int pp, const int reg, const int vvvv, const int base)
+    {
+        byte(0xc4);
+        byte(((~reg >> 3) & 1) << 7 | 1 << 6 | ((~base >> 3) & 1) << 5 | map);
+        byte(((~vvvv) & 15) << 3 | 1 << 2 | pp);
+    }
+    void vex_rr(const int map, const int pp, const unsigned int op, const int dst, const int src1, const int src2)
+    {
+        vex(map, pp, dst, src1, src2); byte(op); modrm_reg(dst, src2); end();
+    }
+    void vex_rm(const int map, const int pp, const unsigned int op, const int dst, const int src1, const JitMem& m)
+    {
+        vex(map, pp, dst, src1, mem_base(m)); byte(op); modrm_mem(dst, m); end();
+    }
+    void vex_op(const unsigned int op, const int dst, const int src1, const JitOperand& src2)
+    {
+        if (src2.is_reg)
+            vex_rr(1, 1, op, dst, src1, src2.reg);
+        else
+            vex_rm(1, 1, op, dst, src1, src2.mem);
+    }
+    void vpaddd(const int dst, const int src1, const JitOperand& src2) { vex_op(0xfe, dst, src1, src2); }
+    void vpxor(const int dst, const int src1, const JitOperand& src2) { vex_op(0xef, dst, src1, src2); }
+    void vpand(const int dst, const int src1, const JitOperand& src2) { vex_op(0xdb, dst, src1, src2); }
+    void vpor(const int dst, const int src1, const JitOperand& src2) { vex_op(0xeb, dst, src1, src2); }
+    void vmovdqu_load(const int dst, const JitMem& m) { vex_rm(1, 2, 0x6f, dst, 0, m); }
+    void vmovdqu_store(const JitMem& m, const int src) { vex_rm(1, 2, 0x7f, src, 0, m); }
+    // vpslld (ext 6) and vpsrld (ext 2) by an immediate
+    void vshift(const int ext, const int dst, const int src, const unsigned int bits)
+    {
+        vex(1, 1, ext, dst, src); byte(0x72); modrm_reg(ext, src); byte(bits); end();
+    }
+
+    // AVX-512: EVEX.512, W0
+    void evex(const int map, const int pp, const int reg, const int vvvv, const int rm, const bool rm_is_reg, const bool broadcast)
+    {
+        byte(0x62);
+        byte(((~reg >> 3) & 1) << 7 | (rm_is_reg ? ((~rm >> 4) & 1) : 1) << 6 | ((~rm >> 3) & 1) << 5 | ((~reg >> 4) & 1) << 4 | map);
+        byte(((~vvvv) & 15) << 3 | 1 << 2 | pp);
+        byte(2 << 5 | (broadcast ? 1 : 0) << 4 | ((~vvvv >> 4) & 1) << 3);
+    }
+    // A 32-bit constant broadcast to all the lanes
+    void evex_op(const int map, const int pp, const unsigned int op, const int dst, const int src1, const JitOperand& src2, const bool broadcast = false)
+    {
+        if (src2.is_reg)
+        {
+            evex(map, pp, dst, src1, src2.reg, true, false); byte(op); modrm_reg(dst, src2.reg);
+        }
+        else
+        {
+            evex(map, pp, dst, src1, mem_base(src2.mem), false, broadcast); byte(op); modrm_mem(dst, src2.mem);
+        }
+    }
+    void vpaddd_z(const int dst, const int src1, const JitOperand& src2, const bool broadcast = false) { evex_op(1, 1, 0xfe, dst, src1, src2, broadcast); end(); }
+    void vpxord_z(const int dst, const int src1, const JitOperand& src2, const bool broadcast = false) { evex_op(1, 1, 0xef, dst, src1, src2, broadcast); end(); }
+    void vpternlogd_z(const int dst, const int src2, const JitOperand& src3, const unsigned int imm, const bool broadcast = false)
+    {
+        evex_op(3, 1, 0x25, dst, src2, src3, broadcast); byte(imm); end();
+    }
+    void vmovdqa32_z(const int dst, const int src) { evex_op(1, 1, 0x6f, dst, 0, jit_reg_operand(src)); end(); }
+    void vmovdqu32_load_z(const int dst, const JitMem& m) { evex_op(1, 2, 0x6f, dst, 0, jit_mem_operand(m)); end(); }
+    void vmovdqu32_store_z(const JitMem& m, const int src) { evex_op(1, 2, 0x7f, src, 0, jit_mem_operand(m)); end(); }
+    void vprold_z(const int dst, const int src, const unsigned int bits)
+    {
+        evex(1, 1, 1, dst, src, true, false); byte(0x72); modrm_reg(1, src); byte(bits); end();
+    }
+
+    // SSE and the SHA CPU instructions (legacy encoding); "map" as above
+    void sse(const bool p66, const int map, const unsigned int op, const int reg, const JitOperand& rm, const int imm = -1)
+    {
+        if (p66) byte(0x66);
+        rex(0, reg, rm.is_reg ? rm.reg : mem_base(rm.mem));
+        byte(0x0f);
+        if (map == 2) byte(0x38);
+        if (map == 3) byte(0x3a);
+        byte(op);
+        if (rm.is_reg)
+            modrm_reg(reg, rm.reg);
+        else
+            modrm_mem(reg, rm.mem);
+        if (imm >= 0) byte(imm);
+        end();
+    }
+
+    // Maps the code and its pool executable
+    bool finish(JitKernel* jit, std::string* error)
+    {
+        const size_t code_end = (code.size() + 63) & ~(size_t)63;
+        const size_t total = code_end + pool.size();
+        std::vector<unsigned char> image(total, 0xcc);
+        memcpy(&image[0], &code[0], code.size());
+        if (!pool.empty()) memcpy(&image[code_end], &pool[0], pool.size());
+        for (std::vector<JitFixup>::size_type i = 0; i < fixups.size(); ++i)
+        {
+            const int32_t disp = (int32_t)(code_end + fixups[i].pool_offset - fixups[i].end);
+            memcpy(&image[fixups[i].position], &disp, sizeof(disp));
+        }
+        void* memory = mmap(0, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            *error = "cannot map the code";
+            return false;
+        }
+        memcpy(memory, &image[0], total);
+        if (mprotect(memory, total, PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(memory, total);
+            *error = "cannot make the code executable";
+            return false;
+        }
+        jit->code = memory;
+        jit->code_size = total;
+        jit->kernel = (JitSha1Kernel)memory;
+        return true;
+    }
+
+private:
+    typedef struct {
+        size_t position;
+        size_t end;
+        size_t pool_offset;
+    } JitFixup;
+
+    std::vector<unsigned char> pool;
+    std::map<std::vector<unsigned char>, size_t> pool_index;
+    std::vector<JitFixup> fixups;
+    std::vector<JitFixup>::size_type open_fixups;
+};
+
+typedef struct {
+    bool known;
+    uint32_t value;
+} JitWord;
+
+// The 80 words of a block: the constant ones and their expansion are computed here; "offsets" are the places of the candidate words in "message"
+static void jit_block_words(const MessageLayout* layout, const unsigned int block, const unsigned int stride, JitWord w[80], int32_t offsets[16])
+{
+    for (unsigned int i = 0; i < 16; ++i)
+    {
+        const unsigned int n = 16 * block + i;
+        w[i].known = (n < layout->first_word) || (n > layout->last_word);
+        w[i].value = layout->words[n];
+        offsets[i] = (int32_t)(n * stride);
+    }
+    for (unsigned int t = 16; t < 80; ++t)
+    {
+        w[t].known = w[t - 3].known && w[t - 8].known && w[t - 14].known && w[t - 16].known;
+        const uint32_t x = w[t - 3].value ^ w[t - 8].value ^ w[t - 14].value ^ w[t - 16].value;
+        w[t].value = (x << 1) | (x >> 31);
+    }
+}
+
+// The emitter of the rounds for one register width; the state registers are addressed as 0-4, the frontend rotates their roles
+class JitLanes
+{
+public:
+    virtual ~JitLanes() {}
+    virtual void prologue() = 0;
+    virtual void epilogue() = 0;
+    // the state from the cached one: "row" 0 for the state before the block, 5 for the state after the first rounds
+    virtual void load_state(const unsigned int s[5], const unsigned int row) = 0;
+    virtual void begin_block(const int32_t offsets[16]) = 0;
+    // W[t] = rol(the XOR of the variable words "sources" and of "constant", 1)
+    virtual void expand(const unsigned int t, const unsigned int* sources, const unsigned int count, const uint32_t constant) = 0;
+    virtual void round(const unsigned int s[5], const unsigned int t, const JitWord& w) = 0;
+    // adds the state before the block (the cached one for the first block) and stores the result
+    virtual void feed_forward(const unsigned int s[5], const bool first) = 0;
+};
+
+// SHA-1 over the image blocks from the cached ones on, the constant words folded in
+static void jit_emit_lanes(JitLanes* be, const MessageLayout* layout, const unsigned int first_round, const unsigned int stride)
+{
+    be->prologue();
+    unsigned int s[5] = { 0, 1, 2, 3, 4 };
+    for (unsigned int b = layout->cached_blocks; b < layout->image_blocks; ++b)
+    {
+        JitWord w[80];
+        int32_t offsets[16];
+        jit_block_words(layout, b, stride, w, offsets);
+        const bool first = b == layout->cached_blocks;
+        const unsigned int r0 = first ? first_round : 0;
+        if (first)
+        {
+            be->load_state(s, (r0 > 0) ? 5 : 0);
+        }
+        be->begin_block(offsets);
+        for (unsigned int t = r0; t < 80; ++t)
+        {
+            if ((t >= 16) && !w[t].known)
+            {
+                const unsigned int terms[4] = { t - 16, t - 14, t - 8, t - 3 };
+                unsigned int sources[4];
+                unsigned int count = 0;
+                uint32_t constant = 0;
+                for (unsigned int i = 0; i < 4; ++i)
+                {
+                    if (w[terms[i]].known)
+                        constant ^= w[terms[i]].value;
+                    else
+                        sources[count++] = terms[i];
+                }
+                be->expand(t, sources, count, constant);
+            }
+            be->round(s, t, w[t]);
+            const unsigned int e = s[4];
+            s[4] = s[3];
+            s[3] = s[2];
+            s[2] = s[1];
+            s[1] = s[0];
+            s[0] = e;
+        }
+        be->feed_forward(s, first);
+    }
+    be->epilogue();
+}
+
+// One lane in 32-bit general-purpose registers; the expanded words are kept in the red zone
+class JitScalar : public JitLanes
+{
+public:
+    JitScalar(JitAssembler* a, const unsigned int stride) : a(a), stride(stride), w_in_reg(-1) {}
+
+    void prologue() { a->push(jit_rbx); a->push(jit_rbp); }
+    void epilogue() { a->pop(jit_rbp); a->pop(jit_rbx); a->ret(); }
+
+    void load_state(const unsigned int s[5], const unsigned int row)
+    {
+        for (unsigned int i = 0; i < 5; ++i) a->alu_rm(0x8b, reg[s[i]], jit_mem(CJitCached, (int32_t)((row + i) * stride)));
+    }
+
+    void begin_block(const int32_t block_offsets[16])
+    {
+        memcpy(offsets, block_offsets, sizeof(offsets));
+        w_in_reg = -1;
+    }
+
+    void expand(const unsigned int t, const unsigned int* sources, const unsigned int count, const uint32_t constant)
+    {
+        a->alu_rm(0x8b, CWord, word(sources[0]));
+        for (unsigned int i = 1; i < count; ++i) a->alu_rm(0x33, CWord, word(sources[i]));
+        if (constant) a->alu_ri(6, CWord, constant);
+        a->rol_ri(CWord, 1);
+        a->mov_mr(ring(t), CWord);
+        w_in_reg = (int)t;
+    }
+
+    void round(const unsigned int s[5], const unsigned int t, const JitWord& w)
+    {
+        const int ra = reg[s[0]], rb = reg[s[1]], rc = reg[s[2]], rd = reg[s[3]], re = reg[s[4]];
+        const uint32_t k = CJitRoundK[t / 20];
+        if (w.known)
+        {
+            if (k + w.value) a->alu_ri(0, re, k + w.value);
+        }
+        else
+        {
+            a->alu_ri(0, re, k);
+            if (w_in_reg == (int)t)
+                a->alu_rr(0x01, re, CWord);
+            else
+                a->alu_rm(0x03, re, word(t));
+        }
+        a->alu_rr(0x89, CTemp0, ra);
+        a->rol_ri(CTemp0, 5);
+        a->alu_rr(0x01, re, CTemp0);
+        if (t < 20)
+        {
+            a->alu_rr(0x89, CTemp0, rc);
+            a->alu_rr(0x31, CTemp0, rd);
+            a->alu_rr(0x21, CTemp0, rb);
+            a->alu_rr(0x31, CTemp0, rd);
+        }
+        else if ((t >= 40) && (t < 60))
+        {
+            a->alu_rr(0x89, CTemp0, rb);
+            a->alu_rr(0x89, CTemp1, rb);
+            a->alu_rr(0x09, CTemp0, rc);
+            a->alu_rr(0x21, CTemp0, rd);
+            a->alu_rr(0x21, CTemp1, rc);
+            a->alu_rr(0x09, CTemp0, CTemp1);
+        }
+        else
+        {
+            a->alu_rr(0x89, CTemp0, rb);
+            a->alu_rr(0x31, CTemp0, rc);
+            a->alu_rr(0x31, CTemp0, rd);
+        }
+        a->alu_rr(0x01, re, CTemp0);
+        a->rol_ri(rb, 30);
+    }
+
+    void feed_forward(const unsigned int s[5], const bool first)
+    {
+        for (unsigned int i = 0; i < 5; ++i)
+        {
+            a->alu_rm(0x03, reg[s[i]], jit_mem(first ? CJitCached : CJitState, (int32_t)(i * stride)));
+            a->mov_mr(jit_mem(CJitState, (int32_t)(i * stride)), reg[s[i]]);
+        }
+    }
+
+private:
+    static const int CTemp0 = jit_r8;
+    static const int CTemp1 = jit_r9;
+    static const int CWord = jit_r10;
+    const int reg[5] = { jit_rax, jit_rbx, jit_rcx, jit_rbp, jit_r11 };
+    JitAssembler* a;
+    unsigned int stride;
+    int32_t offsets[16];
+    int w_in_reg;
+
+    JitMem ring(const unsigned int t) const { return jit_mem(jit_rsp, -64 + 4 * (int32_t)(t & 15)); }
+    JitMem word(const unsigned int t) const { return (t < 16) ? jit_mem(CJitMessage, offsets[t]) : ring(t); }
+};
+
+// 8 lanes in ymm0-7; the expanded words are kept on the stack
+class JitAvx2 : public JitLanes
+{
+public:
+    JitAvx2(JitAssembler* a, const unsigned int stride) : a(a), stride(stride), w_in_reg(-1) {}
+
+    void prologue()
+    {
+        // push rbp; mov rbp, rsp; and rsp, -32; sub rsp, 512
+        const unsigned char frame[] = { 0x55, 0x48, 0x89, 0xe5, 0x48, 0x83, 0xe4, 0xe0, 0x48, 0x81, 0xec, 0x00, 0x02, 0x00, 0x00 };
+        for (unsigned int i = 0; i < sizeof(frame); ++i) a->byte(frame[i]);
+        a->end();
+    }
+
+    void epilogue()
+    {
+        // mov rsp, rbp; pop rbp
+        const unsigned char frame[] = { 0x48, 0x89, 0xec, 0x5d };
+        for (unsigned int i = 0; i < sizeof(frame); ++i) a->byte(frame[i]);
+        a->end();
+        a->vzeroupper();
+        a->ret();
+    }
+
+    void load_state(const unsigned int s[5], const unsigned int row)
+    {
+        for (unsigned int i = 0; i < 5; ++i) a->vmovdqu_load(s[i], jit_mem(CJitCached, (int32_t)((row + i) * stride)));
+    }
+
+    void begin_block(const int32_t block_offsets[16])
+    {
+        memcpy(offsets, block_offsets, sizeof(offsets));
+        w_in_reg = -1;
+    }
+
+    void expand(const unsigned int t, const unsigned int* sources, const unsigned int count, const uint32_t constant)
+    {
+        a->vmovdqu_load(CWord, word(sources[0]));
+        for (unsigned int i = 1; i < count; ++i) a->vpxor(CWord, CWord, jit_mem_operand(word(sources[i])));
+        if (constant) a->vpxor(CWord, CWord, broadcast(constant));
+        a->vshift(6, CTemp0, CWord, 1);
+        a->vshift(2, CWord, CWord, 31);
+        a->vpor(CWord, CWord, jit_reg_operand(CTemp0));
+        a->vmovdqu_store(ring(t), CWord);
+        w_in_reg = (int)t;
+    }
+
+    void round(const unsigned int s[5], const unsigned int t, const JitWord& w)
+    {
+        const int ra = s[0], rb = s[1], rc = s[2], rd = s[3], re = s[4];
+        const uint32_t k = CJitRoundK[t / 20];
+        if (w.known)
+        {
+            if (k + w.value) a->vpaddd(re, re, broadcast(k + w.value));
+        }
+        else
+        {
+            a->vpaddd(re, re, (w_in_reg == (int)t) ? jit_reg_operand(CWord) : jit_mem_operand(word(t)));
+            a->vpaddd(re, re, broadcast(k));
+        }
+        a->vshift(6, CTemp0, ra, 5);
+        a->vshift(2, CTemp1, ra, 27);
+        a->vpor(CTemp0, CTemp0, jit_reg_operand(CTemp1));
+        a->vpaddd(re, re, jit_reg_operand(CTemp0));
+        if (t < 20)
+        {
+            a->vpxor(CTemp0, rc, jit_reg_operand(rd));
+            a->vpand(CTemp0, CTemp0, jit_reg_operand(rb));
+            a->vpxor(CTemp0, CTemp0, jit_reg_operand(rd));
+        }
+        else if ((t >= 40) && (t < 60))
+        {
+            a->vpor(CTemp0, rb, jit_reg_operand(rc));
+            a->vpand(CTemp0, CTemp0, jit_reg_operand(rd));
+            a->vpand(CTemp1, rb, jit_reg_operand(rc));
+            a->vpor(CTemp0, CTemp0, jit_reg_operand(CTemp1));
+        }
+        else
+        {
+            a->vpxor(CTemp0, rb, jit_reg_operand(rc));
+            a->vpxor(CTemp0, CTemp0, jit_reg_operand(rd));
+        }
+        a->vpaddd(re, re, jit_reg_operand(CTemp0));
+        a->vshift(6, CTemp0, rb, 30);
+        a->vshift(2, rb, rb, 2);
+        a->vpor(rb, rb, jit_reg_operand(CTemp0));
+    }
+
+    void feed_forward(const unsigned int s[5], const bool first)
+    {
+        for (unsigned int i = 0; i < 5; ++i)
+        {
+            a->vpaddd(s[i], s[i], jit_mem_operand(jit_mem(first ? CJitCached : CJitState, (int32_t)(i * stride))));
+            a->vmovdqu_store(jit_mem(CJitState, (int32_t)(i * stride)), s[i]);
+        }
+    }
+
+private:
+    static const int CTemp0 = 5;
+    static const int CTemp1 = 6;
+    static const int CWord = 7;
+    JitAssembler* a;
+    unsigned int stride;
+    int32_t offsets[16];
+    int w_in_reg;
+
+    JitOperand broadcast(const uint32_t value)
+    {
+        uint32_t v[8];
+        for (unsigned int i = 0; i < 8; ++i) v[i] = value;
+        return jit_mem_operand(a->constant(v, sizeof(v), 32));
+    }
+    JitMem ring(const unsigned int t) const { return jit_mem(jit_rsp, 32 * (int32_t)(t & 15)); }
+    JitMem word(const unsigned int t) const { return (t < 16) ? jit_mem(CJitMessage, offsets[t]) : ring(t); }
+};
+
+// 16 lanes in zmm0-5, the expanded words in zmm16-31; the constants are broadcast from the pool by the instructions that use them
+class JitAvx512 : public JitLanes
+{
+public:
+    JitAvx512(JitAssembler* a, const unsigned int stride) : a(a), stride(stride) {}
+
+    void prologue() {}
+    void epilogue() { a->vzeroupper(); a->ret(); }
+
+    void load_state(const unsigned int s[5], const unsigned int row)
+    {
+        for (unsigned int i = 0; i < 5; ++i) a->vmovdqu32_load_z(s[i], jit_mem(CJitCached, (int32_t)((row + i) * stride)));
+    }
+
+    void begin_block(const int32_t block_offsets[16])
+    {
+        memcpy(offsets, block_offsets, sizeof(offsets));
+    }
+
+    void expand(const unsigned int t, const unsigned int* sources, const unsigned int count, const uint32_t constant)
+    {
+        const int dst = ring(t);
+        std::vector<JitOperand> terms;
+        std::vector<bool> broadcasts;
+        bool in_place = false;
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            const JitOperand term = word(sources[i]);
+            if (term.is_reg && (term.reg == dst))
+            {
+                // W[t - 16], in the register of W[t]
+                in_place = true;
+                continue;
+            }
+            terms.push_back(term);
+            broadcasts.push_back(false);
+        }
+        if (constant)
+        {
+            terms.push_back(jit_mem_operand(a->constant(&constant, sizeof(constant), 4)));
+            broadcasts.push_back(true);
+        }
+        std::vector<JitOperand>::size_type next = 0;
+        if (!in_place)
+        {
+            if (terms[0].is_reg)
+                a->vmovdqa32_z(dst, terms[0].reg);
+            else
+                a->vmovdqu32_load_z(dst, terms[0].mem);
+            next = 1;
+        }
+        while (next < terms.size())
+        {
+            if ((next + 1 < terms.size()) && terms[next].is_reg)
+            {
+                a->vpternlogd_z(dst, terms[next].reg, terms[next + 1], 0x96, broadcasts[next + 1]);
+                next += 2;
+            }
+            else if ((next + 1 < terms.size()) && terms[next + 1].is_reg)
+            {
+                a->vpternlogd_z(dst, terms[next + 1].reg, terms[next], 0x96, broadcasts[next]);
+                next += 2;
+            }
+            else
+            {
+                a->vpxord_z(dst, dst, terms[next], broadcasts[next]);
+                next += 1;
+            }
+        }
+        a->vprold_z(dst, dst, 1);
+    }
+
+    void round(const unsigned int s[5], const unsigned int t, const JitWord& w)
+    {
+        const int ra = s[0], rb = s[1], rc = s[2], rd = s[3], re = s[4];
+        const uint32_t k = CJitRoundK[t / 20];
+        if (w.known)
+        {
+            if (k + w.value) a->vpaddd_z(re, re, broadcast(k + w.value), true);
+        }
+        else
+        {
+            a->vpaddd_z(re, re, word(t));
+            a->vpaddd_z(re, re, broadcast(k), true);
+        }
+        a->vprold_z(CTemp, ra, 5);
+        a->vpaddd_z(re, re, jit_reg_operand(CTemp));
+        // the truth tables of vpternlogd over b, c and d
+        const unsigned int f = (t < 20) ? 0xca : (((t >= 40) && (t < 60)) ? 0xe8 : 0x96);
+        a->vmovdqa32_z(CTemp, rb);
+        a->vpternlogd_z(CTemp, rc, jit_reg_operand(rd), f);
+        a->vpaddd_z(re, re, jit_reg_operand(CTemp));
+        a->vprold_z(rb, rb, 30);
+    }
+
+    void feed_forward(const unsigned int s[5], const bool first)
+    {
+        for (unsigned int i = 0; i < 5; ++i)
+        {
+            a->vpaddd_z(s[i], s[i], jit_mem_operand(jit_mem(first ? CJitCached : CJitState, (int32_t)(i * stride))));
+            a->vmovdqu32_store_z(jit_mem(CJitState, (int32_t)(i * stride)), s[i]);
+        }
+    }
+
+private:
+    static const int CTemp = 5;
+    JitAssembler* a;
+    unsigned int stride;
+    int32_t offsets[16];
+
+    JitOperand broadcast(const uint32_t value) { return jit_mem_operand(a->constant(&value, sizeof(value), 4)); }
+    static int ring(const unsigned int t) { return 16 + (int)(t & 15); }
+    JitOperand word(const unsigned int t) const { return (t < 16) ? jit_mem_operand(jit_mem(CJitMessage, offsets[t])) : jit_reg_operand(ring(t)); }
+};
+
+// One lane with the SHA CPU instructions, four rounds at a time: ABCD in xmm0, E in xmm1 and xmm2 in turn, the groups of four words in xmm3-6
+static void jit_emit_sha_ni(JitAssembler* a, const MessageLayout* layout, const unsigned int first_round, const unsigned int stride)
+{
+    const int CAbcd = 0, CTemp = 7;
+    const int sha = 0, p66 = 1;  // the prefixes of the instructions
+    for (unsigned int b = layout->cached_blocks; b < layout->image_blocks; ++b)
+    {
+        JitWord w[80];
+        int32_t offsets[16];
+        jit_block_words(layout, b, stride, w, offsets);
+        const bool first = b == layout->cached_blocks;
+        const unsigned int g0 = (first ? first_round : 0) / 4;
+        const int base = first ? CJitCached : CJitState;
+        const unsigned int row = (g0 > 0) ? 5 : 0;
+
+        // a group of words as an operand: the constant groups come from the pool, with the first word in the top dword
+        bool group_known[20];
+        JitOperand group[20];
+        for (unsigned int g = 0; g < 20; ++g)
+        {
+            group_known[g] = w[4 * g].known && w[4 * g + 1].known && w[4 * g + 2].known && w[4 * g + 3].known;
+            if (group_known[g])
+            {
+                const uint32_t v[4] = { w[4 * g + 3].value, w[4 * g + 2].value, w[4 * g + 1].value, w[4 * g].value };
+                group[g] = jit_mem_operand(a->constant(v, sizeof(v), 16));
+            }
+            else
+            {
+                group[g] = jit_reg_operand(3 + (g & 3));
+            }
+        }
+
+        // ABCD with A in the top dword, and E in the top dword of xmm1
+        int cur = 1, other = 2;
+        a->sse(p66, 1, 0x6e, CAbcd, jit_mem_operand(jit_mem(base, (int32_t)((row + 3) * stride))));
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            a->sse(p66, 3, 0x22, CAbcd, jit_mem_operand(jit_mem(base, (int32_t)((row + 2 - i) * stride))), i + 1);
+        }
+        a->sse(p66, 1, 0x6e, cur, jit_mem_operand(jit_mem(base, (int32_t)((row + 4) * stride))));
+        a->sse(p66, 1, 0x73, 7, jit_reg_operand(cur), 12);
+
+        // the groups with candidate words: the constant words from the pool, then the candidate words inserted
+        for (unsigned int g = 0; g < 4; ++g)
+        {
+            if (group_known[g]) continue;
+            const int slot = group[g].reg;
+            uint32_t v[4];
+            bool zero = true;
+            for (unsigned int i = 0; i < 4; ++i)
+            {
+                v[3 - i] = w[4 * g + i].known ? w[4 * g + i].value : 0;
+                zero = zero && (v[3 - i] == 0);
+            }
+            if (zero)
+                a->sse(p66, 1, 0xef, slot, jit_reg_operand(slot));
+            else
+                a->sse(p66, 1, 0x6f, slot, jit_mem_operand(a->constant(v, sizeof(v), 16)));
+            for (unsigned int i = 0; i < 4; ++i)
+            {
+                if (!w[4 * g + i].known) a->sse(p66, 3, 0x22, slot, jit_mem_operand(jit_mem(CJitMessage, offsets[4 * g + i])), 3 - i);
+            }
+        }
+
+        for (unsigned int g = g0; g < 20; ++g)
+        {
+            if ((g >= 4) && !group_known[g])
+            {
+                const int slot = group[g].reg;
+                if (group_known[g - 4]) a->sse(p66, 1, 0x6f, slot, group[g - 4]);
+                a->sse(sha, 2, 0xc9, slot, group[g - 3]);
+                a->sse(p66, 1, 0xef, slot, group[g - 2]);
+                a->sse(sha, 2, 0xca, slot, group[g - 1]);
+            }
+            if (g == g0)
+                a->sse(p66, 1, 0xfe, cur, group[g]);
+            else
+                a->sse(sha, 2, 0xc8, cur, group[g]);
+            a->sse(p66, 1, 0x6f, other, jit_reg_operand(CAbcd));
+            a->sse(sha, 3, 0xcc, CAbcd, jit_reg_operand(cur), g / 5);
+            const int swap = cur;
+            cur = other;
+            other = swap;
+        }
+
+        // the feed-forward: E from the ABCD before the last four rounds, then the state before the block added
+        const int save = first ? CJitCached : CJitState;
+        a->sse(p66, 1, 0x6e, other, jit_mem_operand(jit_mem(save, (int32_t)(4 * stride))));
+        a->sse(p66, 1, 0x73, 7, jit_reg_operand(other), 12);
+        a->sse(sha, 2, 0xc8, cur, jit_reg_operand(other));
+        a->sse(p66, 1, 0x6e, CTemp, jit_mem_operand(jit_mem(save, (int32_t)(3 * stride))));
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            a->sse(p66, 3, 0x22, CTemp, jit_mem_operand(jit_mem(save, (int32_t)((2 - i) * stride))), i + 1);
+        }
+        a->sse(p66, 1, 0xfe, CAbcd, jit_reg_operand(CTemp));
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            a->sse(p66, 3, 0x16, CAbcd, jit_mem_operand(jit_mem(CJitState, (int32_t)(i * stride))), 3 - i);
+        }
+        a->sse(p66, 3, 0x16, cur, jit_mem_operand(jit_mem(CJitState, (int32_t)(4 * stride))), 3);
+    }
+    a->ret();
+}
+
+#endif
+
+bool jit_compile(JitKernel* jit, const MessageLayout* layout, const bool multibuffer, std::string* error)
+{
+    jit_free(jit);
+#ifdef USE_JIT
+    if (layout->algorithm != hash_sha1)
+    {
+        *error = "the kernels are SHA-1 only";
+        return false;
+    }
+    if (layout->candidate_len == 0)
+    {
+        *error = "there is no candidate";
+        return false;
+    }
+    JitTarget target;
+    if (multibuffer)
+    {
+        if ((CMbLanes == 16) && __builtin_cpu_supports("avx512f"))
+            target = jit_avx512;
+        else if ((CMbLanes == 8) && __builtin_cpu_supports("avx2"))
+            target = jit_avx2;
+        else
+        {
+            *error = "there is no kernel for " + std::to_string(CMbLanes) + " lanes";
+            return false;
+        }
+    }
+    else
+    {
+        target = (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1")) ? jit_sha_ni : jit_scalar;
+    }
+
+    // the leading constant words of the first block, whose rounds are done with the cached state
+    const unsigned int block_word = 16 * layout->cached_blocks;
+    unsigned int first_round = (layout->first_word > block_word) ? layout->first_word - block_word : 0;
+    if (target == jit_sha_ni)
+    {
+        first_round &= ~3u;
+    }
+
+    const unsigned int stride = CMbLanes * sizeof(uint32_t);
+    JitAssembler a;
+    if (target == jit_sha_ni)
+    {
+        jit_emit_sha_ni(&a, layout, first_round, stride);
+    }
+    else
+    {
+        JitScalar scalar(&a, stride);
+        JitAvx2 avx2(&a, stride);
+        JitAvx512 avx512(&a, stride);
+        JitLanes* be = (target == jit_avx512) ? (JitLanes*)&avx512 : ((target == jit_avx2) ? (JitLanes*)&avx2 : (JitLanes*)&scalar);
+        jit_emit_lanes(be, layout, first_round, stride);
+    }
+    if (!a.finish(jit, error))
+    {
+        return false;
+    }
+    jit->target = target;
+    jit->first_round = first_round;
+    return true;
+#else
+    (void)layout;
+    (void)multibuffer;
+    *error = "the JIT is x86-64 only";
+    return false;
+#endif
+}
@@ -0,0 +1,56 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Run-time compiled SHA-1 kernels for one message layout (x86-64 only).
+
+Most words of the blocks hashed for every candidate are constant for the whole search: the rest of the prefix, the suffix, the padding and
+the length. A kernel compiled ahead of time has to treat them as variables; a kernel emitted for the layout folds them in:
+- a constant word is added together with the round constant as one immediate, and the expanded words that depend on constants only
+  are computed here, so their expansion is left out of the kernel; a constant term of an expanded word is a single XOR with an immediate;
+- the rounds of the first block before the first candidate word depend on the cached state only, so they are computed when that state is
+  cached (sha1_rounds_mb) and the kernel starts after them, e.g. 10 rounds fewer with a 40-byte salt prefix.
+
+The kernel is emitted for the engine of the configuration: AVX-512 (16 lanes, with vprold and vpternlogd) or AVX2 (8 lanes) for the
+multi-buffer engine, the SHA CPU instructions or plain 32-bit registers for the single-buffer one. The other builds, MD5 layouts and the
+hosts where the code cannot be mapped executable keep the static engines.
+*/
+
+#ifndef PHPMAGIC_JIT_H
+#define PHPMAGIC_JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "phpmagic_layout.h"
+
+#if defined(__x86_64__) && !defined(DISABLE_JIT)
+#define USE_JIT
+#endif
+
+enum JitTarget { jit_none, jit_scalar, jit_sha_ni, jit_avx2, jit_avx512 };
+
+// "message" is the image of the lanes (word-major, CMbLanes lanes per word), "cached" the state after the cached blocks (rows 0-4)
+// and after the first "first_round" rounds of the next block (rows 5-9); the state after the image is written to "state" (rows 0-4)
+typedef void (*JitSha1Kernel)(const uint32_t* message, const uint32_t* cached, uint32_t* state);
+
+typedef struct {
+    JitTarget target;
+    unsigned int first_round;
+    void* code;
+    size_t code_size;
+    JitSha1Kernel kernel;
+} JitKernel;
+
+void jit_init(JitKernel* jit);
+
+// Emits the kernel for the SHA-1 image blocks of the layout from the cached ones on; returns false, with the reason, if there is none
+// for this layout, build or CPU, and the static engines are to be used
+bool jit_compile(JitKernel* jit, const MessageLayout* layout, const bool multibuffer, std::string* error);
+
+void jit_free(JitKernel* jit);
+
+const char* jit_target_name(const JitTarget target);
+
+#endif
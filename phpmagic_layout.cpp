@@ -0,0 +1,75 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Message layout for salted targets, see "phpmagic_layout.h".
+*/
+
+#include <string.h>
+#include "phpmagic_layout.h"
+
+bool layout_init(MessageLayout* layout, const HashAlgorithm algorithm, const std::string& prefix, const unsigned int candidate_len, const std::string& suffix, std::string* error)
+{
+    memset(layout, 0, sizeof(*layout));
+    layout->algorithm = algorithm;
+    layout->big_endian = (algorithm == hash_sha1);
+    layout->message_len = (uint64_t)prefix.length() + candidate_len + suffix.length();
+    layout->candidate_len = candidate_len;
+
+    // the blocks that hold nothing but the prefix are compressed only once
+    const std::string::size_type constant_blocks = prefix.length() / 64;
+    if (algorithm == hash_sha1)
+        memcpy(layout->midstate, CSha1Init, sizeof(CSha1Init));
+    else
+        memcpy(layout->midstate, CMd5Init, sizeof(CMd5Init));
+    for (std::string::size_type b = 0; b < constant_blocks; ++b)
+    {
+        uint32_t block[16];
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            block[i] = layout_load_word((const unsigned char*)prefix.data() + 64 * b + 4 * i, layout->big_endian);
+        }
+        if (algorithm == hash_sha1)
+            SHA1TransformWords(layout->midstate, block);
+        else
+            MD5TransformWords(layout->midstate, block);
+    }
+
+    const std::string::size_type prefix_rest = prefix.length() - 64 * constant_blocks;
+    const std::string::size_type image_len = prefix_rest + candidate_len + suffix.length();
+    layout->image_blocks = (unsigned int)((image_len + 1 + 8 + 63) / 64);
+    if (layout->image_blocks > CLayoutMaxBlocks)
+    {
+        *error = "the candidate and the suffix are too long, at most " + std::to_string(CLayoutMaxBlocks * 64 - 9 - 63) + " bytes fit";
+        return false;
+    }
+    memcpy(layout->image, prefix.data() + 64 * constant_blocks, prefix_rest);
+    memcpy(layout->image + prefix_rest + candidate_len, suffix.data(), suffix.length());
+    layout->image[image_len] = 0x80;
+    const uint64_t bits = layout->message_len * 8;
+    const unsigned int end = layout->image_blocks * 64;
+    for (unsigned int i = 0; i < 8; ++i)
+    {
+        layout->image[layout->big_endian ? end - 1 - i : end - 8 + i] = (unsigned char)(bits >> (8 * i));
+    }
+    for (unsigned int i = 0; i < layout->image_blocks * 16; ++i)
+    {
+        layout->words[i] = layout_load_word(&layout->image[4 * i], layout->big_endian);
+    }
+
+    layout->candidate_offset = (unsigned int)prefix_rest;
+    layout->first_word = layout->candidate_offset / 4;
+    layout->last_word = (candidate_len > 0) ? (layout->candidate_offset + candidate_len - 1) / 4 : layout->first_word;
+    layout->cached_blocks = (candidate_len > 0) ? (layout->candidate_offset + candidate_len - 1) / 64 : 0;
+    return true;
+}
+
+void layout_set_hmac_key(MessageLayout* layout)
+{
+    for (unsigned int i = 0; i < 16; ++i)
+    {
+        layout->words[i] ^= CHmacIpad;
+    }
+    layout->candidate_xor = CHmacIpad;
+}
@@ -0,0 +1,55 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Message layout for salted targets such as sha1($salt . $x) or sha1($x . $salt).
+
+The message is prefix + candidate + suffix. The leading blocks that consist of the prefix only are compressed once, into "midstate".
+The remaining blocks (the "image": the rest of the prefix, the candidate, the suffix, the padding and the length) are kept as words,
+so for every candidate only the words that hold candidate bytes are reloaded.
+The image blocks before the block with the last candidate byte change only when a carry reaches the leading characters of the candidate,
+so the engine caches the state after them too, and a message costs as many compressions as there are blocks from the last candidate byte on:
+a 60-byte prefix costs one compression per 16-character candidate, the same as no prefix at all.
+*/
+
+#ifndef PHPMAGIC_LAYOUT_H
+#define PHPMAGIC_LAYOUT_H
+
+#include <string>
+#include <stdint.h>
+#include "phpmagic_chain.h"
+
+const unsigned int CLayoutMaxBlocks = 16;
+const unsigned int CLayoutMaxWords = CLayoutMaxBlocks * 16;
+
+typedef struct {
+    HashAlgorithm algorithm;
+    bool big_endian;
+    uint32_t midstate[5];             // the state after the constant leading blocks
+    uint64_t message_len;             // the whole message, prefix + candidate + suffix
+    unsigned int image_blocks;
+    unsigned char image[CLayoutMaxBlocks * 64];
+    uint32_t words[CLayoutMaxWords];  // the image as words in the byte order of the algorithm
+    unsigned int candidate_offset;    // in the image
+    unsigned int candidate_len;
+    unsigned int first_word;          // the words that hold candidate bytes
+    unsigned int last_word;
+    unsigned int cached_blocks;       // the image blocks before the one with the last candidate byte
+    uint32_t candidate_xor;           // applied to the candidate words when they are loaded
+} MessageLayout;
+
+bool layout_init(MessageLayout* layout, const HashAlgorithm algorithm, const std::string& prefix, const unsigned int candidate_len, const std::string& suffix, std::string* error);
+
+// For HMAC with the candidate as the key: the candidate, zero-padded to the first block, becomes K ^ ipad
+void layout_set_hmac_key(MessageLayout* layout);
+
+static inline uint32_t layout_load_word(const unsigned char* p, const bool big_endian)
+{
+    if (big_endian)
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    else
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+#endif
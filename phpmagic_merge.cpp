@@ -0,0 +1,177 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Combines the shard files of a "--shard" search, see "phpmagic_shard.h": checks that they belong to the same search, prints the hits, the
+shards with no file or an incomplete one and the ranges of the keyspace that are not covered, and with "-o FILE" writes the merged file, which
+can be merged again with others.
+
+Usage: phpmagic_merge [-o MERGED] FILE...
+*/
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "phpmagic_shard.h"
+
+const unsigned int CMergeMaxListed = 16;
+
+// The part of [begin, end) covered by the sorted, disjoint ranges
+static uint64_t covered_in(const std::vector<ShardCovered>& covered, const uint64_t begin, const uint64_t end)
+{
+    uint64_t total = 0;
+    for (std::vector<ShardCovered>::size_type c = 0; c < covered.size(); ++c)
+    {
+        const uint64_t b = (covered[c].begin > begin) ? covered[c].begin : begin;
+        const uint64_t e = (covered[c].end < end) ? covered[c].end : end;
+        if (b < e) total += e - b;
+    }
+    return total;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string output_path;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if ((arg == "-o") && (i + 1 < argc))
+        {
+            output_path = argv[++i];
+        }
+        else if (!arg.empty() && (arg[0] != '-'))
+        {
+            paths.push_back(arg);
+        }
+        else
+        {
+            std::cerr << "Unknown or incomplete option '" << arg << "'" << std::endl;
+            paths.clear();
+            break;
+        }
+    }
+    if (paths.empty())
+    {
+        std::cerr << "Usage: " << argv[0] << " [-o MERGED] FILE..." << std::endl;
+        return 1;
+    }
+
+    ShardFile merged;
+    for (std::vector<std::string>::size_type f = 0; f < paths.size(); ++f)
+    {
+        ShardFile file;
+        std::string error;
+        if (!shard_read(paths[f], &file, &error))
+        {
+            std::cerr << "Shard error: " << error << std::endl;
+            return 1;
+        }
+        if (f == 0)
+        {
+            merged.fingerprint = file.fingerprint;
+            merged.hash = file.hash;
+            merged.keyspace = file.keyspace;
+        }
+        else if ((file.fingerprint != merged.fingerprint) || (file.keyspace != merged.keyspace))
+        {
+            std::cerr << "Shard error: '" << paths[f] << "' is the file of another search than '" << paths[0] << "'" << std::endl;
+            return 1;
+        }
+        merged.ranges.insert(merged.ranges.end(), file.ranges.begin(), file.ranges.end());
+        merged.covered.insert(merged.covered.end(), file.covered.begin(), file.covered.end());
+        merged.hits.insert(merged.hits.end(), file.hits.begin(), file.hits.end());
+    }
+    shard_normalize(&merged);
+
+    const uint64_t covered = covered_in(merged.covered, 0, merged.keyspace);
+    std::cout << "Merged " << paths.size() << " file(s) of the search " << merged.fingerprint << ", " << merged.hash << ", " << merged.keyspace << " messages" << std::endl;
+    std::cout << "Covered " << covered << " messages (" << 100.0 * covered / merged.keyspace << "%)" << std::endl;
+
+    // the shards by their index, for the files of the same split of the keyspace
+    std::map<unsigned int, std::vector<ShardRange> > shards;
+    bool same_count = true;
+    for (std::vector<ShardRange>::size_type r = 0; r < merged.ranges.size(); ++r)
+    {
+        shards[merged.ranges[r].index].push_back(merged.ranges[r]);
+        same_count = same_count && (merged.ranges[r].count == merged.ranges[0].count);
+    }
+    if (!merged.ranges.empty() && same_count)
+    {
+        const unsigned int count = merged.ranges[0].count;
+        std::vector<unsigned int> absent;
+        for (unsigned int s = 0; s < count; ++s)
+        {
+            if (shards.find(s) == shards.end()) absent.push_back(s);
+        }
+        std::cout << "Shards with a file: " << count - absent.size() << " of " << count << std::endl;
+        if (!absent.empty())
+        {
+            // as ranges, e.g. "0-2,4,7-999", to resubmit them as an array
+            std::cout << "Shards without a file: ";
+            for (std::vector<unsigned int>::size_type a = 0; a < absent.size(); ++a)
+            {
+                std::vector<unsigned int>::size_type last = a;
+                while ((last + 1 < absent.size()) && (absent[last + 1] == absent[last] + 1)) ++last;
+                std::cout << ((a > 0) ? "," : "") << absent[a];
+                if (last > a) std::cout << "-" << absent[last];
+                a = last;
+            }
+            std::cout << std::endl;
+        }
+    }
+    for (std::map<unsigned int, std::vector<ShardRange> >::const_iterator s = shards.begin(); s != shards.end(); ++s)
+    {
+        uint64_t size = 0, done = 0;
+        for (std::vector<ShardRange>::size_type r = 0; r < s->second.size(); ++r)
+        {
+            size += s->second[r].end - s->second[r].begin;
+            done += covered_in(merged.covered, s->second[r].begin, s->second[r].end);
+        }
+        if (done < size)
+        {
+            std::cout << "Shard " << s->first << "/" << s->second[0].count << " is incomplete: " << done << " of " << size << " messages covered" << std::endl;
+        }
+    }
+
+    // the gaps of the keyspace, whether their shard has a file or not
+    unsigned int gaps = 0;
+    uint64_t position = 0;
+    for (std::vector<ShardCovered>::size_type c = 0; c <= merged.covered.size(); ++c)
+    {
+        const uint64_t next = (c < merged.covered.size()) ? merged.covered[c].begin : merged.keyspace;
+        if (position < next)
+        {
+            if (gaps < CMergeMaxListed)
+            {
+                std::cout << "Not covered: " << position << " to " << next << std::endl;
+            }
+            ++gaps;
+        }
+        if (c < merged.covered.size()) position = merged.covered[c].end;
+    }
+    if (gaps > CMergeMaxListed)
+    {
+        std::cout << "... " << gaps << " ranges not covered in all" << std::endl;
+    }
+
+    std::cout << merged.hits.size() << " hit(s)" << std::endl;
+    for (std::vector<ShardHit>::size_type h = 0; h < merged.hits.size(); ++h)
+    {
+        const ShardHit& hit = merged.hits[h];
+        std::cout << "Solution: '" << hit.message << "', index " << hit.index << ", " << merged.hash << ": " << hit.digest << ", patterns " << hit.patterns << std::endl;
+    }
+
+    if (!output_path.empty())
+    {
+        std::string error;
+        if (!shard_write(output_path, &merged, &error))
+        {
+            std::cerr << "Shard error: " << error << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,436 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Node-local coordination, see "phpmagic_node.h".
+*/
+
+#ifndef DISABLE_MPI
+#include <mpi.h>
+#endif
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "phpmagic_node.h"
+
+const unsigned int CNodeSlotHits = 16;    // hits a processor may be ahead of its leader
+const unsigned int CNodeIdleWait = 1000;  // microseconds a processor sleeps while it waits for its leader or a leader for its node
+const size_t CNodeHeaderSize = 64;        // the stop flag of the node, then the slots
+
+const int CNodeTagSummary = 41;
+const int CNodeTagStop = 42;
+
+// The slot of a processor in the window of its node; the processor writes all of it but "hits_read", which is written by the leader.
+// "hits" is a ring: the hits from "hits_read" to "hits_written" are not taken by the leader yet
+typedef struct alignas(64) {
+    uint64_t hashed;
+    uint32_t running;
+    int32_t rank;            // in MPI_COMM_WORLD
+    uint32_t hits_written;
+    uint32_t hits_read;
+    phpmagic_hit hits[CNodeSlotHits];
+} NodeSlot;
+
+// A summary of a node, sent by its leader to processor 0 and followed by "hit_count" NodeHit
+typedef struct {
+    uint64_t hashed;
+    uint32_t running;        // the processors of the node still searching
+    uint32_t hit_count;
+} NodeSummary;
+
+typedef struct {
+    int32_t rank;
+    phpmagic_hit hit;
+} NodeHit;
+
+typedef std::chrono::steady_clock NodeClock;
+
+struct NodeGroup {
+    NodeJob job;
+    int world_rank;
+    int node_rank;
+    int node_size;
+    int nodes;
+    int leader_rank;                  // -1 on the processors other than the leaders
+#ifndef DISABLE_MPI
+    MPI_Comm node_comm;
+    MPI_Comm leader_comm;
+    MPI_Win window;
+#endif
+    unsigned char* memory;            // the window of the node
+    uint32_t* stop;
+    NodeSlot* slots;
+    NodeSlot* own;
+    uint64_t hashed;
+    // on a leader
+    std::vector<NodeHit> hits;        // taken from the slots, not forwarded yet
+    NodeClock::time_point last_summary;
+    bool final_sent;
+    bool stop_received;
+    // on processor 0, per node
+    std::vector<std::string> names;
+    std::vector<int> sizes;
+    std::vector<uint64_t> node_hashed;
+    std::vector<uint32_t> node_running;
+    std::vector<bool> finished;
+    std::vector<bool> stop_sent;
+    NodeClock::time_point time_begin;
+    NodeClock::time_point last_progress;
+    uint64_t progress_hashed;
+};
+
+static void raise_stop(NodeGroup* group)
+{
+    __atomic_store_n(group->stop, 1, __ATOMIC_RELEASE);
+}
+
+// Sums the slots of the node and takes their new hits; a processor clears "running" after its last hits and count
+static void collect_node(NodeGroup* group, NodeSummary* summary)
+{
+    summary->hashed = 0;
+    summary->running = 0;
+    for (int i = 0; i < group->node_size; ++i)
+    {
+        NodeSlot* slot = &(group->slots[i]);
+        summary->running += __atomic_load_n(&slot->running, __ATOMIC_ACQUIRE);
+        summary->hashed += __atomic_load_n(&slot->hashed, __ATOMIC_ACQUIRE);
+        const uint32_t written = __atomic_load_n(&slot->hits_written, __ATOMIC_ACQUIRE);
+        uint32_t read = slot->hits_read;
+        for ( ; read != written; ++read)
+        {
+            NodeHit hit;
+            hit.rank = slot->rank;
+            hit.hit = slot->hits[read % CNodeSlotHits];
+            group->hits.push_back(hit);
+        }
+        __atomic_store_n(&slot->hits_read, read, __ATOMIC_RELEASE);
+    }
+    summary->hit_count = (uint32_t)group->hits.size();
+    if (group->job.stop_at_hit && !group->hits.empty())
+    {
+        raise_stop(group);
+    }
+}
+
+// On processor 0: the leaders stop their nodes
+static void stop_nodes(NodeGroup* group)
+{
+    raise_stop(group);
+#ifndef DISABLE_MPI
+    for (int l = 1; l < group->nodes; ++l)
+    {
+        if (!group->stop_sent[l])
+        {
+            MPI_Send(0, 0, MPI_BYTE, l, CNodeTagStop, group->leader_comm);
+            group->stop_sent[l] = true;
+        }
+    }
+#endif
+}
+
+static void print_progress(NodeGroup* group, const NodeClock::time_point now)
+{
+    uint64_t hashed = 0;
+    uint32_t running = 0;
+    for (int l = 0; l < group->nodes; ++l)
+    {
+        hashed += group->node_hashed[l];
+        running += group->node_running[l];
+    }
+    const double seconds = std::chrono::duration<double>(now - group->last_progress).count();
+    std::cout << "Progress: " << hashed << " of " << group->job.keyspace << " messages, " << (uint64_t)((hashed - group->progress_hashed) / seconds / 1000000)
+        << " MH/s, " << running << " processor(s) running on " << group->nodes << " node(s)" << std::endl;
+    group->progress_hashed = hashed;
+    group->last_progress = now;
+}
+
+// On processor 0: the summary of a node
+static void take_summary(NodeGroup* group, const int node, const NodeSummary* summary, const NodeHit* hits)
+{
+    group->node_hashed[node] = summary->hashed;
+    group->node_running[node] = summary->running;
+    group->finished[node] = (summary->running == 0);
+    for (uint32_t h = 0; h < summary->hit_count; ++h)
+    {
+        phpmagic_hit hit = hits[h].hit;
+        phpmagic_results results;
+        results.hits = &hit;
+        results.capacity = 1;
+        results.count = 1;
+        results.hashes = 0;
+        group->job.print(group->job.context, hits[h].rank, group->names[node], &results);
+    }
+    if (group->job.stop_at_hit && (summary->hit_count > 0))
+    {
+        stop_nodes(group);
+    }
+}
+
+// The duties of a leader between the calls of its engine
+static void lead_node(NodeGroup* group)
+{
+#ifndef DISABLE_MPI
+    if ((group->leader_rank > 0) && !group->stop_received)
+    {
+        int flag = 0;
+        MPI_Iprobe(0, CNodeTagStop, group->leader_comm, &flag, MPI_STATUS_IGNORE);
+        if (flag)
+        {
+            MPI_Recv(0, 0, MPI_BYTE, 0, CNodeTagStop, group->leader_comm, MPI_STATUS_IGNORE);
+            group->stop_received = true;
+            raise_stop(group);
+        }
+    }
+#endif
+    if ((group->leader_rank > 0) && group->final_sent) return;
+    NodeSummary summary;
+    collect_node(group, &summary);
+    const NodeClock::time_point now = NodeClock::now();
+
+    if (group->leader_rank == 0)
+    {
+        take_summary(group, 0, &summary, group->hits.empty() ? 0 : &(group->hits[0]));
+        group->hits.clear();
+#ifndef DISABLE_MPI
+        std::vector<unsigned char> buffer;
+        while (true)
+        {
+            int flag = 0;
+            MPI_Status status;
+            MPI_Iprobe(MPI_ANY_SOURCE, CNodeTagSummary, group->leader_comm, &flag, &status);
+            if (!flag) break;
+            int len = 0;
+            MPI_Get_count(&status, MPI_BYTE, &len);
+            buffer.resize(len);
+            MPI_Recv(&buffer[0], len, MPI_BYTE, status.MPI_SOURCE, CNodeTagSummary, group->leader_comm, MPI_STATUS_IGNORE);
+            const NodeSummary* node_summary = (const NodeSummary*)&buffer[0];
+            take_summary(group, status.MPI_SOURCE, node_summary, (const NodeHit*)(buffer.data() + sizeof(NodeSummary)));
+        }
+#endif
+        if (std::chrono::duration_cast<std::chrono::seconds>(now - group->last_progress).count() >= group->job.interval)
+        {
+            print_progress(group, now);
+        }
+        return;
+    }
+
+#ifndef DISABLE_MPI
+    // one message per interval, or at once for the hits and the end of the node
+    if ((summary.hit_count == 0) && (summary.running > 0)
+        && (std::chrono::duration_cast<std::chrono::seconds>(now - group->last_summary).count() < group->job.interval)) return;
+    std::vector<unsigned char> buffer(sizeof(NodeSummary) + summary.hit_count * sizeof(NodeHit));
+    memcpy(&buffer[0], &summary, sizeof(NodeSummary));
+    if (summary.hit_count > 0)
+    {
+        memcpy(&buffer[sizeof(NodeSummary)], &(group->hits[0]), summary.hit_count * sizeof(NodeHit));
+    }
+    MPI_Send(&buffer[0], (int)buffer.size(), MPI_BYTE, 0, CNodeTagSummary, group->leader_comm);
+    group->hits.clear();
+    group->last_summary = now;
+    group->final_sent = (summary.running == 0);
+#endif
+}
+
+NodeGroup* node_create(const NodeJob* job, const std::string& processor_name, std::string* error)
+{
+    NodeGroup* group = new NodeGroup;
+    group->job = *job;
+    group->world_rank = 0;
+    group->node_rank = 0;
+    group->node_size = 1;
+    group->nodes = 1;
+    group->leader_rank = 0;
+    group->hashed = 0;
+    group->final_sent = false;
+    group->stop_received = false;
+#ifndef DISABLE_MPI
+    MPI_Comm_rank(MPI_COMM_WORLD, &group->world_rank);
+    if (MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, group->world_rank, MPI_INFO_NULL, &group->node_comm) != MPI_SUCCESS)
+    {
+        *error = "MPI_Comm_split_type failed";
+        delete group;
+        return 0;
+    }
+    MPI_Comm_rank(group->node_comm, &group->node_rank);
+    MPI_Comm_size(group->node_comm, &group->node_size);
+    // the leaders in the order of their ranks, so processor 0 is the leader 0
+    MPI_Comm_split(MPI_COMM_WORLD, (group->node_rank == 0) ? 0 : MPI_UNDEFINED, group->world_rank, &group->leader_comm);
+    group->leader_rank = -1;
+    if (group->leader_comm != MPI_COMM_NULL)
+    {
+        MPI_Comm_rank(group->leader_comm, &group->leader_rank);
+    }
+    const int leader = (group->node_rank == 0) ? 1 : 0;
+    MPI_Allreduce(&leader, &group->nodes, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+    // the leader allocates the window, the others map it
+    const MPI_Aint own_size = (group->node_rank == 0) ? (MPI_Aint)(CNodeHeaderSize + sizeof(NodeSlot) * (size_t)group->node_size) : 0;
+    void* memory = 0;
+    if (MPI_Win_allocate_shared(own_size, 1, MPI_INFO_NULL, group->node_comm, &memory, &group->window) != MPI_SUCCESS)
+    {
+        *error = "MPI_Win_allocate_shared failed";
+        delete group;
+        return 0;
+    }
+    MPI_Aint size = 0;
+    int disp_unit = 0;
+    MPI_Win_shared_query(group->window, 0, &size, &disp_unit, &memory);
+    group->memory = (unsigned char*)memory;
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, group->window);
+#else
+    group->memory = (unsigned char*)aligned_alloc(64, CNodeHeaderSize + sizeof(NodeSlot));
+#endif
+    group->stop = (uint32_t*)group->memory;
+    group->slots = (NodeSlot*)(group->memory + CNodeHeaderSize);
+    group->own = &(group->slots[group->node_rank]);
+    if (group->node_rank == 0)
+    {
+        *group->stop = 0;
+    }
+    memset(group->own, 0, sizeof(NodeSlot));
+    group->own->rank = group->world_rank;
+    group->own->running = 1;
+#ifndef DISABLE_MPI
+    MPI_Win_sync(group->window);
+    MPI_Barrier(group->node_comm);
+    MPI_Win_sync(group->window);
+#endif
+
+    // processor 0 names the nodes by their leaders
+    group->names.assign(group->nodes, processor_name);
+    group->sizes.assign(group->nodes, group->node_size);
+#ifndef DISABLE_MPI
+    if (group->leader_rank >= 0)
+    {
+        char name[MPI_MAX_PROCESSOR_NAME];
+        memset(name, 0, sizeof(name));
+        strncpy(name, processor_name.c_str(), sizeof(name) - 1);
+        std::vector<char> names((group->leader_rank == 0) ? group->nodes * MPI_MAX_PROCESSOR_NAME : 1);
+        MPI_Gather(name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, &names[0], MPI_MAX_PROCESSOR_NAME, MPI_CHAR, 0, group->leader_comm);
+        MPI_Gather(&group->node_size, 1, MPI_INT, &(group->sizes[0]), 1, MPI_INT, 0, group->leader_comm);
+        if (group->leader_rank == 0)
+        {
+            for (int l = 0; l < group->nodes; ++l)
+            {
+                group->names[l] = std::string(&names[l * MPI_MAX_PROCESSOR_NAME]);
+            }
+        }
+    }
+#endif
+    group->node_hashed.assign(group->nodes, 0);
+    group->node_running.assign(group->sizes.begin(), group->sizes.end());
+    group->finished.assign(group->nodes, false);
+    group->stop_sent.assign(group->nodes, false);
+    group->time_begin = NodeClock::now();
+    group->last_progress = group->time_begin;
+    group->last_summary = group->time_begin;
+    group->progress_hashed = 0;
+    return group;
+}
+
+void node_layout(const NodeGroup* group, int* nodes, int* node_rank, int* node_size)
+{
+    *nodes = group->nodes;
+    *node_rank = group->node_rank;
+    *node_size = group->node_size;
+}
+
+bool node_publish(NodeGroup* group, const phpmagic_results* results)
+{
+    NodeSlot* own = group->own;
+    for (unsigned int h = 0; h < results->count; ++h)
+    {
+        // the leader takes the hits at its next check
+        while (own->hits_written - __atomic_load_n(&own->hits_read, __ATOMIC_ACQUIRE) >= CNodeSlotHits)
+        {
+            if (group->leader_rank >= 0)
+            {
+                lead_node(group);
+            }
+            else
+            {
+                usleep(CNodeIdleWait);
+            }
+        }
+        own->hits[own->hits_written % CNodeSlotHits] = results->hits[h];
+        __atomic_store_n(&own->hits_written, own->hits_written + 1, __ATOMIC_RELEASE);
+    }
+    group->hashed += results->hashes;
+    __atomic_store_n(&own->hashed, group->hashed, __ATOMIC_RELEASE);
+    if (group->leader_rank >= 0)
+    {
+        lead_node(group);
+    }
+    if (group->job.stop_at_hit && (results->count > 0))
+    {
+        return true;
+    }
+    return __atomic_load_n(group->stop, __ATOMIC_ACQUIRE) != 0;
+}
+
+void node_finish(NodeGroup* group)
+{
+    __atomic_store_n(&group->own->running, 0, __ATOMIC_RELEASE);
+    if (group->leader_rank < 0) return;
+    while (true)
+    {
+        lead_node(group);
+        if (group->leader_rank > 0)
+        {
+            if (group->final_sent) break;
+        }
+        else
+        {
+            bool all_finished = true;
+            for (int l = 0; l < group->nodes; ++l)
+            {
+                all_finished = all_finished && group->finished[l];
+            }
+            if (all_finished) break;
+        }
+        usleep(CNodeIdleWait);
+    }
+#ifndef DISABLE_MPI
+    if (group->leader_rank > 0)
+    {
+        // processor 0 stops every leader once, after the end of all the nodes at the latest
+        if (!group->stop_received)
+        {
+            MPI_Recv(0, 0, MPI_BYTE, 0, CNodeTagStop, group->leader_comm, MPI_STATUS_IGNORE);
+            group->stop_received = true;
+        }
+        return;
+    }
+    stop_nodes(group);
+#endif
+    uint64_t hashed = 0;
+    int processors = 0;
+    for (int l = 0; l < group->nodes; ++l)
+    {
+        hashed += group->node_hashed[l];
+        processors += group->sizes[l];
+    }
+    const double seconds = std::chrono::duration<double>(NodeClock::now() - group->time_begin).count();
+    std::cout << processors << " processor(s) on " << group->nodes << " node(s) hashed " << hashed << " messages in " << (uint64_t)(seconds * 1000)
+        << " milliseconds, " << (uint64_t)(hashed / seconds / 1000000) << " MH/s" << std::endl;
+}
+
+void node_free(NodeGroup* group)
+{
+#ifndef DISABLE_MPI
+    MPI_Win_unlock_all(group->window);
+    MPI_Win_free(&group->window);
+    if (group->leader_comm != MPI_COMM_NULL)
+    {
+        MPI_Comm_free(&group->leader_comm);
+    }
+    MPI_Comm_free(&group->node_comm);
+#else
+    free(group->memory);
+#endif
+    delete group;
+}
@@ -0,0 +1,50 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Node-local coordination: "--hierarchical" groups the processors per node, so the messages of a run scale with the nodes rather than the cores.
+
+The processors of a node (MPI_Comm_split_type() with MPI_COMM_TYPE_SHARED) share an MPI window. Each processor writes its count of hashed
+candidates and its hits into its own slot of it after every call of the engine, and reads the stop flag of the node from it. The processor
+with the lowest rank of the node is its leader: between its own calls of the engine it sums the slots and sends processor 0 one summary per
+interval over a communicator of the leaders, and at once if its node has new hits or has finished. Processor 0, the leader of its node,
+prints the hits and the progress of the whole run; a hit that ends the search makes it tell the leaders, and each leader raises the stop flag
+of its node. A solution therefore stops the run in an orderly way instead of by MPI_Abort().
+*/
+
+#ifndef PHPMAGIC_NODE_H
+#define PHPMAGIC_NODE_H
+
+#include <string>
+#include <stdint.h>
+#include "phpmagic_search.h"
+
+// Prints the hits found by the processor "mpi_rank" on the node "processor_name"; called on processor 0 only
+typedef void (*NodePrint)(const void* context, const int mpi_rank, const std::string& processor_name, const phpmagic_results* results);
+
+typedef struct {
+    uint64_t keyspace;       // for the progress reports
+    unsigned int interval;   // seconds between the summaries of a leader and the progress reports
+    bool stop_at_hit;
+    NodePrint print;
+    const void* context;
+} NodeJob;
+
+typedef struct NodeGroup NodeGroup;
+
+// Collective over MPI_COMM_WORLD: splits the processors per node and maps the window of the node; 0 and the reason on an MPI error
+NodeGroup* node_create(const NodeJob* job, const std::string& processor_name, std::string* error);
+void node_layout(const NodeGroup* group, int* nodes, int* node_rank, int* node_size);
+
+// After each call of the engine: publishes the hashed candidates and the hits, and on a leader forwards those of its node;
+// returns true if the search is to stop
+bool node_publish(NodeGroup* group, const phpmagic_results* results);
+
+// At the end of the search of this processor: a leader waits for the processors of its node, processor 0 for all the nodes
+void node_finish(NodeGroup* group);
+
+// Collective over MPI_COMM_WORLD
+void node_free(NodeGroup* group);
+
+#endif
@@ -0,0 +1,544 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+The OpenCL engine, see "phpmagic_opencl.h".
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#ifdef __unix__
+#include <dlfcn.h>
+#endif
+#include "phpmagic_opencl.h"
+
+const char COpenclSource[] = R"CL(
+#define ROTL(x, n) rotate((uint)(x), (uint)(n))
+
+__kernel void phpmagic_sha1(__constant uint* words, __constant uchar* charset, const uint radix, const uint tail, const uint tail_offset,
+    const uint first, const uint count, __constant uint* gate, __constant uint* terms, const uint term_count,
+    __global volatile uint* hit_count, __global uint* hits, const uint hit_capacity)
+{
+    const uint i = get_global_id(0);
+    if (i >= count) return;
+    uint w[16];
+    for (int k = 0; k < 16; ++k) w[k] = words[k];
+
+    // the candidate generator: the last "tail" characters from the offset in the block, the leading ones are in the words
+    uint n = first + i;
+    for (int j = (int)tail - 1; j >= 0; --j)
+    {
+        const uint pos = tail_offset + (uint)j;
+        w[pos >> 2] |= (uint)charset[n % radix] << (24 - 8 * (pos & 3));
+        n /= radix;
+    }
+
+    uint a = 0x67452301, b = 0xEFCDAB89, c = 0x98BADCFE, d = 0x10325476, e = 0xC3D2E1F0;
+#pragma unroll
+    for (int r = 0; r < 80; ++r)
+    {
+        uint x;
+        if (r < 16)
+        {
+            x = w[r];
+        }
+        else
+        {
+            x = ROTL(w[(r + 13) & 15] ^ w[(r + 8) & 15] ^ w[(r + 2) & 15] ^ w[r & 15], 1);
+            w[r & 15] = x;
+        }
+        uint f, k;
+        if (r < 20) { f = (b & c) | (~b & d); k = 0x5A827999; }
+        else if (r < 40) { f = b ^ c ^ d; k = 0x6ED9EBA1; }
+        else if (r < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+        else { f = b ^ c ^ d; k = 0xCA62C1D6; }
+        const uint t = ROTL(a, 5) + f + e + k + x;
+        e = d;
+        d = c;
+        c = ROTL(b, 30);
+        b = a;
+        a = t;
+    }
+    uint h[5];
+    h[0] = a + 0x67452301;
+    h[1] = b + 0xEFCDAB89;
+    h[2] = c + 0x98BADCFE;
+    h[3] = d + 0x10325476;
+    h[4] = e + 0xC3D2E1F0;
+
+    // the patterns: the bitmap over the top 16 bits, then the terms, 5 words each of and_mask, cmp, digit_mask and alpha_mask
+    const uint top = h[0] >> 16;
+    if (!((gate[top >> 5] >> (top & 31)) & 1)) return;
+    for (uint t = 0; t < term_count; ++t)
+    {
+        __constant uint* term = terms + 20 * t;
+        bool match = true;
+        for (int k = 0; match && (k < 5); ++k)
+        {
+            const uint x = h[k];
+            const uint alpha = x & ((x << 1) | (x << 2)) & 0x88888888;
+            match = ((x & term[k]) == term[5 + k]) && !(alpha & term[10 + k]) && ((alpha & term[15 + k]) == term[15 + k]);
+        }
+        if (match)
+        {
+            const uint slot = atomic_inc(hit_count);
+            if (slot < hit_capacity) hits[slot] = i;
+            return;
+        }
+    }
+}
+)CL";
+
+// The part of the OpenCL 1.2 API the engine uses, loaded at run time
+typedef int32_t cl_int;
+typedef uint32_t cl_uint;
+typedef uint64_t cl_bitfield;
+typedef struct _cl_platform_id* cl_platform_id;
+typedef struct _cl_device_id* cl_device_id;
+typedef struct _cl_context* cl_context;
+typedef struct _cl_command_queue* cl_command_queue;
+typedef struct _cl_program* cl_program;
+typedef struct _cl_kernel* cl_kernel;
+typedef struct _cl_mem* cl_mem;
+typedef struct _cl_event* cl_event;
+
+const cl_int CL_SUCCESS = 0;
+const cl_bitfield CL_DEVICE_TYPE_ALL = 0xFFFFFFFF;
+const cl_uint CL_DEVICE_NAME = 0x102B;
+const cl_uint CL_PROGRAM_BUILD_LOG = 0x1183;
+const cl_bitfield CL_MEM_READ_WRITE = 1 << 0;
+const cl_bitfield CL_MEM_READ_ONLY = 1 << 2;
+const cl_bitfield CL_MEM_COPY_HOST_PTR = 1 << 5;
+const cl_uint CL_FALSE = 0;
+const cl_uint CL_TRUE = 1;
+
+typedef struct {
+    cl_int (*GetPlatformIDs)(cl_uint, cl_platform_id*, cl_uint*);
+    cl_int (*GetDeviceIDs)(cl_platform_id, cl_bitfield, cl_uint, cl_device_id*, cl_uint*);
+    cl_int (*GetDeviceInfo)(cl_device_id, cl_uint, size_t, void*, size_t*);
+    cl_context (*CreateContext)(const intptr_t*, cl_uint, const cl_device_id*, void (*)(const char*, const void*, size_t, void*), void*, cl_int*);
+    cl_command_queue (*CreateCommandQueue)(cl_context, cl_device_id, cl_bitfield, cl_int*);
+    cl_program (*CreateProgramWithSource)(cl_context, cl_uint, const char**, const size_t*, cl_int*);
+    cl_int (*BuildProgram)(cl_program, cl_uint, const cl_device_id*, const char*, void (*)(cl_program, void*), void*);
+    cl_int (*GetProgramBuildInfo)(cl_program, cl_device_id, cl_uint, size_t, void*, size_t*);
+    cl_kernel (*CreateKernel)(cl_program, const char*, cl_int*);
+    cl_mem (*CreateBuffer)(cl_context, cl_bitfield, size_t, void*, cl_int*);
+    cl_int (*SetKernelArg)(cl_kernel, cl_uint, size_t, const void*);
+    cl_int (*EnqueueWriteBuffer)(cl_command_queue, cl_mem, cl_uint, size_t, size_t, const void*, cl_uint, const cl_event*, cl_event*);
+    cl_int (*EnqueueReadBuffer)(cl_command_queue, cl_mem, cl_uint, size_t, size_t, void*, cl_uint, const cl_event*, cl_event*);
+    cl_int (*EnqueueNDRangeKernel)(cl_command_queue, cl_kernel, cl_uint, const size_t*, const size_t*, const size_t*, cl_uint, const cl_event*, cl_event*);
+    cl_int (*WaitForEvents)(cl_uint, const cl_event*);
+    cl_int (*ReleaseEvent)(cl_event);
+    cl_int (*Flush)(cl_command_queue);
+    cl_int (*Finish)(cl_command_queue);
+    cl_int (*ReleaseMemObject)(cl_mem);
+    cl_int (*ReleaseKernel)(cl_kernel);
+    cl_int (*ReleaseProgram)(cl_program);
+    cl_int (*ReleaseCommandQueue)(cl_command_queue);
+    cl_int (*ReleaseContext)(cl_context);
+} OpenclApi;
+
+static bool load_api(OpenclApi* api, std::string* error)
+{
+#ifdef __unix__
+    void* library = dlopen("libOpenCL.so.1", RTLD_NOW);
+    if (!library) library = dlopen("libOpenCL.so", RTLD_NOW);
+    if (!library)
+    {
+        *error = "no OpenCL library (libOpenCL.so.1)";
+        return false;
+    }
+    bool loaded = true;
+    auto load = [&](void* field, const char* name) {
+        void* symbol = dlsym(library, name);
+        if (!symbol) loaded = false;
+        memcpy(field, &symbol, sizeof(symbol));
+    };
+    load(&api->GetPlatformIDs, "clGetPlatformIDs");
+    load(&api->GetDeviceIDs, "clGetDeviceIDs");
+    load(&api->GetDeviceInfo, "clGetDeviceInfo");
+    load(&api->CreateContext, "clCreateContext");
+    load(&api->CreateCommandQueue, "clCreateCommandQueue");
+    load(&api->CreateProgramWithSource, "clCreateProgramWithSource");
+    load(&api->BuildProgram, "clBuildProgram");
+    load(&api->GetProgramBuildInfo, "clGetProgramBuildInfo");
+    load(&api->CreateKernel, "clCreateKernel");
+    load(&api->CreateBuffer, "clCreateBuffer");
+    load(&api->SetKernelArg, "clSetKernelArg");
+    load(&api->EnqueueWriteBuffer, "clEnqueueWriteBuffer");
+    load(&api->EnqueueReadBuffer, "clEnqueueReadBuffer");
+    load(&api->EnqueueNDRangeKernel, "clEnqueueNDRangeKernel");
+    load(&api->WaitForEvents, "clWaitForEvents");
+    load(&api->ReleaseEvent, "clReleaseEvent");
+    load(&api->Flush, "clFlush");
+    load(&api->Finish, "clFinish");
+    load(&api->ReleaseMemObject, "clReleaseMemObject");
+    load(&api->ReleaseKernel, "clReleaseKernel");
+    load(&api->ReleaseProgram, "clReleaseProgram");
+    load(&api->ReleaseCommandQueue, "clReleaseCommandQueue");
+    load(&api->ReleaseContext, "clReleaseContext");
+    if (!loaded)
+    {
+        *error = "the OpenCL library lacks OpenCL 1.2 functions";
+        return false;
+    }
+    return true;
+#else
+    (void)api;
+    *error = "OpenCL is only loaded on Unix";
+    return false;
+#endif
+}
+
+// A launch in flight and its buffers
+typedef struct {
+    cl_mem words;
+    cl_mem hit_count;
+    cl_mem hits;
+    uint32_t host_words[16];
+    uint32_t host_count;
+    uint32_t host_hits[COpenclHitCapacity];
+    uint64_t start;
+    uint32_t count;
+    cl_event done;
+} OpenclSlot;
+
+struct OpenclEngine {
+    OpenclApi api;
+    cl_context context;
+    cl_command_queue queue;
+    cl_program program;
+    cl_kernel kernel;
+    cl_mem charset;
+    cl_mem gate;
+    cl_mem terms;
+    OpenclSlot slots[2];
+    std::string device_name;
+    std::string charset_text;
+    unsigned int length;
+    unsigned int tail;          // the characters counted by the work-items
+    uint64_t block;             // radix ^ tail
+    uint32_t term_count;
+    uint32_t words[16];         // the message with zero candidate bytes
+    unsigned int prefix_len;
+    std::mutex lock;
+};
+
+static std::string cl_error(const char* function, const cl_int status)
+{
+    return std::string(function) + " failed with the OpenCL error " + std::to_string(status);
+}
+
+OpenclEngine* opencl_create(const Predicate* predicate, const std::string& charset, const unsigned int length, const unsigned int device,
+    std::string* error)
+{
+    if ((predicate->terms.size() > COpenclMaxTerms) || (predicate->targets.count > 0) || (predicate->digest_words != 5))
+    {
+        *error = "the OpenCL engine takes SHA-1 and at most " + std::to_string(COpenclMaxTerms) + " pattern terms, without targets";
+        return 0;
+    }
+    if ((length == 0) || charset.empty())
+    {
+        *error = "the OpenCL engine needs a candidate";
+        return 0;
+    }
+    OpenclEngine* engine = new OpenclEngine();
+    OpenclApi& cl = engine->api;
+    if (!load_api(&cl, error))
+    {
+        delete engine;
+        return 0;
+    }
+
+    // the devices of all the platforms, in order
+    cl_uint platform_count = 0;
+    cl_int status = cl.GetPlatformIDs(0, 0, &platform_count);
+    if ((status != CL_SUCCESS) || (platform_count == 0))
+    {
+        *error = "no OpenCL platform (" + std::to_string(status) + "), e.g. install PoCL";
+        delete engine;
+        return 0;
+    }
+    std::vector<cl_platform_id> platforms(platform_count);
+    cl.GetPlatformIDs(platform_count, platforms.data(), 0);
+    cl_device_id chosen = 0;
+    unsigned int seen = 0;
+    for (cl_uint p = 0; (p < platform_count) && !chosen; ++p)
+    {
+        cl_uint device_count = 0;
+        if ((cl.GetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, 0, 0, &device_count) != CL_SUCCESS) || (device_count == 0)) continue;
+        std::vector<cl_device_id> devices(device_count);
+        cl.GetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, device_count, devices.data(), 0);
+        if (device < seen + device_count) chosen = devices[device - seen];
+        seen += device_count;
+    }
+    if (!chosen)
+    {
+        *error = "no OpenCL device " + std::to_string(device) + ", there are " + std::to_string(seen);
+        delete engine;
+        return 0;
+    }
+    char name[256] = { 0 };
+    cl.GetDeviceInfo(chosen, CL_DEVICE_NAME, sizeof(name) - 1, name, 0);
+    engine->device_name = name;
+
+    engine->context = cl.CreateContext(0, 1, &chosen, 0, 0, &status);
+    if (status == CL_SUCCESS) engine->queue = cl.CreateCommandQueue(engine->context, chosen, 0, &status);
+    const char* source = COpenclSource;
+    if (status == CL_SUCCESS) engine->program = cl.CreateProgramWithSource(engine->context, 1, &source, 0, &status);
+    if (status == CL_SUCCESS)
+    {
+        status = cl.BuildProgram(engine->program, 1, &chosen, "", 0, 0);
+        if (status != CL_SUCCESS)
+        {
+            char log[4096] = { 0 };
+            cl.GetProgramBuildInfo(engine->program, chosen, CL_PROGRAM_BUILD_LOG, sizeof(log) - 1, log, 0);
+            *error = cl_error("clBuildProgram", status) + ": " + log;
+            opencl_free(engine);
+            return 0;
+        }
+    }
+    if (status == CL_SUCCESS) engine->kernel = cl.CreateKernel(engine->program, "phpmagic_sha1", &status);
+
+    // the character set, the bitmap and the terms are constant for the configuration
+    std::vector<uint32_t> terms;
+    for (std::vector<PredicateTerm>::const_iterator t = predicate->terms.begin(); t != predicate->terms.end(); ++t)
+    {
+        terms.insert(terms.end(), t->and_mask, t->and_mask + 5);
+        terms.insert(terms.end(), t->cmp, t->cmp + 5);
+        terms.insert(terms.end(), t->digit_mask, t->digit_mask + 5);
+        terms.insert(terms.end(), t->alpha_mask, t->alpha_mask + 5);
+    }
+    terms.resize(terms.size() + 20);  // a buffer may not be empty
+    engine->term_count = (uint32_t)predicate->terms.size();
+    std::string charset_buffer = charset;
+    if (status == CL_SUCCESS) engine->charset = cl.CreateBuffer(engine->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, charset_buffer.length(), &charset_buffer[0], &status);
+    if (status == CL_SUCCESS) engine->gate = cl.CreateBuffer(engine->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(predicate->gate), (void*)predicate->gate, &status);
+    if (status == CL_SUCCESS) engine->terms = cl.CreateBuffer(engine->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, terms.size() * sizeof(uint32_t), terms.data(), &status);
+    for (unsigned int s = 0; (s < 2) && (status == CL_SUCCESS); ++s)
+    {
+        OpenclSlot& slot = engine->slots[s];
+        slot.words = cl.CreateBuffer(engine->context, CL_MEM_READ_ONLY, sizeof(slot.host_words), 0, &status);
+        if (status == CL_SUCCESS) slot.hit_count = cl.CreateBuffer(engine->context, CL_MEM_READ_WRITE, sizeof(uint32_t), 0, &status);
+        if (status == CL_SUCCESS) slot.hits = cl.CreateBuffer(engine->context, CL_MEM_READ_WRITE, sizeof(slot.host_hits), 0, &status);
+    }
+    if (status != CL_SUCCESS)
+    {
+        *error = cl_error("the set-up of the device", status);
+        opencl_free(engine);
+        return 0;
+    }
+
+    // as many characters as have fewer than 2^32 combinations are counted by the work-items
+    engine->charset_text = charset;
+    engine->length = length;
+    engine->tail = 0;
+    engine->block = 1;
+    while ((engine->tail < length) && (engine->block * charset.length() <= UINT32_MAX))
+    {
+        engine->block *= charset.length();
+        ++engine->tail;
+    }
+    return engine;
+}
+
+void opencl_free(OpenclEngine* engine)
+{
+    if (!engine) return;
+    OpenclApi& cl = engine->api;
+    for (unsigned int s = 0; s < 2; ++s)
+    {
+        if (engine->slots[s].words) cl.ReleaseMemObject(engine->slots[s].words);
+        if (engine->slots[s].hit_count) cl.ReleaseMemObject(engine->slots[s].hit_count);
+        if (engine->slots[s].hits) cl.ReleaseMemObject(engine->slots[s].hits);
+    }
+    if (engine->terms) cl.ReleaseMemObject(engine->terms);
+    if (engine->gate) cl.ReleaseMemObject(engine->gate);
+    if (engine->charset) cl.ReleaseMemObject(engine->charset);
+    if (engine->kernel) cl.ReleaseKernel(engine->kernel);
+    if (engine->program) cl.ReleaseProgram(engine->program);
+    if (engine->queue) cl.ReleaseCommandQueue(engine->queue);
+    if (engine->context) cl.ReleaseContext(engine->context);
+    delete engine;
+}
+
+const char* opencl_device_name(const OpenclEngine* engine)
+{
+    return engine->device_name.c_str();
+}
+
+bool opencl_set_message(OpenclEngine* engine, const std::string& prefix, const std::string& suffix, std::string* error)
+{
+    const size_t len = prefix.length() + engine->length + suffix.length();
+    if (len > 55)
+    {
+        *error = "the OpenCL engine hashes messages of one SHA-1 block, up to 55 bytes";
+        return false;
+    }
+    unsigned char block[64];
+    memset(block, 0, sizeof(block));
+    memcpy(block, prefix.data(), prefix.length());
+    memcpy(block + prefix.length() + engine->length, suffix.data(), suffix.length());
+    block[len] = 0x80;
+    block[62] = (unsigned char)((len * 8) >> 8);
+    block[63] = (unsigned char)(len * 8);
+    std::lock_guard<std::mutex> guard(engine->lock);
+    for (unsigned int i = 0; i < 16; ++i)
+    {
+        engine->words[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) | ((uint32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+    }
+    engine->prefix_len = (unsigned int)prefix.length();
+    return true;
+}
+
+// Queues a launch of "count" candidates from "start", which stay within a block; the hits are read back when "done" is signalled
+static cl_int enqueue_launch(OpenclEngine* engine, OpenclSlot* slot, const uint64_t start, const uint32_t count)
+{
+    OpenclApi& cl = engine->api;
+    const uint32_t radix = (uint32_t)engine->charset_text.length();
+    slot->start = start;
+    slot->count = count;
+    slot->host_count = 0;
+    memcpy(slot->host_words, engine->words, sizeof(slot->host_words));
+    // the leading characters are constant in the launch
+    uint64_t lead = start / engine->block;
+    for (unsigned int i = engine->length - engine->tail; i > 0; --i)
+    {
+        const unsigned int pos = engine->prefix_len + i - 1;
+        slot->host_words[pos / 4] |= (uint32_t)(unsigned char)engine->charset_text[lead % radix] << (24 - 8 * (pos % 4));
+        lead /= radix;
+    }
+    const uint32_t tail = engine->tail;
+    const uint32_t tail_offset = engine->prefix_len + engine->length - engine->tail;
+    const uint32_t first = (uint32_t)(start % engine->block);
+    const uint32_t capacity = COpenclHitCapacity;
+    cl_int status = cl.EnqueueWriteBuffer(engine->queue, slot->words, CL_FALSE, 0, sizeof(slot->host_words), slot->host_words, 0, 0, 0);
+    if (status == CL_SUCCESS) status = cl.EnqueueWriteBuffer(engine->queue, slot->hit_count, CL_FALSE, 0, sizeof(uint32_t), &slot->host_count, 0, 0, 0);
+    // the arguments are taken when the kernel is queued
+    cl_uint arg = 0;
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(cl_mem), &slot->words);
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(cl_mem), &engine->charset);
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(uint32_t), &radix);
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(uint32_t), &tail);
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(uint32_t), &tail_offset);
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(uint32_t), &first);
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(uint32_t), &count);
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(cl_mem), &engine->gate);
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(cl_mem), &engine->terms);
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(uint32_t), &engine->term_count);
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(cl_mem), &slot->hit_count);
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(cl_mem), &slot->hits);
+    if (status == CL_SUCCESS) status = cl.SetKernelArg(engine->kernel, arg++, sizeof(uint32_t), &capacity);
+    const size_t global = ((size_t)count + 63) / 64 * 64;
+    if (status == CL_SUCCESS) status = cl.EnqueueNDRangeKernel(engine->queue, engine->kernel, 1, 0, &global, 0, 0, 0, 0);
+    if (status == CL_SUCCESS) status = cl.EnqueueReadBuffer(engine->queue, slot->hit_count, CL_FALSE, 0, sizeof(uint32_t), &slot->host_count, 0, 0, 0);
+    if (status == CL_SUCCESS) status = cl.EnqueueReadBuffer(engine->queue, slot->hits, CL_FALSE, 0, sizeof(slot->host_hits), slot->host_hits, 0, 0, &slot->done);
+    if (status == CL_SUCCESS) status = cl.Flush(engine->queue);
+    return status;
+}
+
+static cl_int wait_launch(OpenclEngine* engine, OpenclSlot* slot)
+{
+    const cl_int status = engine->api.WaitForEvents(1, &slot->done);
+    engine->api.ReleaseEvent(slot->done);
+    slot->done = 0;
+    return status;
+}
+
+// Collects the hits of a finished launch; a launch with more hits than the buffer holds is run again in launches of the size of the buffer,
+// until "limit" indexes are found. "end" is the end of the candidates collected
+static cl_int collect_launch(OpenclEngine* engine, OpenclSlot* slot, const size_t limit, std::vector<uint64_t>* indexes, uint64_t* end)
+{
+    *end = slot->start + slot->count;
+    if (slot->host_count <= COpenclHitCapacity)
+    {
+        for (uint32_t i = 0; i < slot->host_count; ++i)
+        {
+            indexes->push_back(slot->start + slot->host_hits[i]);
+        }
+        return CL_SUCCESS;
+    }
+    const uint64_t launch_end = *end;
+    for (uint64_t start = slot->start; start < launch_end; start += COpenclHitCapacity)
+    {
+        if (indexes->size() >= limit)
+        {
+            *end = start;
+            break;
+        }
+        const uint32_t count = (launch_end - start < COpenclHitCapacity) ? (uint32_t)(launch_end - start) : COpenclHitCapacity;
+        cl_int status = enqueue_launch(engine, slot, start, count);
+        if (status == CL_SUCCESS) status = wait_launch(engine, slot);
+        if (status != CL_SUCCESS) return status;
+        for (uint32_t i = 0; i < slot->host_count; ++i)
+        {
+            indexes->push_back(slot->start + slot->host_hits[i]);
+        }
+    }
+    return CL_SUCCESS;
+}
+
+bool opencl_search(OpenclEngine* engine, const uint64_t start, const uint64_t count, const size_t limit, std::vector<uint64_t>* indexes,
+    uint64_t* searched, std::string* error)
+{
+    std::lock_guard<std::mutex> guard(engine->lock);
+    indexes->clear();
+    *searched = 0;
+    const uint64_t end = start + count;
+    uint64_t next = start;
+    // the next launch, within a block
+    auto next_count = [&]() -> uint32_t {
+        uint64_t limit = (next / engine->block + 1) * engine->block;
+        if (limit > end) limit = end;
+        return (limit - next > COpenclBatch) ? COpenclBatch : (uint32_t)(limit - next);
+    };
+
+    // two launches in flight: the hits of one are collected while the other runs
+    bool busy[2] = { false, false };
+    cl_int status = CL_SUCCESS;
+    for (unsigned int s = 0; (s < 2) && (next < end) && (status == CL_SUCCESS); ++s)
+    {
+        const uint32_t n = next_count();
+        status = enqueue_launch(engine, &engine->slots[s], next, n);
+        busy[s] = status == CL_SUCCESS;
+        next += n;
+    }
+    for (unsigned int s = 0; (busy[0] || busy[1]) && (status == CL_SUCCESS); s ^= 1)
+    {
+        if (!busy[s]) continue;
+        OpenclSlot* slot = &engine->slots[s];
+        status = wait_launch(engine, slot);
+        busy[s] = false;
+        uint64_t launch_end = 0;
+        if (status == CL_SUCCESS) status = collect_launch(engine, slot, limit, indexes, &launch_end);
+        if (status != CL_SUCCESS) break;
+        *searched = launch_end - start;
+        if (indexes->size() >= limit)
+        {
+            // enough: the launch still in flight is dropped, the search ends at the candidates collected
+            if (busy[s ^ 1]) status = wait_launch(engine, &engine->slots[s ^ 1]);
+            break;
+        }
+        if (next < end)
+        {
+            const uint32_t n = next_count();
+            status = enqueue_launch(engine, slot, next, n);
+            busy[s] = status == CL_SUCCESS;
+            next += n;
+        }
+    }
+    if (status != CL_SUCCESS)
+    {
+        engine->api.Finish(engine->queue);
+        for (unsigned int s = 0; s < 2; ++s)
+        {
+            if (engine->slots[s].done) wait_launch(engine, &engine->slots[s]);
+        }
+        *error = cl_error("the OpenCL search", status);
+        return false;
+    }
+    std::sort(indexes->begin(), indexes->end());
+    return true;
+}
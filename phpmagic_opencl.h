@@ -0,0 +1,53 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+The OpenCL engine: SHA-1 of single-block messages on any OpenCL device, a GPU or a CPU runtime such as PoCL.
+
+The candidate generator, SHA-1 and the patterns run in one kernel, one work-item per candidate. A launch covers candidates that share
+all but their last "tail" characters (as many as have fewer than 2^32 combinations), so the host puts the leading characters into the
+message words and a work-item counts only its tail from its 32-bit offset. The digest goes through the first-level bitmap and the terms
+of the patterns (without their per-nibble classes), and a work-item that passes appends its offset to a small buffer; only these offsets
+come back, and the host hashes their candidates again with the reference implementation and checks the full patterns.
+
+A search is split into launches of COpenclBatch candidates, two of them in flight on an in-order queue: the host reads the hits of one
+while the device hashes the next. A launch whose hits do not fit in the buffer is run again in launches of the size of the buffer.
+
+The OpenCL library (libOpenCL.so.1, the ICD loader) is loaded at run time, so the application builds and runs without it; the engine
+then reports why it is unavailable. The engine is serialized by a mutex, so a configuration can still be searched from several threads.
+*/
+
+#ifndef PHPMAGIC_OPENCL_H
+#define PHPMAGIC_OPENCL_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "phpmagic_predicate.h"
+
+const uint32_t COpenclBatch = 1 << 22;       // candidates per launch
+const uint32_t COpenclHitCapacity = 4096;    // offsets per launch
+const unsigned int COpenclMaxTerms = 256;    // in the constant memory of the device
+
+typedef struct OpenclEngine OpenclEngine;
+
+// Builds the kernel for a candidate of "length" characters of "charset" on the device "device" (counted over all the platforms);
+// returns 0 and the reason if there is no OpenCL, no such device, or the predicate does not fit
+OpenclEngine* opencl_create(const Predicate* predicate, const std::string& charset, const unsigned int length, const unsigned int device,
+    std::string* error);
+void opencl_free(OpenclEngine* engine);
+const char* opencl_device_name(const OpenclEngine* engine);
+
+// The text before and after the candidate: with it, the message must fit in one SHA-1 block
+bool opencl_set_message(OpenclEngine* engine, const std::string& prefix, const std::string& suffix, std::string* error);
+
+// The indexes from "start" to "start" + "count" - 1 whose digests passed the device check, sorted; no more launches are queued once
+// "limit" indexes are found, and "searched" is the number of the candidates of the launches done. False and the reason on a device error
+bool opencl_search(OpenclEngine* engine, const uint64_t start, const uint64_t count, const size_t limit, std::vector<uint64_t>* indexes,
+    uint64_t* searched, std::string* error);
+
+// The source of the kernel, OpenCL C 1.2
+extern const char COpenclSource[];
+
+#endif
@@ -0,0 +1,557 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Declarative digest predicates, see "phpmagic_predicate.h" for the pattern syntax.
+*/
+
+#include <set>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <algorithm>
+#include "phpmagic_predicate.h"
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+const uint16_t CNibbleSetAll = 0xffff;
+const uint16_t CNibbleSetDigits = 0x03ff;
+const uint16_t CNibbleSetAlpha = 0xfc00;
+const uint32_t CNibbleBit3 = 0x88888888;
+const unsigned int CRepeatInfinite = UINT_MAX;
+
+typedef struct {
+    uint16_t set;
+    unsigned int min;
+    unsigned int max;
+} PatternItem;
+
+static int hex_value(const char c)
+{
+    if ((c >= '0') && (c <= '9')) return c - '0';
+    if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    return -1;
+}
+
+static bool parse_number(const std::string& s, std::string::size_type* i, unsigned int* value)
+{
+    std::string::size_type start = *i;
+    unsigned long v = 0;
+    while ((*i < s.length()) && (s[*i] >= '0') && (s[*i] <= '9'))
+    {
+        v = v * 10 + (s[*i] - '0');
+        if (v > CPredicateMaxNibbles) v = CPredicateMaxNibbles + 1; // longer than any digest anyway
+        ++*i;
+    }
+    *value = (unsigned int)v;
+    return *i > start;
+}
+
+static bool parse_pattern(const std::string& s, std::vector<PatternItem>* items, std::string* error)
+{
+    std::string::size_type i = 0;
+    items->clear();
+    while (i < s.length())
+    {
+        PatternItem item;
+        item.min = 1;
+        item.max = 1;
+        char c = s[i++];
+        if (c == '.')
+        {
+            item.set = CNibbleSetAll;
+        }
+        else if (c == '[')
+        {
+            bool negate = false;
+            uint16_t set = 0;
+            if ((i < s.length()) && (s[i] == '^'))
+            {
+                negate = true;
+                ++i;
+            }
+            while (true)
+            {
+                if (i >= s.length())
+                {
+                    *error = "unterminated character class";
+                    return false;
+                }
+                if (s[i] == ']')
+                {
+                    ++i;
+                    break;
+                }
+                int lo = hex_value(s[i++]);
+                if (lo < 0)
+                {
+                    *error = "invalid character in a class, only hexadecimal digits are allowed";
+                    return false;
+                }
+                int hi = lo;
+                if ((i + 1 < s.length()) && (s[i] == '-') && (s[i + 1] != ']'))
+                {
+                    hi = hex_value(s[i + 1]);
+                    if ((hi < 0) || (hi < lo))
+                    {
+                        *error = "invalid range in a class";
+                        return false;
+                    }
+                    i += 2;
+                }
+                for (int v = lo; v <= hi; ++v)
+                {
+                    set |= (uint16_t)(1 << v);
+                }
+            }
+            item.set = negate ? (uint16_t)~set : set;
+        }
+        else
+        {
+            int v = hex_value(c);
+            if (v < 0)
+            {
+                *error = std::string("unexpected character '") + c + "'";
+                return false;
+            }
+            item.set = (uint16_t)(1 << v);
+        }
+
+        if (i < s.length())
+        {
+            switch (s[i])
+            {
+            case '*':
+                item.min = 0;
+                item.max = CRepeatInfinite;
+                ++i;
+                break;
+            case '+':
+                item.min = 1;
+                item.max = CRepeatInfinite;
+                ++i;
+                break;
+            case '?':
+                item.min = 0;
+                item.max = 1;
+                ++i;
+                break;
+            case '{':
+                ++i;
+                if (!parse_number(s, &i, &item.min))
+                {
+                    *error = "a number is expected after '{'";
+                    return false;
+                }
+                item.max = item.min;
+                if ((i < s.length()) && (s[i] == ','))
+                {
+                    ++i;
+                    if (!parse_number(s, &i, &item.max))
+                    {
+                        item.max = CRepeatInfinite;
+                    }
+                }
+                if ((i >= s.length()) || (s[i] != '}') || (item.max < item.min))
+                {
+                    *error = "invalid repetition count";
+                    return false;
+                }
+                ++i;
+                break;
+            }
+        }
+        items->push_back(item);
+    }
+    if (items->empty())
+    {
+        *error = "empty pattern";
+        return false;
+    }
+    return true;
+}
+
+// Enumerates all the ways to distribute the digest nibbles among the items; every way gives a vector of per-nibble sets
+static bool expand_items(const std::vector<PatternItem>& items, const std::vector<unsigned int>& suffix_min, unsigned int index, unsigned int pos,
+    std::vector<uint16_t>* sets, std::set<std::vector<uint16_t> >* out)
+{
+    const unsigned int total = (unsigned int)sets->size();
+    if (index == items.size())
+    {
+        if (pos == total)
+        {
+            out->insert(*sets);
+        }
+        return out->size() <= CPredicateMaxTerms;
+    }
+    const PatternItem& item = items[index];
+    unsigned int available = total - pos - suffix_min[index + 1];
+    if (item.min > available) return true;
+    unsigned int max_count = std::min(item.max, available);
+    for (unsigned int count = item.min; count <= max_count; ++count)
+    {
+        for (unsigned int k = 0; k < count; ++k)
+        {
+            (*sets)[pos + k] = item.set;
+        }
+        if (!expand_items(items, suffix_min, index + 1, pos + count, sets, out)) return false;
+    }
+    return true;
+}
+
+// A set is expressible as mask/compare if it is {v : (v & m) == c} for some m and c
+static bool nibble_set_to_mask(const uint16_t set, unsigned int* mask, unsigned int* cmp)
+{
+    unsigned int lowest = 0;
+    while (!(set & (1 << lowest))) ++lowest;
+    for (unsigned int m = 0; m < 16; ++m)
+    {
+        unsigned int c = lowest & m;
+        bool ok = true;
+        for (unsigned int v = 0; v < 16; ++v)
+        {
+            if ((((v & m) == c) ? 1 : 0) != ((set >> v) & 1))
+            {
+                ok = false;
+                break;
+            }
+        }
+        if (ok)
+        {
+            *mask = m;
+            *cmp = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+static unsigned int popcount16(uint16_t v)
+{
+    unsigned int n = 0;
+    for (; v; v &= v - 1) ++n;
+    return n;
+}
+
+static bool build_term(const std::vector<uint16_t>& sets, unsigned int digest_words, unsigned int pattern, PredicateTerm* term, double* probability)
+{
+    memset(term, 0, sizeof(*term));
+    term->pattern = (uint8_t)pattern;
+    double log_pass[CPredicateMaxWords];
+    std::vector<uint8_t> generic_pos[CPredicateMaxWords];
+    std::vector<uint16_t> generic_set[CPredicateMaxWords];
+    for (unsigned int w = 0; w < CPredicateMaxWords; ++w) log_pass[w] = 0;
+
+    for (unsigned int i = 0; i < sets.size(); ++i)
+    {
+        const uint16_t set = sets[i];
+        const unsigned int w = i / 8;
+        const unsigned int shift = 28 - 4 * (i % 8);
+        unsigned int mask, cmp;
+        if (set == 0) return false; // nothing can match, e.g. "[^0-9a-f]"
+        log_pass[w] += log((double)popcount16(set) / 16);
+        if (set == CNibbleSetAll) continue;
+        if (nibble_set_to_mask(set, &mask, &cmp))
+        {
+            term->and_mask[w] |= mask << shift;
+            term->cmp[w] |= cmp << shift;
+        }
+        else if (set == CNibbleSetDigits)
+        {
+            term->digit_mask[w] |= 8u << shift;
+        }
+        else if (set == CNibbleSetAlpha)
+        {
+            term->alpha_mask[w] |= 8u << shift;
+        }
+        else
+        {
+            generic_pos[w].push_back((uint8_t)i);
+            generic_set[w].push_back(set);
+        }
+    }
+
+    unsigned int g = 0;
+    for (unsigned int w = 0; w < digest_words; ++w)
+    {
+        term->generic_begin[w] = (uint8_t)g;
+        for (unsigned int k = 0; k < generic_pos[w].size(); ++k, ++g)
+        {
+            term->generic_pos[g] = generic_pos[w][k];
+            term->generic_set[g] = generic_set[w][k];
+        }
+        term->order[w] = (uint8_t)w;
+    }
+    term->generic_begin[digest_words] = (uint8_t)g;
+    double log_term = 0;
+    for (unsigned int w = 0; w < digest_words; ++w) log_term += log_pass[w];
+    *probability = exp(log_term);
+
+    // staged rejection: the word that is least likely to pass goes first
+    std::stable_sort(&term->order[0], &term->order[digest_words],
+        [&log_pass](uint8_t a, uint8_t b) { return log_pass[a] < log_pass[b]; });
+    return true;
+}
+
+static void gate_add(Predicate* predicate, const std::vector<uint16_t>& sets)
+{
+    const unsigned int gate_nibbles = CPredicateGateBits / 4;
+    uint16_t s[gate_nibbles];
+    for (unsigned int i = 0; i < gate_nibbles; ++i)
+    {
+        s[i] = (i < sets.size()) ? sets[i] : CNibbleSetAll;
+    }
+    for (unsigned int a = 0; a < 16; ++a)
+    {
+        if (!(s[0] & (1 << a))) continue;
+        for (unsigned int b = 0; b < 16; ++b)
+        {
+            if (!(s[1] & (1 << b))) continue;
+            for (unsigned int c = 0; c < 16; ++c)
+            {
+                if (!(s[2] & (1 << c))) continue;
+                for (unsigned int d = 0; d < 16; ++d)
+                {
+                    if (!(s[3] & (1 << d))) continue;
+                    unsigned int top = (a << 12) | (b << 8) | (c << 4) | d;
+                    predicate->gate[top >> 5] |= 1u << (top & 31);
+                }
+            }
+        }
+    }
+}
+
+bool predicate_compile(Predicate* predicate, const std::vector<std::string>& patterns, unsigned int digest_nibbles, std::string* error)
+{
+    predicate->patterns.clear();
+    predicate->terms.clear();
+    predicate->probability = 0;
+    predicate->targets.bitmap.clear();
+    predicate->targets.groups.clear();
+    predicate->targets.count = 0;
+    predicate->targets_pattern = 0;
+    memset(predicate->gate, 0, sizeof(predicate->gate));
+    predicate->digest_nibbles = digest_nibbles;
+    predicate->digest_words = (digest_nibbles + 7) / 8;
+
+    if ((digest_nibbles < CPredicateGateBits / 4) || (digest_nibbles > CPredicateMaxNibbles))
+    {
+        *error = "unsupported digest length";
+        return false;
+    }
+    if (patterns.size() > CPredicateMaxPatterns)
+    {
+        *error = "at most " + std::to_string(CPredicateMaxPatterns) + " patterns are supported";
+        return false;
+    }
+
+    std::set<std::vector<uint16_t> > gate_sets;
+    for (unsigned int p = 0; p < patterns.size(); ++p)
+    {
+        std::vector<PatternItem> items;
+        std::string item_error;
+        if (!parse_pattern(patterns[p], &items, &item_error))
+        {
+            *error = "pattern '" + patterns[p] + "': " + item_error;
+            return false;
+        }
+        std::vector<unsigned int> suffix_min(items.size() + 1, 0);
+        for (unsigned int i = (unsigned int)items.size(); i-- > 0;)
+        {
+            suffix_min[i] = std::min(suffix_min[i + 1] + items[i].min, CPredicateMaxNibbles + 1);
+        }
+        std::vector<uint16_t> sets(digest_nibbles, 0);
+        std::set<std::vector<uint16_t> > expanded;
+        if (!expand_items(items, suffix_min, 0, 0, &sets, &expanded))
+        {
+            *error = "pattern '" + patterns[p] + "' is too ambiguous, it expands to more than " + std::to_string(CPredicateMaxTerms) + " alternatives";
+            return false;
+        }
+        for (std::set<std::vector<uint16_t> >::const_iterator it = expanded.begin(); it != expanded.end(); ++it)
+        {
+            PredicateTerm term;
+            double probability = 0;
+            if (!build_term(*it, predicate->digest_words, p, &term, &probability)) continue;
+            predicate->terms.push_back(term);
+            predicate->probability = std::min(1.0, predicate->probability + probability);
+            gate_sets.insert(std::vector<uint16_t>(it->begin(), it->begin() + CPredicateGateBits / 4));
+        }
+        predicate->patterns.push_back(patterns[p]);
+    }
+    for (std::set<std::vector<uint16_t> >::const_iterator it = gate_sets.begin(); it != gate_sets.end(); ++it)
+    {
+        gate_add(predicate, *it);
+    }
+    return true;
+}
+
+static bool term_match(const PredicateTerm& t, const uint32_t digest[], const unsigned int digest_words)
+{
+    for (unsigned int k = 0; k < digest_words; ++k)
+    {
+        const unsigned int w = t.order[k];
+        const uint32_t x = digest[w];
+        if ((x & t.and_mask[w]) != t.cmp[w]) return false;
+        // bit 3 of a nibble is set in "alpha" if the nibble is a-f: it has bit 3 and either bit 2 or bit 1
+        const uint32_t alpha = x & ((x << 1) | (x << 2)) & CNibbleBit3;
+        if (alpha & t.digit_mask[w]) return false;
+        if ((alpha & t.alpha_mask[w]) != t.alpha_mask[w]) return false;
+        for (unsigned int g = t.generic_begin[w]; g < t.generic_begin[w + 1]; ++g)
+        {
+            const unsigned int nibble = (x >> (28 - 4 * (t.generic_pos[g] % 8))) & 15;
+            if (!((t.generic_set[g] >> nibble) & 1)) return false;
+        }
+    }
+    return true;
+}
+
+bool predicate_add_targets(Predicate* predicate, const std::string& path, std::string* error)
+{
+    if (predicate->patterns.size() >= CPredicateMaxPatterns)
+    {
+        *error = "at most " + std::to_string(CPredicateMaxPatterns) + " patterns, the targets included";
+        return false;
+    }
+    if (!targets_load(&predicate->targets, path, predicate->digest_nibbles, error))
+    {
+        return false;
+    }
+    predicate->targets_pattern = (unsigned int)predicate->patterns.size();
+    predicate->patterns.push_back("the prefixes of '" + path + "'");
+    predicate->probability = std::min(1.0, predicate->probability + targets_probability(&predicate->targets));
+    return true;
+}
+
+uint32_t predicate_match(const Predicate* predicate, const uint32_t digest[])
+{
+    uint32_t hits = targets_match(&predicate->targets, digest) ? 1u << predicate->targets_pattern : 0;
+    const uint32_t top = digest[0] >> (32 - CPredicateGateBits);
+    if (!((predicate->gate[top >> 5] >> (top & 31)) & 1)) return hits;
+
+    const unsigned int digest_words = predicate->digest_words;
+    for (std::vector<PredicateTerm>::const_iterator t = predicate->terms.begin(); t != predicate->terms.end(); ++t)
+    {
+        const uint32_t bit = 1u << t->pattern;
+        if (hits & bit) continue;
+        if (term_match(*t, digest, digest_words)) hits |= bit;
+    }
+    return hits;
+}
+
+// That the nibble "k" of the first word of a digest may have the value "v" in the term
+static bool term_nibble_allows(const PredicateTerm& t, const unsigned int k, const unsigned int v)
+{
+    const unsigned int shift = 28 - 4 * k;
+    if ((v & ((t.and_mask[0] >> shift) & 15)) != ((t.cmp[0] >> shift) & 15)) return false;
+    if (((t.digit_mask[0] >> shift) & 8) && (v >= 10)) return false;
+    if (((t.alpha_mask[0] >> shift) & 8) && (v < 10)) return false;
+    for (unsigned int g = t.generic_begin[0]; g < t.generic_begin[1]; ++g)
+    {
+        if ((t.generic_pos[g] == k) && !((t.generic_set[g] >> v) & 1)) return false;
+    }
+    return true;
+}
+
+bool predicate_enumerate(const Predicate* predicate, const uint64_t limit, std::vector<uint32_t>* values)
+{
+    values->clear();
+    if ((predicate->digest_words != 1) || (predicate->targets.count > 0)) return false;
+    for (std::vector<PredicateTerm>::const_iterator t = predicate->terms.begin(); t != predicate->terms.end(); ++t)
+    {
+        uint16_t sets[8];
+        uint64_t count = 1;
+        for (unsigned int k = 0; k < 8; ++k)
+        {
+            sets[k] = 0;
+            for (unsigned int v = 0; v < 16; ++v)
+            {
+                if (term_nibble_allows(*t, k, v)) sets[k] |= (uint16_t)(1 << v);
+            }
+            count *= popcount16(sets[k]);
+        }
+        if (values->size() + count > limit) return false;
+        // every combination of the allowed values, the last nibble changing fastest
+        unsigned int value[8];
+        for (unsigned int k = 0; k < 8; ++k) value[k] = 0;
+        for (uint64_t n = 0; n < count; ++n)
+        {
+            uint32_t digest = 0;
+            for (unsigned int k = 0; k < 8; ++k)
+            {
+                while (!((sets[k] >> value[k]) & 1)) ++value[k];
+                digest |= value[k] << (28 - 4 * k);
+            }
+            values->push_back(digest);
+            for (unsigned int k = 8; k > 0; --k)
+            {
+                do { ++value[k - 1]; } while ((value[k - 1] < 16) && !((sets[k - 1] >> value[k - 1]) & 1));
+                if (value[k - 1] < 16) break;
+                value[k - 1] = 0;
+            }
+        }
+    }
+    std::sort(values->begin(), values->end());
+    values->erase(std::unique(values->begin(), values->end()), values->end());
+    return true;
+}
+
+// A bitmap over the first "Bits" bits of the digest, probed for a vector of lanes with a gather
+#if defined(__AVX512F__)
+template <unsigned int Bits>
+static inline uint32_t gate_gather(const __m512i words, const uint32_t* bitmap)
+{
+    const __m512i top = _mm512_srli_epi32(words, 32 - Bits);
+    const __m512i bitmap_words = _mm512_i32gather_epi32(_mm512_srli_epi32(top, 5), bitmap, 4);
+    const __m512i bit = _mm512_sllv_epi32(_mm512_set1_epi32(1), _mm512_and_si512(top, _mm512_set1_epi32(31)));
+    return _mm512_test_epi32_mask(bitmap_words, bit);
+}
+#elif defined(__AVX2__)
+template <unsigned int Bits>
+static inline uint32_t gate_gather(const __m256i words, const uint32_t* bitmap)
+{
+    const __m256i top = _mm256_srli_epi32(words, 32 - Bits);
+    const __m256i bitmap_words = _mm256_i32gather_epi32((const int*)bitmap, _mm256_srli_epi32(top, 5), 4);
+    const __m256i bit = _mm256_sllv_epi32(_mm256_set1_epi32(1), _mm256_and_si256(top, _mm256_set1_epi32(31)));
+    const __m256i clear = _mm256_cmpeq_epi32(_mm256_and_si256(bitmap_words, bit), _mm256_setzero_si256());
+    return ~(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(clear)) & 0xff;
+}
+#endif
+
+uint32_t predicate_gate_lanes(const Predicate* predicate, const uint32_t first_words[], const unsigned int lanes)
+{
+    const bool patterns = !predicate->terms.empty();
+    const bool targets = predicate->targets.count > 0;
+    uint32_t passed = 0;
+    unsigned int lane = 0;
+#if defined(__AVX512F__)
+    const uint32_t* bitmap = targets ? predicate->targets.bitmap.data() : 0;
+    for (; lane + 16 <= lanes; lane += 16)
+    {
+        const __m512i words = _mm512_loadu_si512((const void*)(first_words + lane));
+        uint32_t pass = 0;
+        if (patterns) pass |= gate_gather<CPredicateGateBits>(words, predicate->gate);
+        if (targets) pass |= gate_gather<CTargetBitmapBits>(words, bitmap);
+        passed |= pass << lane;
+    }
+#elif defined(__AVX2__)
+    const uint32_t* bitmap = targets ? predicate->targets.bitmap.data() : 0;
+    for (; lane + 8 <= lanes; lane += 8)
+    {
+        const __m256i words = _mm256_loadu_si256((const __m256i*)(first_words + lane));
+        uint32_t pass = 0;
+        if (patterns) pass |= gate_gather<CPredicateGateBits>(words, predicate->gate);
+        if (targets) pass |= gate_gather<CTargetBitmapBits>(words, bitmap);
+        passed |= pass << lane;
+    }
+#endif
+    for (; lane < lanes; ++lane)
+    {
+        const uint32_t top = first_words[lane] >> (32 - CPredicateGateBits);
+        const bool pass = (patterns && ((predicate->gate[top >> 5] >> (top & 31)) & 1)) || (targets && targets_bitmap_test(&predicate->targets, first_words[lane]));
+        passed |= (uint32_t)pass << lane;
+    }
+    return passed;
+}
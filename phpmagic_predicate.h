@@ -0,0 +1,86 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Declarative digest predicates.
+
+A predicate is a set of patterns over the hexadecimal nibbles of a digest. Each pattern must match the whole digest, e.g.
+
+    0+e[0-9]*           PHP magic hash: "0e", "00e", "000e"... followed by decimal digits only
+    [0-9]*              a numeric string, all nibbles are decimal digits
+    0{8}[1-9a-f].*      exactly 8 leading zero nibbles
+    deadbeef.*          a fixed hexadecimal prefix
+    .{6}0e[0-9]{12}.*   "0e" at offset 6, e.g. for substr($hash, 6, 14)
+
+Syntax: a hex digit (case-insensitive) matches itself, "." matches any nibble, "[...]" is a class of nibbles with ranges ("[^...]" negates),
+and every atom can be followed by "*", "+", "?", "{n}", "{n,}" or "{n,m}".
+
+At startup every pattern is expanded into a list of terms, one per way of distributing the digest's nibbles among the atoms.
+Each term is compiled into per-word mask/compare tables, and the words are checked from the most selective to the least selective one.
+A bitmap over the top 16 bits of the digest, common for all the patterns, rejects almost every digest with a single load before any term is looked at.
+
+A set of target prefixes (see "phpmagic_targets.h") can be matched besides the patterns, as one more pattern.
+*/
+
+#ifndef PHPMAGIC_PREDICATE_H
+#define PHPMAGIC_PREDICATE_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "phpmagic_targets.h"
+
+const unsigned int CPredicateMaxPatterns = 32;   // the match result is a bitmask of patterns
+const unsigned int CPredicateMaxWords = 8;       // digests of up to 256 bits
+const unsigned int CPredicateMaxNibbles = CPredicateMaxWords * 8;
+const unsigned int CPredicateMaxTerms = 4096;    // per pattern, to reject ambiguous patterns like ".*0.*e.*"
+const unsigned int CPredicateGateBits = 16;
+
+// The classic PHP magic hash, used when no pattern is given
+const char CPredicatePhpMagic[] = "0+e[0-9]*";
+
+// One expanded alternative of a pattern: a fixed set of allowed values for every nibble of the digest
+typedef struct {
+    uint32_t and_mask[CPredicateMaxWords];    // nibbles (or their bits) that have a fixed value ...
+    uint32_t cmp[CPredicateMaxWords];         // ... and that value
+    uint32_t digit_mask[CPredicateMaxWords];  // bit 3 of every nibble that must be 0-9
+    uint32_t alpha_mask[CPredicateMaxWords];  // bit 3 of every nibble that must be a-f
+    uint16_t generic_set[CPredicateMaxNibbles]; // allowed values of the remaining nibbles, one bit per value
+    uint8_t generic_pos[CPredicateMaxNibbles];
+    uint8_t generic_begin[CPredicateMaxWords + 1]; // generic nibbles of the word i are generic_begin[i]..generic_begin[i+1]-1
+    uint8_t order[CPredicateMaxWords];        // words, the most selective first
+    uint8_t pattern;
+} PredicateTerm;
+
+typedef struct {
+    unsigned int digest_nibbles;
+    unsigned int digest_words;
+    std::vector<std::string> patterns;
+    std::vector<PredicateTerm> terms;
+    uint32_t gate[(1 << CPredicateGateBits) / 32];
+    double probability;  // that a random digest matches: the sum over the terms, so an upper bound if patterns overlap
+    TargetSet targets;
+    unsigned int targets_pattern;  // the bit of the targets in the match result
+} Predicate;
+
+// Compiles the patterns (none if only targets are added) for a digest of "digest_nibbles" hexadecimal characters; returns false and fills "error"
+// if a pattern is invalid
+bool predicate_compile(Predicate* predicate, const std::vector<std::string>& patterns, unsigned int digest_nibbles, std::string* error);
+
+// Adds the prefixes of a file as one more pattern, after predicate_compile(); returns false and fills "error" if the file is invalid
+bool predicate_add_targets(Predicate* predicate, const std::string& path, std::string* error);
+
+// The digest is given as big-endian words, the first hexadecimal character is the top nibble of digest[0].
+// Returns the bitmask of the patterns that matched, bit i for predicate->patterns[i]
+uint32_t predicate_match(const Predicate* predicate, const uint32_t digest[]);
+
+// Lists every 32-bit digest (of 8 nibbles) that matches the patterns, sorted, for solvers that go from the digest to the message;
+// returns false if there are more than "limit" of them, or the digests are longer, or there are targets
+bool predicate_enumerate(const Predicate* predicate, const uint64_t limit, std::vector<uint32_t>* values);
+
+// The first-level check of the patterns and the targets for "lanes" digests at once, given their first words: the bitmask of the lanes
+// that may match; predicate_match() is only needed for these
+uint32_t predicate_gate_lanes(const Predicate* predicate, const uint32_t first_words[], const unsigned int lanes);
+
+#endif
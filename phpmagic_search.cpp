@@ -0,0 +1,762 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+The search library, see "phpmagic_search.h".
+*/
+
+#include <string.h>
+#include <string>
+#include <vector>
+#include <new>
+#include "phpmagic_search.h"
+#include "phpmagic_layout.h"
+#include "phpmagic_jit.h"
+#include "phpmagic_checksum.h"
+#include "phpmagic_opencl.h"
+#include "phpmagic_token.h"
+
+struct phpmagic_config {
+    HashChain chain;
+    Predicate predicate;
+    bool sampling;
+    Predicate sample;      // the near-miss pattern, counted besides the patterns
+    HmacMode hmac;
+    std::string hash_name;
+    std::string charset;
+    bool tokenized;
+    TokenFormat token;     // the candidates instead of the character set
+    unsigned int length;
+    std::string base;
+    std::string salt_prefix;
+    std::string salt_suffix;
+    std::string hmac_key;
+    std::string hmac_message;
+    bool multibuffer;
+    uint64_t keyspace;
+    MessageLayout layout;  // with the base, copied by every search
+    bool jit_requested;
+    JitKernel jit;         // compiled for the layout, if requested and possible
+    std::string jit_error;
+    std::string engine_name;
+    ChecksumAlgorithm checksum;  // one of PHP's non-cryptographic algorithms instead of the chain
+    ChecksumSearch checksum_search;
+    OpenclEngine* opencl;        // SHA-1 on an OpenCL device; the CPU engines stay configured for a device error
+};
+
+static void set_error(const std::string& text, char* error, const size_t error_size)
+{
+    if (error && (error_size > 0))
+    {
+        const size_t len = (text.length() < error_size - 1) ? text.length() : error_size - 1;
+        memcpy(error, text.data(), len);
+        error[len] = 0;
+    }
+}
+
+// The layout of the message with the base followed by the candidate after the salt prefix; for HMAC, the K ^ ipad block goes
+// before the message, either constant or with the base and the candidate as the key
+static bool config_layout(phpmagic_config* config, std::string* error)
+{
+    std::string layout_prefix = config->salt_prefix + config->base;
+    std::string layout_suffix = config->salt_suffix;
+    if (config->base.length() + config->length > PHPMAGIC_MAX_MESSAGE)
+    {
+        *error = "the base and the candidate are longer than " + std::to_string(PHPMAGIC_MAX_MESSAGE) + " characters";
+        return false;
+    }
+    if (config->checksum != checksum_none)
+    {
+        if (!checksum_prepare(&config->checksum_search, config->checksum, config->multibuffer, layout_prefix, config->charset, config->length,
+            layout_suffix, &config->predicate, error))
+        {
+            return false;
+        }
+        config->engine_name = std::string(config->multibuffer ? "multi-buffer " : "single-buffer ") + checksum_name(config->checksum)
+            + (config->checksum_search.solver ? " with the algebraic solver" : "");
+        if (config->jit_requested)
+        {
+            config->engine_name += " (no JIT: SHA-1 and MD5 only)";
+        }
+        return true;
+    }
+    if (config->hmac == hmac_fixed_key)
+    {
+        std::string ipad_block = hmac_key_block(config->chain.algorithm[0], config->hmac_key);
+        for (std::string::size_type i = 0; i < ipad_block.length(); ++i)
+        {
+            ipad_block[i] ^= 0x36;
+        }
+        layout_prefix = ipad_block + layout_prefix;
+    }
+    else if (config->hmac == hmac_varying_key)
+    {
+        if (config->base.length() + config->length > 64)
+        {
+            *error = "with the candidate as the HMAC key, the key must fit in 64 bytes";
+            return false;
+        }
+        layout_suffix = std::string(64 - config->base.length() - config->length, '\0') + config->hmac_message;
+    }
+    if (!layout_init(&config->layout, config->chain.algorithm[0], layout_prefix, config->length, layout_suffix, error))
+    {
+        return false;
+    }
+    if (config->hmac == hmac_varying_key)
+    {
+        layout_set_hmac_key(&config->layout);
+    }
+    // the constant words of the layout are folded into the kernel, so a new base needs a new kernel; without one, the static engine runs
+    config->jit_error.clear();
+    if (config->jit_requested)
+    {
+        jit_compile(&config->jit, &config->layout, config->multibuffer, &config->jit_error);
+    }
+    config->engine_name = config->jit.kernel ? jit_target_name(config->jit.target) : (config->multibuffer ? "multi-buffer" : "single-buffer");
+    if (!config->jit_error.empty())
+    {
+        config->engine_name += " (no JIT: " + config->jit_error + ")";
+    }
+    if (config->opencl)
+    {
+        if (!opencl_set_message(config->opencl, config->salt_prefix + config->base, config->salt_suffix, error))
+        {
+            return false;
+        }
+        config->engine_name = std::string("OpenCL (") + opencl_device_name(config->opencl) + ")";
+    }
+    return true;
+}
+
+phpmagic_config* phpmagic_config_new(const phpmagic_options* options, char* error, size_t error_size)
+{
+    phpmagic_config* config = new (std::nothrow) phpmagic_config;
+    if (!config)
+    {
+        set_error("out of memory", error, error_size);
+        return 0;
+    }
+    std::string text;
+    jit_init(&config->jit);
+    config->opencl = 0;
+    config->jit_requested = options->jit != 0;
+    config->charset = options->charset ? options->charset : "";
+    config->length = options->length;
+    config->tokenized = options->token != 0;
+    config->base = options->base ? options->base : "";
+    config->salt_prefix = options->salt_prefix ? options->salt_prefix : "";
+    config->salt_suffix = options->salt_suffix ? options->salt_suffix : "";
+    config->hmac_key = options->hmac_key ? options->hmac_key : "";
+    config->hmac_message = options->hmac_message ? options->hmac_message : "";
+    config->hmac = options->hmac_key ? hmac_fixed_key : (options->hmac_message ? hmac_varying_key : hmac_none);
+    // the SHA CPU instructions hash one message faster than 4 SSE lanes, but not faster than 8 AVX2 or 16 AVX-512 lanes
+#ifdef USE_SHA_CPU_EXTENSIONS
+    config->multibuffer = (options->engine == PHPMAGIC_ENGINE_MULTIBUFFER) || ((options->engine == PHPMAGIC_ENGINE_AUTO) && (CMbLanes >= 8));
+#else
+    config->multibuffer = options->engine != PHPMAGIC_ENGINE_SINGLE;
+#endif
+    if (options->engine == PHPMAGIC_ENGINE_OPENCL)
+    {
+        config->multibuffer = true;
+    }
+
+    bool valid = true;
+    if (config->tokenized)
+    {
+        if (!token_parse(options->token, &config->token, &text))
+        {
+            valid = false;
+        }
+        else if (config->token.text.length() > PHPMAGIC_MAX_CANDIDATE)
+        {
+            text = "the token has more than " + std::to_string(PHPMAGIC_MAX_CANDIDATE) + " characters";
+            valid = false;
+        }
+        config->length = (unsigned int)config->token.text.length();
+    }
+    else if (config->charset.empty() || (config->charset.length() > 256) || (config->length > PHPMAGIC_MAX_CANDIDATE))
+    {
+        text = "the candidate needs a character set and at most " + std::to_string(PHPMAGIC_MAX_CANDIDATE) + " characters";
+        valid = false;
+    }
+    // PHP's non-cryptographic algorithms are searched by their own engines, without a chain
+    config->checksum = checksum_parse(options->hash ? options->hash : "");
+    if (config->checksum != checksum_none)
+    {
+        config->chain.depth = 0;
+        if (config->hmac != hmac_none)
+        {
+            text = "HMAC is not supported with " + std::string(checksum_name(config->checksum));
+            valid = false;
+        }
+    }
+    else if (valid && !chain_parse(options->hash ? options->hash : "sha1", &config->chain, &text))
+    {
+        text = "invalid hash: " + text;
+        valid = false;
+    }
+    if (valid && (config->hmac != hmac_none))
+    {
+        if (options->hmac_key && options->hmac_message)
+        {
+            text = "either the HMAC key or the HMAC message is given, not both";
+            valid = false;
+        }
+        else if ((config->hmac == hmac_varying_key) && (!config->salt_prefix.empty() || !config->salt_suffix.empty()))
+        {
+            text = "with the candidate as the HMAC key, there are no salts";
+            valid = false;
+        }
+        else if (!chain_set_hmac(&config->chain, config->hmac, config->hmac_key, &text))
+        {
+            text = "invalid HMAC: " + text;
+            valid = false;
+        }
+    }
+    if (valid)
+    {
+        std::vector<std::string> patterns;
+        for (unsigned int i = 0; i < options->pattern_count; ++i)
+        {
+            patterns.push_back(options->patterns[i]);
+        }
+        if (patterns.empty() && !options->targets)
+        {
+            patterns.push_back(CPredicatePhpMagic);
+        }
+        const unsigned int digest_nibbles = (config->checksum != checksum_none) ? checksum_digest_nibbles(config->checksum) : chain_digest_nibbles(&config->chain);
+        if (!predicate_compile(&config->predicate, patterns, digest_nibbles, &text))
+        {
+            text = "invalid pattern: " + text;
+            valid = false;
+        }
+        else if (options->targets && !predicate_add_targets(&config->predicate, options->targets, &text))
+        {
+            text = "invalid targets: " + text;
+            valid = false;
+        }
+    }
+    // the checksum and OpenCL engines generate the candidates of a character set themselves
+    if (valid && config->tokenized && ((config->checksum != checksum_none) || (options->engine == PHPMAGIC_ENGINE_OPENCL)))
+    {
+        text = "the token needs a CPU engine of SHA-1 or MD5";
+        valid = false;
+    }
+    config->sampling = options->sample != 0;
+    if (valid && config->sampling)
+    {
+        // the samples are taken in the loop of the chain engines
+        if ((config->checksum != checksum_none) || (options->engine == PHPMAGIC_ENGINE_OPENCL))
+        {
+            text = "the sample pattern needs a CPU engine of SHA-1 or MD5";
+            valid = false;
+        }
+        else if (!predicate_compile(&config->sample, std::vector<std::string>(1, options->sample), config->predicate.digest_nibbles, &text))
+        {
+            text = "invalid sample pattern: " + text;
+            valid = false;
+        }
+    }
+    if (valid && (options->engine == PHPMAGIC_ENGINE_OPENCL))
+    {
+        if ((config->checksum != checksum_none) || (config->chain.depth != 1) || (config->chain.algorithm[0] != hash_sha1) || (config->hmac != hmac_none))
+        {
+            text = "the OpenCL engine hashes SHA-1 without chains or HMAC";
+            valid = false;
+        }
+        else if (!(config->opencl = opencl_create(&config->predicate, config->charset, config->length, options->opencl_device, &text)))
+        {
+            text = "OpenCL: " + text;
+            valid = false;
+        }
+    }
+    if (valid && !config_layout(config, &text))
+    {
+        valid = false;
+    }
+    if (!valid)
+    {
+        set_error(text, error, error_size);
+        phpmagic_config_free(config);
+        return 0;
+    }
+    config->hash_name = (config->checksum != checksum_none) ? checksum_name(config->checksum) : chain_name(&config->chain);
+    config->keyspace = 1;
+    for (unsigned int i = 0; !config->tokenized && (i < config->length); ++i)
+    {
+        const uint64_t radix = config->charset.length();
+        config->keyspace = (config->keyspace > UINT64_MAX / radix) ? UINT64_MAX : config->keyspace * radix;
+    }
+    if (config->tokenized)
+    {
+        config->keyspace = config->token.keyspace;
+    }
+    return config;
+}
+
+void phpmagic_config_free(phpmagic_config* config)
+{
+    jit_free(&config->jit);
+    opencl_free(config->opencl);
+    delete config;
+}
+
+int phpmagic_config_set_base(phpmagic_config* config, const char* base, char* error, size_t error_size)
+{
+    config->base = base ? base : "";
+    std::string text;
+    if (!config_layout(config, &text))
+    {
+        set_error(text, error, error_size);
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t phpmagic_keyspace(const phpmagic_config* config)
+{
+    return config->keyspace;
+}
+
+unsigned int phpmagic_lanes(const phpmagic_config* config)
+{
+    if (config->opencl) return COpenclBatch;
+    return config->multibuffer ? CMbLanes : 1;
+}
+
+const char* phpmagic_hash_name(const phpmagic_config* config)
+{
+    return config->hash_name.c_str();
+}
+
+const char* phpmagic_engine_name(const phpmagic_config* config)
+{
+    return config->engine_name.c_str();
+}
+
+unsigned int phpmagic_digest_nibbles(const phpmagic_config* config)
+{
+    return config->predicate.digest_nibbles;
+}
+
+const char* phpmagic_pattern(const phpmagic_config* config, unsigned int pattern)
+{
+    return (pattern < config->predicate.patterns.size()) ? config->predicate.patterns[pattern].c_str() : 0;
+}
+
+double phpmagic_hit_probability(const phpmagic_config* config)
+{
+    return config->predicate.probability;
+}
+
+double phpmagic_sample_probability(const phpmagic_config* config)
+{
+    return config->sampling ? config->sample.probability : 0;
+}
+
+const HashChain* phpmagic_config_chain(const phpmagic_config* config)
+{
+    return &config->chain;
+}
+
+const Predicate* phpmagic_config_predicate(const phpmagic_config* config)
+{
+    return &config->predicate;
+}
+
+// The digits of the index in the radix of the character set, the last one changing fastest
+static void index_digits(const phpmagic_config* config, uint64_t index, unsigned int digits[PHPMAGIC_MAX_CANDIDATE])
+{
+    const uint64_t radix = config->charset.length();
+    for (unsigned int i = config->length; i > 0; --i)
+    {
+        digits[i - 1] = (unsigned int)(index % radix);
+        index /= radix;
+    }
+}
+
+void phpmagic_message(const phpmagic_config* config, uint64_t index, char message[PHPMAGIC_MAX_MESSAGE + 1])
+{
+    memcpy(message, config->base.data(), config->base.length());
+    message[config->base.length() + config->length] = 0;
+    if (config->tokenized)
+    {
+        TokenCounter counter;
+        token_set(&config->token, index, &counter, (unsigned char*)message + config->base.length());
+        return;
+    }
+    unsigned int digits[PHPMAGIC_MAX_CANDIDATE];
+    index_digits(config, index, digits);
+    for (unsigned int i = 0; i < config->length; ++i)
+    {
+        message[config->base.length() + i] = config->charset[digits[i]];
+    }
+}
+
+// The lanes of a batch are stored word-major, CMbLanes lanes per word
+
+const unsigned int CCachedRows = 10;
+
+// Hashes the image blocks before the one with the last candidate byte, for the cache of their states (rows 0-4), and the rounds of the next
+// block that a JIT kernel starts after (rows 5-9)
+template <typename V>
+static void hash_cached_blocks(const MessageLayout* layout, const uint32_t message[][CMbLanes], uint32_t midstate[CCachedRows][CMbLanes], const unsigned int first_round)
+{
+    V state[5];
+    for (unsigned int i = 0; i < 5; ++i)
+    {
+        state[i] = V() + layout->midstate[i];
+    }
+    for (unsigned int b = 0; b < layout->cached_blocks; ++b)
+    {
+        V block[16];
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            block[i] = mb_load<V>(&message[16 * b + i][0]);
+        }
+        chain_compress(layout->algorithm, state, block);
+    }
+    for (unsigned int i = 0; i < 5; ++i)
+    {
+        mb_store(&midstate[i][0], state[i]);
+    }
+    if (first_round > 0)
+    {
+        V block[16];
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            block[i] = mb_load<V>(&message[16 * layout->cached_blocks + i][0]);
+        }
+        sha1_rounds_mb(state, block, first_round);
+        for (unsigned int i = 0; i < 5; ++i)
+        {
+            mb_store(&midstate[5 + i][0], state[i]);
+        }
+    }
+}
+
+// Hashes the rest of the image from the cached states and the result through the chain
+template <typename V>
+static void hash_batch(const HashChain* chain, const MessageLayout* layout, const JitKernel* jit, const uint32_t message[][CMbLanes],
+    const uint32_t midstate[CCachedRows][CMbLanes], uint32_t digest[CChainMaxDigestWords][CMbLanes])
+{
+    V state[5];
+    V result[CChainMaxDigestWords];
+    if (jit->kernel)
+    {
+        alignas(64) uint32_t lane_state[5][CMbLanes];
+        jit->kernel(&message[0][0], &midstate[0][0], &lane_state[0][0]);
+        for (unsigned int i = 0; i < 5; ++i)
+        {
+            state[i] = mb_load<V>(&lane_state[i][0]);
+        }
+    }
+    else
+    {
+        for (unsigned int i = 0; i < 5; ++i)
+        {
+            state[i] = mb_load<V>(&midstate[i][0]);
+        }
+        for (unsigned int b = layout->cached_blocks; b < layout->image_blocks; ++b)
+        {
+            V block[16];
+            for (unsigned int i = 0; i < 16; ++i)
+            {
+                block[i] = mb_load<V>(&message[16 * b + i][0]);
+            }
+            chain_compress(layout->algorithm, state, block);
+        }
+    }
+    if (chain->hmac == hmac_varying_key)
+    {
+        V key_block[16];
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            key_block[i] = mb_load<V>(&message[i][0]);
+        }
+        chain_finish(chain, state, result, key_block);
+    }
+    else
+    {
+        chain_finish(chain, state, result);
+    }
+    for (unsigned int i = 0; i < CChainMaxDigestWords; ++i)
+    {
+        mb_store(&digest[i][0], result[i]);
+    }
+}
+
+// Re-verifies a hit with the byte-oriented reference implementation, so a broken engine cannot report false solutions
+static bool verify_hit(const phpmagic_config* config, const phpmagic_hit* hit)
+{
+    uint32_t reference[CChainMaxDigestWords];
+    const std::string message(hit->message);
+    const std::string salted = config->salt_prefix + message + config->salt_suffix;
+    if (config->checksum != checksum_none)
+        checksum_reference(config->checksum, (const unsigned char*)salted.data(), salted.length(), reference);
+    else if (config->hmac == hmac_fixed_key)
+        hmac_reference(config->chain.algorithm[0], config->hmac_key, salted, reference);
+    else if (config->hmac == hmac_varying_key)
+        hmac_reference(config->chain.algorithm[0], message, config->hmac_message, reference);
+    else
+        chain_reference(&config->chain, (const unsigned char*)salted.data(), (uint32_t)salted.length(), reference);
+    return memcmp(reference, hit->digest, config->predicate.digest_nibbles / 2) == 0;
+}
+
+int phpmagic_check_hit(const phpmagic_config* config, const phpmagic_hit* hit)
+{
+    return verify_hit(config, hit) ? 1 : 0;
+}
+
+const unsigned int CChecksumMaxHits = 64;
+
+// The non-cryptographic algorithms: their hits are converted and re-verified like those of the chains
+static int search_checksum(const phpmagic_config* config, const uint64_t start_index, const uint64_t count, phpmagic_results* results)
+{
+    ChecksumHit hits[CChecksumMaxHits];
+    uint64_t done = 0;
+    while (done < count)
+    {
+        const unsigned int room = results->capacity - results->count;
+        unsigned int found;
+        uint64_t hashed;
+        checksum_search(&config->checksum_search, &config->predicate, start_index + done, count - done, hits,
+            (room < CChecksumMaxHits) ? room : CChecksumMaxHits, &found, &hashed);
+        for (unsigned int i = 0; i < found; ++i)
+        {
+            phpmagic_hit* hit = &(results->hits[results->count]);
+            hit->index = hits[i].index;
+            phpmagic_message(config, hit->index, hit->message);
+            memset(hit->digest, 0, sizeof(hit->digest));
+            hit->digest[0] = hits[i].digest[0];
+            hit->digest[1] = hits[i].digest[1];
+            hit->patterns = hits[i].patterns;
+            if (!verify_hit(config, hit))
+            {
+                results->hashes = hit->index - start_index;
+                return -1;
+            }
+            ++results->count;
+        }
+        done += hashed;
+        if ((done < count) && (results->count == results->capacity))
+        {
+            // the caller resumes from the hit that did not fit
+            break;
+        }
+    }
+    results->hashes = done;
+    return 0;
+}
+
+// The OpenCL engine: the candidates that passed the device check are hashed again with the reference implementation and checked against
+// the full patterns; false on a device error, and the range is then searched on the CPU
+static bool search_opencl(const phpmagic_config* config, const uint64_t start_index, const uint64_t count, phpmagic_results* results)
+{
+    std::vector<uint64_t> indexes;
+    uint64_t searched;
+    std::string text;
+    if (!opencl_search(config->opencl, start_index, count, results->capacity - results->count + 1, &indexes, &searched, &text))
+    {
+        return false;
+    }
+    for (std::vector<uint64_t>::const_iterator index = indexes.begin(); index != indexes.end(); ++index)
+    {
+        char message[PHPMAGIC_MAX_MESSAGE + 1];
+        phpmagic_message(config, *index, message);
+        const std::string salted = config->salt_prefix + message + config->salt_suffix;
+        uint32_t digest[CChainMaxDigestWords];
+        chain_reference(&config->chain, (const unsigned char*)salted.data(), (uint32_t)salted.length(), digest);
+        const uint32_t matched = predicate_match(&config->predicate, digest);
+        if (!matched) continue;
+        if (results->count == results->capacity)
+        {
+            results->hashes = *index - start_index;
+            return true;
+        }
+        phpmagic_hit* hit = &(results->hits[results->count]);
+        hit->index = *index;
+        memcpy(hit->message, message, sizeof(message));
+        memcpy(hit->digest, digest, sizeof(hit->digest));
+        hit->patterns = matched;
+        ++results->count;
+    }
+    results->hashes = searched;
+    return true;
+}
+
+int phpmagic_search_range(const phpmagic_config* config, uint64_t start_index, uint64_t count, phpmagic_results* results)
+{
+    results->count = 0;
+    results->hashes = 0;
+    results->samples = 0;
+    if (start_index >= config->keyspace)
+    {
+        return 0;
+    }
+    if (count > config->keyspace - start_index)
+    {
+        count = config->keyspace - start_index;
+    }
+    if (config->checksum != checksum_none)
+    {
+        return search_checksum(config, start_index, count, results);
+    }
+    if (config->opencl && search_opencl(config, start_index, count, results))
+    {
+        return 0;
+    }
+
+    // the layout is copied, so the candidate can be counted right in its image
+    MessageLayout layout = config->layout;
+    const HashChain* chain = &config->chain;
+    const JitKernel* jit = &config->jit;
+    const unsigned int length = config->length;
+    const char* charset = config->charset.data();
+    const unsigned int radix = (unsigned int)config->charset.length();
+    unsigned char* candidate = &(layout.image[layout.candidate_offset]);
+    const bool big_endian = layout.big_endian;
+    const unsigned int lanes = config->multibuffer ? CMbLanes : 1;
+    const unsigned int cached_words = 16 * layout.cached_blocks;
+    const bool tokenized = config->tokenized;
+    TokenCounter token_counter;
+    unsigned int digits[PHPMAGIC_MAX_CANDIDATE];
+    if (tokenized)
+    {
+        // the separators of the token stay in the image, only its fields are rewritten
+        token_set(&config->token, start_index, &token_counter, candidate);
+    }
+    else
+    {
+        index_digits(config, start_index, digits);
+        for (unsigned int i = 0; i < length; ++i)
+        {
+            candidate[i] = (unsigned char)charset[digits[i]];
+        }
+    }
+
+    // the words that hold candidate bytes are reloaded for each message, the rest are constant
+    alignas(64) uint32_t lane_message[CLayoutMaxWords][CMbLanes];
+    alignas(64) uint32_t lane_midstate[CCachedRows][CMbLanes];
+    alignas(64) uint32_t lane_digest[CChainMaxDigestWords][CMbLanes];
+    uint32_t cache_key[CLayoutMaxWords];
+    bool cache_valid = false;
+    for (unsigned int i = 0; i < 16 * layout.image_blocks; ++i)
+    {
+        for (unsigned int lane = 0; lane < CMbLanes; ++lane)
+        {
+            lane_message[i][lane] = layout.words[i];
+        }
+    }
+
+    uint64_t done = 0;
+    while (done < count)
+    {
+        const unsigned int filled = (count - done < lanes) ? (unsigned int)(count - done) : lanes;
+        for (unsigned int lane = 0; lane < filled; ++lane)
+        {
+            for (unsigned int i = layout.first_word; i <= layout.last_word; ++i)
+            {
+                lane_message[i][lane] = layout_load_word(&(layout.image[4 * i]), big_endian) ^ layout.candidate_xor;
+            }
+            // the next candidate, counted in place
+            if (tokenized)
+            {
+                token_next(&config->token, &token_counter, candidate);
+                continue;
+            }
+            for (unsigned int i = length; i > 0; --i)
+            {
+                if (++digits[i - 1] < radix)
+                {
+                    candidate[i - 1] = (unsigned char)charset[digits[i - 1]];
+                    break;
+                }
+                digits[i - 1] = 0;
+                candidate[i - 1] = (unsigned char)charset[0];
+            }
+        }
+
+        // the cached states are still valid if no lane changed the candidate bytes of the cached blocks
+        bool cache_hit = cache_valid;
+        for (unsigned int i = layout.first_word; cache_hit && (i < cached_words); ++i)
+        {
+            for (unsigned int lane = 0; lane < filled; ++lane)
+            {
+                cache_hit = cache_hit && (lane_message[i][lane] == cache_key[i]);
+            }
+        }
+        if (!cache_hit)
+        {
+            if (config->multibuffer)
+                hash_cached_blocks<mb_u32>(&layout, lane_message, lane_midstate, jit->first_round);
+            else
+                hash_cached_blocks<uint32_t>(&layout, lane_message, lane_midstate, jit->first_round);
+        }
+
+        if (config->multibuffer)
+            hash_batch<mb_u32>(chain, &layout, jit, lane_message, lane_midstate, lane_digest);
+        else
+            hash_batch<uint32_t>(chain, &layout, jit, lane_message, lane_midstate, lane_digest);
+
+        if (!cache_hit)
+        {
+            // the lanes could differ if a carry happened within the batch, the next batch continues from the last lane
+            for (unsigned int i = 0; i < CCachedRows; ++i)
+            {
+                for (unsigned int lane = 0; lane < CMbLanes; ++lane)
+                {
+                    lane_midstate[i][lane] = lane_midstate[i][filled - 1];
+                }
+            }
+            for (unsigned int i = layout.first_word; i < cached_words; ++i)
+            {
+                cache_key[i] = lane_message[i][filled - 1];
+            }
+            cache_valid = true;
+        }
+
+        // the first-level check of all the lanes at once, most batches end here
+        const uint32_t gate = predicate_gate_lanes(&config->predicate, lane_digest[0], filled);
+        const uint32_t sample_gate = config->sampling ? predicate_gate_lanes(&config->sample, lane_digest[0], filled) : 0;
+        for (unsigned int lane = 0; (gate | sample_gate) && (lane < filled); ++lane)
+        {
+            if (!(((gate | sample_gate) >> lane) & 1)) continue;
+            uint32_t digest[CChainMaxDigestWords];
+            for (unsigned int i = 0; i < CChainMaxDigestWords; ++i)
+            {
+                digest[i] = lane_digest[i][lane];
+            }
+            const uint32_t matched = ((gate >> lane) & 1) ? predicate_match(&config->predicate, digest) : 0;
+            if (matched && (results->count == results->capacity))
+            {
+                // the caller resumes from this candidate
+                results->hashes = done + lane;
+                return 0;
+            }
+            if (((sample_gate >> lane) & 1) && predicate_match(&config->sample, digest) && (results->samples++ == 0))
+            {
+                results->sample.index = start_index + done + lane;
+                phpmagic_message(config, results->sample.index, results->sample.message);
+                memcpy(results->sample.digest, digest, sizeof(results->sample.digest));
+                results->sample.patterns = 0;
+            }
+            if (!matched) continue;
+            phpmagic_hit* hit = &(results->hits[results->count]);
+            hit->index = start_index + done + lane;
+            phpmagic_message(config, hit->index, hit->message);
+            memcpy(hit->digest, digest, sizeof(hit->digest));
+            hit->patterns = matched;
+            if (!verify_hit(config, hit))
+            {
+                results->hashes = done + lane;
+                return -1;
+            }
+            ++results->count;
+        }
+        done += filled;
+    }
+    results->hashes = done;
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+The search engine as a library with a C API (libphpmagic.a and libphpmagic.so); the Open MPI application is a driver on top of it.
+
+A search is configured once: the hash, the digest patterns, the character set and the length of the candidate, the constant base before it,
+the salts and HMAC. Then any range of the keyspace can be searched. The candidate with index i is the i-th string of "length" characters
+of the character set, in the order of the set, the last character changing fastest; or, with a structured token, the i-th of its range,
+see "phpmagic_token.h".
+
+phpmagic_search_range() does no I/O and no allocation in its loop. The message layout of the configuration is copied to the stack, the candidate
+is counted in place, and only a hit is re-verified with the reference implementation before it is stored in the caller's buffer.
+A configuration can be searched from several threads at once.
+*/
+
+#ifndef PHPMAGIC_SEARCH_H
+#define PHPMAGIC_SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PHPMAGIC_MAX_CANDIDATE 64  /* characters of the candidate */
+#define PHPMAGIC_MAX_MESSAGE 256   /* characters of the base and the candidate */
+
+enum { PHPMAGIC_ENGINE_AUTO, PHPMAGIC_ENGINE_SINGLE, PHPMAGIC_ENGINE_MULTIBUFFER, PHPMAGIC_ENGINE_OPENCL };
+
+typedef struct {
+    const char* hash;                 /* "sha1" if NULL, "md5", "md5(sha1($x))", etc. */
+    const char* const* patterns;      /* the digest patterns; the PHP magic hash pattern if there are none and no targets */
+    unsigned int pattern_count;
+    const char* charset;              /* the characters of the candidate in their order, e.g. "0123456789" */
+    unsigned int length;              /* of the candidate */
+    const char* base;                 /* the constant text before the candidate, may be NULL */
+    const char* salt_prefix;          /* may be NULL */
+    const char* salt_suffix;          /* may be NULL */
+    const char* hmac_key;             /* hash_hmac(hash, $x, hmac_key) if not NULL */
+    const char* hmac_message;         /* hash_hmac(hash, hmac_message, $x) if not NULL */
+    int engine;                       /* PHPMAGIC_ENGINE_... */
+    int jit;                          /* non-zero to compile a SHA-1 kernel for the configuration at run time (x86-64), see "phpmagic_jit.h" */
+    const char* targets;              /* a file of hexadecimal digest prefixes, one per line, matched besides the patterns; may be NULL */
+    unsigned int opencl_device;       /* with PHPMAGIC_ENGINE_OPENCL, the device counted over all the platforms, see "phpmagic_opencl.h" */
+    const char* sample;               /* a weak pattern, e.g. "0e[0-9][0-9].*", whose matches are counted and sampled besides the hits, to check
+                                         an engine against its expected rate of them; may be NULL. Not with the OpenCL engine or PHP's
+                                         non-cryptographic algorithms */
+    const char* token;                /* a structured token of one fixed width, e.g. "uniqid:1700000000-1700000059", instead of the character
+                                         set and the length; may be NULL. See "phpmagic_token.h", and token_split() for the parts of a range
+                                         of integers. Not with the OpenCL engine or PHP's non-cryptographic algorithms */
+} phpmagic_options;
+
+typedef struct {
+    uint64_t index;                        /* of the candidate in the keyspace */
+    char message[PHPMAGIC_MAX_MESSAGE + 1]; /* the base and the candidate, zero-terminated; the salts are not included */
+    uint32_t digest[5];                    /* big-endian words */
+    uint32_t patterns;                     /* the bit mask of the matched patterns */
+} phpmagic_hit;
+
+typedef struct {
+    phpmagic_hit* hits;               /* the caller's buffer */
+    unsigned int capacity;
+    unsigned int count;               /* the hits stored */
+    uint64_t hashes;                  /* the candidates hashed: fewer than requested if the buffer filled up or the keyspace ended */
+    uint64_t samples;                 /* of those, the ones matching the sample pattern ... */
+    phpmagic_hit sample;              /* ... and the first of them, not re-verified */
+} phpmagic_results;
+
+typedef struct phpmagic_config phpmagic_config;
+
+/* Returns NULL and the reason in "error" if the options are invalid */
+phpmagic_config* phpmagic_config_new(const phpmagic_options* options, char* error, size_t error_size);
+void phpmagic_config_free(phpmagic_config* config);
+
+/* Replaces the base, e.g. for each word of a wordlist; returns 0, or -1 and the reason in "error" */
+int phpmagic_config_set_base(phpmagic_config* config, const char* base, char* error, size_t error_size);
+
+/* The number of candidates, UINT64_MAX if there are more */
+uint64_t phpmagic_keyspace(const phpmagic_config* config);
+/* The messages hashed at once by the engine */
+unsigned int phpmagic_lanes(const phpmagic_config* config);
+/* E.g. "md5(sha1($x))" */
+const char* phpmagic_hash_name(const phpmagic_config* config);
+unsigned int phpmagic_digest_nibbles(const phpmagic_config* config);
+/* E.g. "multi-buffer" or "JIT AVX-512", with the reason if the JIT was requested but the static engine runs */
+const char* phpmagic_engine_name(const phpmagic_config* config);
+const char* phpmagic_pattern(const phpmagic_config* config, unsigned int pattern);
+/* That a candidate is a hit, from the patterns: e.g. for the expected number of hits in a keyspace */
+double phpmagic_hit_probability(const phpmagic_config* config);
+/* That a candidate matches the sample pattern, 0 without one */
+double phpmagic_sample_probability(const phpmagic_config* config);
+/* Returns 1 if the digest of the hit is that of its message by the reference implementation, e.g. for a sample found by another process */
+int phpmagic_check_hit(const phpmagic_config* config, const phpmagic_hit* hit);
+/* The base and the candidate with the given index, zero-terminated */
+void phpmagic_message(const phpmagic_config* config, uint64_t index, char message[PHPMAGIC_MAX_MESSAGE + 1]);
+
+/* Searches the candidates from "start_index" on, at most "count" of them, until a hit does not fit in the buffer ("hashes" then stops at it);
+   returns 0, or -1 if the engine disagreed with the reference implementation (a broken build or hardware), then the hit in question
+   is left after the stored ones */
+int phpmagic_search_range(const phpmagic_config* config, uint64_t start_index, uint64_t count, phpmagic_results* results);
+
+#ifdef __cplusplus
+}
+
+#include "phpmagic_chain.h"
+#include "phpmagic_predicate.h"
+
+/* For the other tools of this application, such as the verification of files */
+const HashChain* phpmagic_config_chain(const phpmagic_config* config);
+const Predicate* phpmagic_config_predicate(const phpmagic_config* config);
+#endif
+
+#endif
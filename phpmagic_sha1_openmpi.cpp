@@ -53,12 +53,27 @@ Taken from the "clibs" GitHub page at <https://github.com/clibs/sha1>
 #include <mpi.h>
 #endif
 #include <string>
+#include <vector>
 #include <iostream>
 #include <chrono>
-
-// We currently support only SHA-1 hash with a digest size of 20 bytes
-#include "sha1.h"
-const unsigned int CDigestLength = 20;
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// The search engine, see "phpmagic_search.h"; SHA-1, MD5 and their chains such as md5(sha1($x)), and PHP's non-cryptographic algorithms,
+// see the "--hash" option
+#include "phpmagic_search.h"
+#include "phpmagic_verify.h"
+#include "phpmagic_wordlist.h"
+#include "phpmagic_daemon.h"
+#include "phpmagic_tolerant.h"
+#include "phpmagic_tune.h"
+#include "phpmagic_sweep.h"
+#include "phpmagic_node.h"
+#include "phpmagic_smt.h"
+#include "phpmagic_shard.h"
+#include "phpmagic_validate.h"
+#include "phpmagic_token.h"
 
 
 // CONFIGURATION SECTION #################################################################################################################################
@@ -72,12 +87,9 @@ const unsigned int CDigestLength = 20;
 #define mixcase_digits_punct
 
 // *******************************************************************************************************************************************************
-// Define the "stepover_run" for a slower mode when all the processors start from the same base plus the current processor number 
-// and increment by the total number of processors on each steps. However, it does not require to have a prefix with the 
-// current processor number in the middle of the message.
-// If you would not define the "stepover_run", each process will start from it's own base and will increment by just one; however
-// if the message is short, the incremented value may overflow the processors's number prefix, so all the processors witll be
-// calculating the same data
+// Define the "stepover_run" for a mode when all the processors start from the same base: the keyspace is taken in chunks, and each processor
+// takes every N-th chunk, where N is the total number of processors, so the first messages are searched by all the processors together.
+// If you would not define the "stepover_run", the keyspace is split into equal contiguous ranges, one per processor.
 //#define stepover_run
 
 // The lenght of the message to be hashed ***************************************************************************************************************
@@ -90,347 +102,229 @@ const unsigned int CMessageLen = 16;
 
 
 
+// The characters of the message in the order they are counted, and the constant base of the message before them
+
 #ifdef digits_only
-const unsigned char CInitialChar = '0';
+const char CCharset[] = "0123456789";
+const char CBase[] = "1";
 #endif
 
 #ifdef lowercase_only
-const unsigned char CInitialChar = 'a';
+const char CCharset[] = "abcdefghijklmnopqrstuvwxyz";
+const char CBase[] = "lowercase";
 #endif
 
 #ifdef uppercase_only
-const unsigned char CInitialChar = 'A';
+const char CCharset[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+const char CBase[] = "UPPERCASE";
 #endif
 
 #ifdef mixed_case_only
-const unsigned char CInitialChar = 'A';
+const char CCharset[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+const char CBase[] = "MixedCase";
 #endif
 
 #ifdef mixed_case_with_digits
-const unsigned char CInitialChar = '0';
+const char CCharset[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+const char CBase[] = "MixCaseDig0";
 #endif
 
 #ifdef mixcase_digits_punct
-const unsigned char CInitialChar = '!';
+const char CCharset[] = "!\"#$%&'()*+,-./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+const char CBase[] = "MixC!0";
 #endif
 
 const unsigned int CMpiAbortCode = 0;
-const unsigned char CChar00 = 0x00;
-const unsigned char CChar0E = 0x0e;
-const unsigned char CCharE1 = 0xe1;
-const unsigned char CChar09 = 0x09;
-const unsigned char CChar90 = 0x90;
-
-static bool is_digit_byte(const unsigned char b)
-{
-    return ((b & 0xf) <= 9) && ((b >> 4) <= 9);
-}
 
-static bool is_edigit_byte(const unsigned char b)
-{
-    return ((b & 0xf) <= 9) && ((b >> 4) == CChar0E);
-}
-
-// we use branching here rather than the logical operations over the whole 64-bit qwords, because it is very infrequent that the algorithm gets to here
-
-static bool is_phpmagic_4up(const unsigned char b[CDigestLength])
-{
-    return
-        (is_digit_byte(b[4])) &&
-        (is_digit_byte(b[5])) &&
-        (is_digit_byte(b[6])) &&
-        (is_digit_byte(b[7])) &&
-        (is_digit_byte(b[8])) &&
-        (is_digit_byte(b[9])) &&
-        (is_digit_byte(b[10])) &&
-        (is_digit_byte(b[11])) &&
-        (is_digit_byte(b[12])) &&
-        (is_digit_byte(b[13])) &&
-        (is_digit_byte(b[14])) &&
-        (is_digit_byte(b[15])) &&
-        (is_digit_byte(b[16])) &&
-        (is_digit_byte(b[17])) &&
-        (is_digit_byte(b[18])) &&
-        (is_digit_byte(b[19])); 
-}
+// The candidates searched at a time, unless "--autotune" finds better; a processor takes chunks of this size in the stepover mode
+const uint64_t CSearchChunk = 1 << 20;
+// hits stored per call of the engine; without "mpi_continue" the search stops at the first solution, so the engine stops there too
+#ifdef mpi_continue
+const unsigned int CSearchMaxHits = 16;
+#else
+const unsigned int CSearchMaxHits = 1;
+#endif
 
-bool is_nothex_from_b3(const unsigned char b[CDigestLength])
+// Where a search runs, for the reports
+typedef struct {
+    const phpmagic_config* config;
+    std::string salt_prefix;
+    std::string salt_suffix;
+    int mpi_current;
+    int mpi_total;
+    std::string processor_name;
+    uint64_t batch;  // candidates per call of the engine
+    std::chrono::high_resolution_clock::time_point time_begin;
+    NodeGroup* node;  // with "--hierarchical", the hits go to processor 0 through the leader of the node
+    ValidateGroup* validate;  // with "--validate", the near misses go to processor 0
+} SearchRun;
+
+// Prints the solutions
+static void print_hits(const SearchRun* run, const phpmagic_results* results)
 {
-    return ((is_digit_byte(b[3])) &&
-        is_phpmagic_4up(b));
-}
+    const unsigned int digest_nibbles = phpmagic_digest_nibbles(run->config);
+    for (unsigned int h = 0; h < results->count; ++h)
+    {
+        const phpmagic_hit* hit = &(results->hits[h]);
+        auto time_end = std::chrono::high_resolution_clock::now();
+        auto duration_milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - run->time_begin);
+        auto ms_count = duration_milliseconds.count();
+        const std::string message(hit->message);
+
+        std::cout << "PHP Magic string found!!!" << std::endl;
+        std::cout << "It took " << ms_count << " milliseconds" << std::endl;
+
+        // convert to hex string
+        std::string hash_code;
+        hash_code.reserve(digest_nibbles);
+        static const char dec2hex[16 + 1] = "0123456789abcdef";
+        for (unsigned int i = 0; i < digest_nibbles; i++)
+        {
+            hash_code += dec2hex[(hit->digest[i / 8] >> (28 - 4 * (i % 8))) & 15];
+        }
 
-bool is_from_b2_after_zero(const unsigned char b[CDigestLength])
-{
-    unsigned char b2 = b[2];
-    unsigned char b3;
-    switch (b2)
-    {
-    case CChar0E:
-        return is_nothex_from_b3(b);
-    case CChar00:
-        b3 = b[3];
-        if ((b3 == CChar0E) || (is_edigit_byte(b3)))
-            return is_phpmagic_4up(b);
-        else
-            return false;
-    default:
-        if (is_edigit_byte(b2))
-            return
-            is_nothex_from_b3(b);
-        else
-            return false;
+        std::cout << "Solution: '" << message << "' found by the processor " << run->mpi_current << " ("<<run->processor_name<<") of " << run->mpi_total << ", " << phpmagic_hash_name(run->config) << ": " << hash_code << std::endl;
+        if (!run->salt_prefix.empty() || !run->salt_suffix.empty())
+        {
+            std::cout << "Salted message: '" << run->salt_prefix << message << run->salt_suffix << "'" << std::endl;
+        }
+        for (unsigned int p = 0; p < 32; ++p)
+        {
+            if (hit->patterns & (1u << p))
+            {
+                std::cout << "Matched pattern " << p << ": '" << phpmagic_pattern(run->config, p) << "'" << std::endl;
+            }
+        }
     }
 }
 
-
-// We use branching to check whether the buffer fits the definition of "PHP Magic".
-// We do not use logical operations over the whole 64-bit qwords.
-// There is only 1/128 chance (0.78125%) that we move past the first byte - it can be either 00 or 0e from the whole range of 256 bytes,
-// and if the first byte was 00, we have have only 1 / (256/12) chance (4.6875%) that we move past the second byte, etc.
-// So, in most cases, checking just first or the second byte should be enough to continue the loop and check for new digests.
-
-
-static bool is_phpmagic_buf(const unsigned char b[CDigestLength])
+// Prints the solutions; returns true if the search is to stop
+static bool report_hits(const SearchRun* run, const phpmagic_results* results)
 {
-    unsigned char b1;
-    switch (b[0])
-    {
-    case CChar0E:
-        return ((is_digit_byte(b[1])) && (is_digit_byte(b[2])) && is_nothex_from_b3(b));
-    case CChar00:
-        b1 = b[1];
-        switch (b1)
-        {
-        case CChar0E:
-            return ((is_digit_byte(b[2])) && is_nothex_from_b3(b));
-        case CChar00:
-            return is_from_b2_after_zero(b);
-        default:
-            if (is_edigit_byte(b1))
-                return ((is_digit_byte(b[2])) && is_nothex_from_b3(b));
-
-            else
-                return false;
+    if (run->validate)
+    {
+        validate_publish(run->validate, results);
+    }
+    if (run->node)
+    {
+        return node_publish(run->node, results);
+    }
+    print_hits(run, results);
+#ifndef mpi_continue
+    if (results->count > 0)
+    {
+#ifndef DISABLE_MPI
+        if (run->mpi_total > 1)
+        {
+            int mpi_result = MPI_Abort(MPI_COMM_WORLD, CMpiAbortCode);
+            if (mpi_result != MPI_SUCCESS)
+            {
+                std::cerr << "MPI_Abort error " << mpi_result;
+            }
         }
-    default:
-        return false;
+#endif
+        return true;
     }
+#endif
+    return false;
 }
 
-static void increment_char_mixedcase_with_digits(unsigned char* c)
+static bool report_smt(const void* context, const phpmagic_results* results)
 {
-    while (true)
-    {
-        unsigned char a = *c;
-        switch (a)
-        {
-        case '9':
-            a = 'A';
-            break;
-        case 'Z':
-            a = 'a';
-            break;
-        case 'z':
-            a = '0';
-            *c = a;
-            --c;
-            continue;
-        default:
-            ++a;
-        }
-        *c = a;
-        break;
-    }
+    return report_hits((const SearchRun*)context, results);
 }
 
-static void increment_char_mixedcase_with_digits_and_punctuation(unsigned char* c)
+static bool report_shard(const void* context, const phpmagic_results* results)
 {
-    while (true)
-    {
-        unsigned char a = *c;
-        switch (a)
-        {
-        case '9':
-            a = 'A';
-            break;
-        case 'Z':
-            a = 'a';
-            break;
-        case 'z':
-            a = '!';
-            *c = a;
-            --c;
-            continue;
-        default:
-            ++a;
-        }
-        *c = a;
-        break;
-    }
+    return report_hits((const SearchRun*)context, results);
 }
 
-
-static void increment_char_mixedcase(unsigned char* c)
+// No MPI_Abort(): processor 0 stops the others itself, and a processor that aborted would be taken as failed and its unit searched again
+static bool report_tolerant(const void* context, const phpmagic_results* results)
 {
-    while (true)
-    {
-        unsigned char a = *c;
-        switch (a)
-        {
-        case 'Z':
-            a = 'a';
-            break;
-        case 'z':
-            a = 'A';
-            *c = a;
-            --c;
-            continue;
-        default:
-            ++a;
-        }
-        *c = a;
-        break;
-    }
+    print_hits((const SearchRun*)context, results);
+#ifdef mpi_continue
+    return false;
+#else
+    return results->count > 0;
+#endif
 }
 
-static void increment_char_uppercase(unsigned char* c)
+// Processor 0 prints the hits of the other processors, forwarded by the leaders of their nodes
+static void report_node(const void* context, const int mpi_rank, const std::string& processor_name, const phpmagic_results* results)
 {
-    while (true)
-    {
-        unsigned char a = *c;
-        switch (a)
-        {
-        case 'Z':
-            a = 'A';
-            *c = a;
-            --c;
-            continue;
-        default:
-            ++a;
-        }
-        *c = a;
-        break;
-    }
+    SearchRun run = *(const SearchRun*)context;
+    run.mpi_current = mpi_rank;
+    run.processor_name = processor_name;
+    print_hits(&run, results);
 }
 
-static void increment_char_lowercase(unsigned char* c)
+// The sweep goes on after a solution, for the shorter lengths
+static void report_sweep(const void* context, const phpmagic_config* config, const phpmagic_results* results)
 {
-    while (true)
-    {
-        unsigned char a = *c;
-        switch (a)
-        {
-        case 'z':
-            a = 'a';
-            *c = a;
-            --c;
-            continue;
-        default:
-            ++a;
-        }
-        *c = a;
-        break;
-    }
+    SearchRun run = *(const SearchRun*)context;
+    run.config = config;
+    print_hits(&run, results);
 }
 
-static void increment_char_digits(unsigned char* c)
+// Processor 0 waits for the last counts of the others
+static void finish_validation(SearchRun* run)
 {
-    while (true)
+    if (!run->validate) return;
+    const unsigned int flagged = validate_finish(run->validate);
+    if (flagged > 0)
     {
-        unsigned char a = *c;
-        switch (a)
-        {
-        case '9':
-            a = '0';
-            *c = a;
-            --c;
-            continue;
-        default:
-            ++a;
-        }
-        *c = a;
-        break;
+        std::cout << "Validation: " << flagged << " processor(s) flagged, see above" << std::endl;
     }
+    validate_free(run->validate);
+    run->validate = 0;
 }
 
-static void increment_char_hexadecimal_lowercase(unsigned char* c)
+// Searches the keyspace from "begin" to "end" in chunks of CSearchChunk candidates, skipping "skip" chunks after each one;
+// returns false on an engine error and sets "found" if the search is to stop
+static bool search_keyspace(const SearchRun* run, const uint64_t begin, const uint64_t end, const uint64_t skip, bool* found)
 {
-    while (true)
+    phpmagic_hit hits[CSearchMaxHits];
+    phpmagic_results results;
+    results.hits = hits;
+    results.capacity = CSearchMaxHits;
+    uint64_t index = begin;
+    while (index < end)
     {
-        unsigned char a = *c;
-        switch (a)
+        // a contiguous range may go in larger calls, e.g. to keep the OpenCL device busy
+        const uint64_t chunk = ((skip == 0) && (run->batch > CSearchChunk)) ? run->batch : CSearchChunk;
+        const uint64_t chunk_end = (end - index > chunk) ? index + chunk : end;
+        while (index < chunk_end)
         {
-        case '9':
-            a = 'a';
-            break;
-        case 'z':
-            a = '0';
-            *c = a;
-            --c;
-            continue;
-        default:
-            ++a;
+            const uint64_t batch = (chunk_end - index > run->batch) ? run->batch : chunk_end - index;
+            if (phpmagic_search_range(run->config, index, batch, &results) != 0)
+            {
+                std::cerr << "Engine error: the digest of '" << hits[results.count].message << "' does not match the reference implementation" << std::endl;
+                return false;
+            }
+            if (report_hits(run, &results))
+            {
+                *found = true;
+                return true;
+            }
+            if (results.hashes == 0) break;
+            index += results.hashes;
         }
-        *c = a;
-        break;
+        if ((skip > 0) && (end - chunk_end <= skip * CSearchChunk)) break;
+        index = chunk_end + skip * CSearchChunk;
     }
+    return true;
 }
 
-static void increment_char_hexadecimal_uppercase(unsigned char* c)
-{
-    while (true)
-    {
-        unsigned char a = *c;
-        switch (a)
-        {
-        case '9':
-            a = 'A';
-            break;
-        case 'Z':
-            a = '0';
-            *c = a;
-            --c;
-            continue;
-        default:
-            ++a;
-        }
-        *c = a;
-        break;
-    }
-}
-
-static void increment_char_short(unsigned char* c)
-{
-#ifdef digits_only
-    increment_char_digits(c);
-#endif
-#ifdef mixcase_digits_punct
-    increment_char_mixedcase_with_digits_and_punctuation(c);
-#endif
-#ifdef lowercase_only
-    increment_char_lowercase(c);
-#endif
-#ifdef uppercase_only
-    increment_char_uppercase(c);
-#endif
-#ifdef mixed_case_only
-    increment_char_mixedcase(c);
-#endif
-#ifdef mixed_case_with_digits
-    increment_char_mixedcase_with_digits(c);
-#endif
-}
-
-
-
 
 int main(int argc, char* argv[])
 {
 
 #ifndef DISABLE_MPI
 
-    MPI_Init(NULL, NULL);
+    // "--smt-pair" reports from a second thread, one call at a time
+    int mpi_thread_level = MPI_THREAD_SINGLE;
+    MPI_Init_thread(NULL, NULL, MPI_THREAD_SERIALIZED, &mpi_thread_level);
 
     int mpi_result;
     int mpi_total = 0;
@@ -475,197 +369,785 @@ int main(int argc, char* argv[])
     int mpi_total = 1;
 #endif
 
-#ifdef digits_only
-    std::string message("1");
-#endif
-#ifdef mixcase_digits_punct
-    std::string message("MixC!0");
-#endif
-#ifdef lowercase_only
-    std::string message("lowercase");
-#endif
-#ifdef uppercase_only
-    std::string message("UPPERCASE");
-#endif
-#ifdef mixed_case_only
-    std::string message("MixedCase");
-#endif
-#ifdef mixed_case_with_digits
-    std::string message("MixCaseDig0");
-#endif
-
-    std::string next_message;
-
-#ifndef stepover_run
+    std::vector<std::string> patterns;
+    std::string hash_text("sha1");
+    std::string salt_prefix;
+    std::string salt_suffix;
+    std::string hmac_key;
+    std::string hmac_message;
+    std::string targets_path;
+    bool hmac_fixed = false;
+    bool hmac_varying = false;
+    std::string verify_path;
+    std::string daemon_path;
+    bool fault_tolerant = false;
+    unsigned int heartbeat = 30;
+    bool hierarchical = false;
+    unsigned int interval = 5;
+    bool smt_pair = false;
+    std::string shard_text;
+    bool validate = false;
+    std::string sample_text(CValidateSample);
+    std::string shard_prefix("phpmagic-shard");
+    std::string token_text;
+    unsigned int threads = 1;
+    std::string wordlist_path;
+    std::string rules_text("none");
+    unsigned int rules = rule_none;
+    unsigned int tail_len = 4;
+    int engine = PHPMAGIC_ENGINE_AUTO;
+    bool jit = false;
+    bool autotune = false;
+    unsigned int opencl_device = 0;
+    unsigned int min_length = 0;
+    unsigned int max_length = 0;
+    std::string tune_path;
+    for (int i = 1; i < argc; ++i)
     {
-        const unsigned int CSuffixLength = 100;
-        unsigned char suffix[CSuffixLength];
-        memset(suffix, CInitialChar, sizeof(suffix));
-        const char* charptr = (char*)&(suffix[CSuffixLength - 1]);
-        for (int i = 0; i < mpi_current; ++i)
+        const std::string arg(argv[i]);
+        if ((arg == "--pattern") && (i + 1 < argc))
+        {
+            patterns.push_back(argv[++i]);
+        }
+        else if ((arg == "--salt-prefix") && (i + 1 < argc))
+        {
+            salt_prefix = argv[++i];
+        }
+        else if ((arg == "--salt-suffix") && (i + 1 < argc))
+        {
+            salt_suffix = argv[++i];
+        }
+        else if ((arg == "--hmac-key") && (i + 1 < argc))
+        {
+            hmac_fixed = true;
+            hmac_key = argv[++i];
+        }
+        else if ((arg == "--hmac-message") && (i + 1 < argc))
+        {
+            hmac_varying = true;
+            hmac_message = argv[++i];
+        }
+        else if ((arg == "--targets") && (i + 1 < argc))
+        {
+            targets_path = argv[++i];
+        }
+        else if ((arg == "--verify") && (i + 1 < argc))
+        {
+            verify_path = argv[++i];
+        }
+        else if ((arg == "--daemon") && (i + 1 < argc))
         {
-            increment_char_short((unsigned char*)charptr);
-            if (suffix[1] != CInitialChar)
+            daemon_path = argv[++i];
+        }
+        else if (arg == "--fault-tolerant")
+        {
+            fault_tolerant = true;
+        }
+        else if ((arg == "--heartbeat") && (i + 1 < argc) && (atoi(argv[i + 1]) > 0))
+        {
+            heartbeat = (unsigned int)atoi(argv[++i]);
+        }
+        else if ((arg == "--shard") && (i + 1 < argc))
+        {
+            shard_text = argv[++i];
+        }
+        else if ((arg == "--shard-prefix") && (i + 1 < argc))
+        {
+            shard_prefix = argv[++i];
+        }
+        else if (arg == "--validate")
+        {
+            validate = true;
+        }
+        else if ((arg == "--sample") && (i + 1 < argc))
+        {
+            validate = true;
+            sample_text = argv[++i];
+        }
+        else if ((arg == "--token") && (i + 1 < argc))
+        {
+            token_text = argv[++i];
+        }
+        else if (arg == "--smt-pair")
+        {
+            smt_pair = true;
+        }
+        else if (arg == "--hierarchical")
+        {
+            hierarchical = true;
+        }
+        else if ((arg == "--interval") && (i + 1 < argc) && (atoi(argv[i + 1]) > 0))
+        {
+            interval = (unsigned int)atoi(argv[++i]);
+        }
+        else if ((arg == "--threads") && (i + 1 < argc) && (atoi(argv[i + 1]) > 0))
+        {
+            threads = (unsigned int)atoi(argv[++i]);
+        }
+        else if ((arg == "--wordlist") && (i + 1 < argc))
+        {
+            wordlist_path = argv[++i];
+        }
+        else if ((arg == "--rules") && (i + 1 < argc))
+        {
+            rules_text = argv[++i];
+            std::string rules_error;
+            if (!wordlist_parse_rules(rules_text, &rules, &rules_error))
             {
-                std::cerr << "Stepover buffer overflow" << std::endl;
+                std::cerr << "Invalid rules: " << rules_error << std::endl;
                 return 1;
             }
         }
-        int len = 0;
-        int i = 0;
-        while (i < CSuffixLength)
+        else if ((arg == "--tail") && (i + 1 < argc) && (atoi(argv[i + 1]) >= 0) && (atoi(argv[i + 1]) <= 64))
         {
-            if (suffix[i] != CInitialChar) break;
-            i++;
+            tail_len = (unsigned int)atoi(argv[++i]);
         }
-        len = CSuffixLength - i;
-        if (len > 0)
+        else if ((arg == "--hash") && (i + 1 < argc))
         {
-            for (i = 0; i < len-1; ++i)
-            {
-                --charptr;
-            }
-            message.append(charptr, len);
+            hash_text = argv[++i];
+        }
+        else if ((arg == "--engine") && (i + 1 < argc) && ((std::string(argv[i + 1]) == "single") || (std::string(argv[i + 1]) == "multibuffer")))
+        {
+            engine = (std::string(argv[++i]) == "multibuffer") ? PHPMAGIC_ENGINE_MULTIBUFFER : PHPMAGIC_ENGINE_SINGLE;
+        }
+        else if ((arg == "--engine") && (i + 1 < argc) && (std::string(argv[i + 1]) == "opencl"))
+        {
+            engine = PHPMAGIC_ENGINE_OPENCL;
+            ++i;
+        }
+        else if ((arg == "--opencl-device") && (i + 1 < argc))
+        {
+            opencl_device = (unsigned int)atoi(argv[++i]);
+        }
+        else if (arg == "--jit")
+        {
+            jit = true;
+        }
+        else if ((arg == "--lengths") && (i + 1 < argc) && (sscanf(argv[i + 1], "%u-%u", &min_length, &max_length) == 2) && (min_length > 0) && (min_length <= max_length))
+        {
+            ++i;
+        }
+        else if (arg == "--autotune")
+        {
+            autotune = true;
+        }
+        else if ((arg == "--tune-profile") && (i + 1 < argc))
+        {
+            autotune = true;
+            tune_path = argv[++i];
+        }
+        else
+        {
+            std::cerr << "Unknown or incomplete option '" << arg << "'" << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [--pattern PATTERN]... [--targets FILE] [--hash sha1|md5|md5(sha1($x))|...|crc32b|adler32|fnv1a32|fnv1a64|joaat] [--salt-prefix SALT] [--salt-suffix SALT] [--hmac-key KEY|--hmac-message MESSAGE] [--engine single|multibuffer|opencl [--opencl-device N]] [--jit] [--autotune [--tune-profile FILE]] [--lengths MIN-MAX] [--verify FILE [--threads N]] [--daemon SOCKET] [--fault-tolerant [--heartbeat SECONDS]] [--hierarchical [--interval SECONDS]] [--smt-pair] [--shard i/N|auto [--shard-prefix PREFIX]] [--validate [--sample PATTERN]] [--token integer|timestamp|uniqid|uuid1|date:...] [--wordlist FILE [--rules none,capitalize,upper,toggle,leet,digits] [--tail N]]" << std::endl;
+            return 1;
         }
     }
-#endif
 
-    char c = CInitialChar;
-    while (message.length() < CMessageLen)
+    if (hierarchical && (!daemon_path.empty() || !verify_path.empty() || !wordlist_path.empty() || (max_length > 0) || fault_tolerant))
+    {
+        std::cerr << "--hierarchical applies to the quick sequential and stepover modes only" << std::endl;
+        return 1;
+    }
+    if (smt_pair && (!daemon_path.empty() || !verify_path.empty() || !wordlist_path.empty() || (max_length > 0) || fault_tolerant || (engine != PHPMAGIC_ENGINE_AUTO)))
+    {
+        std::cerr << "--smt-pair applies to the quick sequential and stepover modes only and picks the engines itself" << std::endl;
+        return 1;
+    }
+    if (validate && (!daemon_path.empty() || !verify_path.empty() || !wordlist_path.empty() || (max_length > 0) || fault_tolerant))
+    {
+        std::cerr << "--validate applies to the quick sequential, stepover and shard modes only" << std::endl;
+        return 1;
+    }
+    unsigned int shard_index = 0;
+    unsigned int shard_count = 0;
+    if (!shard_text.empty())
     {
-        unsigned char buff[2];
-        buff[0] = CInitialChar;
-        buff[1] = c;
+        if (!daemon_path.empty() || !verify_path.empty() || !wordlist_path.empty() || (max_length > 0) || fault_tolerant || hierarchical || smt_pair)
+        {
+            std::cerr << "--shard applies to the quick sequential and stepover modes only, without --hierarchical and --smt-pair" << std::endl;
+            return 1;
+        }
+        std::string shard_error;
+        if (!shard_parse(shard_text, &shard_index, &shard_count, &shard_error))
         {
-            const char* charptr = (char*)&(buff[1]);
-            message.append(charptr, 1);
+            std::cerr << "Invalid shard: " << shard_error << std::endl;
+            return 1;
         }
-        increment_char_short(&buff[1]);
-        c = buff[1];
     }
-
-#ifdef hash_is_sha256
-    SHA256 sha256;
-#endif    
-#ifdef hash_is_sha1
-    SHA1_CTX sha1ctx;
-#endif    
-    unsigned char buf[CMessageLen];
-    unsigned char hash[CDigestLength];
-    memset(&(buf[0]), 0, sizeof(buf));
-    std::string::size_type sl = message.length();
-    if (sl > sizeof(buf))
+    // a range of integers over several numbers of digits is a part per number of digits, searched one after the other
+    std::vector<std::string> token_parts;
+    if (!token_text.empty())
+    {
+        if (!daemon_path.empty() || !verify_path.empty() || !wordlist_path.empty() || (max_length > 0))
+        {
+            std::cerr << "--token replaces the character set of the quick sequential, stepover, fault-tolerant and shard modes" << std::endl;
+            return 1;
+        }
+        std::string token_error;
+        if (!token_split(token_text, &token_parts, &token_error))
+        {
+            std::cerr << "Invalid token: " << token_error << std::endl;
+            return 1;
+        }
+        if ((token_parts.size() > 1) && (fault_tolerant || hierarchical || smt_pair || (shard_count > 0) || validate))
+        {
+            std::cerr << "--token with numbers of " << token_parts.size() << " different lengths applies to the quick sequential and stepover modes only; "
+                "give each length, e.g. '" << token_parts.back() << "', to the other modes" << std::endl;
+            return 1;
+        }
+    }
+#ifndef DISABLE_MPI
+    if (smt_pair && (mpi_thread_level < MPI_THREAD_SERIALIZED))
     {
-        std::cerr << "The string '" << message << "' has " << sl << " characters is loo long to fit in the "<< CMessageLen <<"-bytes buffer";
+        std::cerr << "--smt-pair needs an MPI library with MPI_THREAD_SERIALIZED" << std::endl;
         return 1;
     }
+#endif
 
-    memcpy(&(buf[0]), message.c_str(), sl);
-
-    std::string common_initial_message = message;
+    // serve the search jobs of the clients, each job brings its own options
+    if (!daemon_path.empty())
+    {
+        const int daemon_result = daemon_run(daemon_path, mpi_current, mpi_total, processor_name);
+#ifndef DISABLE_MPI
+        MPI_Finalize();
+#endif
+        return daemon_result;
+    }
 
-#ifdef stepover_run
-    for (int i = 0; i < mpi_current; ++i)
+    // the hybrid mode counts the tails after each base, a token is the whole message, the other modes count the end of the message after CBase
+    const std::string base = (wordlist_path.empty() && token_parts.empty()) ? std::string(CBase) : std::string();
+    if (base.length() > CMessageLen)
     {
-        increment_char_short(&(buf[CMessageLen - 1]));
+        std::cerr << "The string '" << base << "' has " << base.length() << " characters is loo long to fit in the "<< CMessageLen <<"-bytes buffer";
+        return 1;
     }
+    if ((max_length > 0) && (!wordlist_path.empty() || (min_length <= base.length()) || (max_length - base.length() > PHPMAGIC_MAX_CANDIDATE)))
     {
-        char* charptr = (char*)&(buf[0]);
-        message.assign(charptr, sl);
+        std::cerr << "The lengths of a sweep must be from " << base.length() + 1 << " to " << base.length() + PHPMAGIC_MAX_CANDIDATE << " characters, without a wordlist" << std::endl;
+        return 1;
+    }
+    std::vector<const char*> pattern_texts;
+    for (std::vector<std::string>::size_type i = 0; i < patterns.size(); ++i)
+    {
+        pattern_texts.push_back(patterns[i].c_str());
+    }
+    phpmagic_options options;
+    memset(&options, 0, sizeof(options));
+    options.hash = hash_text.c_str();
+    options.patterns = pattern_texts.empty() ? 0 : &(pattern_texts[0]);
+    options.pattern_count = (unsigned int)pattern_texts.size();
+    options.charset = CCharset;
+    options.length = wordlist_path.empty() ? CMessageLen - (unsigned int)base.length() : tail_len;
+    options.base = base.c_str();
+    options.salt_prefix = salt_prefix.c_str();
+    options.salt_suffix = salt_suffix.c_str();
+    options.hmac_key = hmac_fixed ? hmac_key.c_str() : 0;
+    options.hmac_message = hmac_varying ? hmac_message.c_str() : 0;
+    options.engine = engine;
+    options.jit = jit ? 1 : 0;
+    options.targets = targets_path.empty() ? 0 : targets_path.c_str();
+    options.opencl_device = opencl_device;
+    options.sample = validate ? sample_text.c_str() : 0;
+    options.token = token_parts.empty() ? 0 : token_parts[0].c_str();
+
+    // the engine, the JIT and the batch sizes timed on this CPU, or those found by an earlier run on this host
+    TuneProfile tune;
+    tune.batch = CSearchChunk;
+    tune.poll = CSearchChunk;
+    if (autotune && (engine == PHPMAGIC_ENGINE_OPENCL))
+    {
+        std::cerr << "The OpenCL engine is not tuned" << std::endl;
+        return 1;
     }
+    if (autotune)
     {
-        unsigned char next_buf[CMessageLen];
-        memcpy(next_buf, buf, CMessageLen);
-        for (int i = 0; i < mpi_total; ++i)
+        if (tune_path.empty())
         {
-            increment_char_short(&(next_buf[CMessageLen - 1]));
+            tune_path = tune_default_path(processor_name);
         }
+        std::string tune_error;
+        auto time_begin = std::chrono::high_resolution_clock::now();
+        if (!tune_search(&options, tune_path, &tune, &tune_error))
         {
-            const char* charptr = (char*)&(next_buf[0]);
-            next_message.assign(charptr, sl);
+            std::cerr << "Invalid options: " << tune_error << std::endl;
+            return 1;
+        }
+        if (!tune_error.empty())
+        {
+            std::cerr << "Processor " << mpi_current << " (" << processor_name << "): " << tune_error << std::endl;
         }
+        options.engine = tune.engine;
+        options.jit = tune.jit;
+        auto ms_count = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - time_begin).count();
+        std::cout << "Processor " << mpi_current << " (" << processor_name << ") is tuned " << (tune.cached ? "from '" + tune_path + "'" : "in " + std::to_string(ms_count) + " milliseconds")
+            << ": " << ((tune.engine == PHPMAGIC_ENGINE_SINGLE) ? "single-buffer" : "multi-buffer") << " engine" << (tune.jit ? " with the JIT" : "") << ", "
+            << tune.batch << " messages per call, a check every " << tune.poll << " messages, " << (uint64_t)(tune.rate / 1000000) << " MH/s" << std::endl;
     }
-#else
-    {
-        unsigned char next_buf[CMessageLen];
-        memcpy(next_buf, buf, CMessageLen);
-        increment_char_short(&(next_buf[CMessageLen - 1]));
-        const char* charptr = (char*)&(next_buf[0]);
-        next_message.assign(charptr, sl);
 
+    phpmagic_config* config;
+    {
+        char config_error[256];
+        config = phpmagic_config_new(&options, config_error, sizeof(config_error));
+        if (!config)
+        {
+            std::cerr << "Invalid options: " << config_error << std::endl;
+            return 1;
+        }
+    }
+    const std::string hash_name(phpmagic_hash_name(config));
+    if (engine == PHPMAGIC_ENGINE_OPENCL)
+    {
+        // several launches per call, so the device always has the next one queued
+        tune.batch = 8 * (uint64_t)phpmagic_lanes(config);
+        tune.poll = tune.batch;
     }
-#endif
-
 
-#ifdef stepover_run
-    std::cout << "Stepover mode. Common initial message: '" << common_initial_message << "', initial message for processor " << mpi_current <<" ("<<processor_name<<"): '" << message << "', step: " << mpi_total << ", next message: '"<< next_message << "'" << std::endl;
-#else
-    std::cout << "Quick sequential mode. Base message for processor " << mpi_current << " ("<<processor_name<<"): '" << message << "', next message: '" << next_message << "'."<<std::endl;
+    // screen the lines of a file instead of searching
+    if (!verify_path.empty())
+    {
+        if (phpmagic_config_chain(config)->depth == 0)
+        {
+            std::cerr << "Files cannot be verified with " << hash_name << std::endl;
+            return 1;
+        }
+        VerifyJob verify_job;
+        verify_job.chain = phpmagic_config_chain(config);
+        verify_job.predicate = phpmagic_config_predicate(config);
+        verify_job.multibuffer = phpmagic_lanes(config) > 1;
+        verify_job.threads = threads;
+        verify_job.salt_prefix = salt_prefix;
+        verify_job.salt_suffix = salt_suffix;
+        verify_job.hmac_key = hmac_key;
+        verify_job.hmac_message = hmac_message;
+        VerifyStats stats;
+        std::string verify_error;
+        auto time_begin = std::chrono::high_resolution_clock::now();
+        if (!verify_file(verify_path, &verify_job, mpi_current, mpi_total, &stats, &verify_error))
+        {
+            std::cerr << "Verification error: " << verify_error << std::endl;
+            return 1;
+        }
+        auto ms_count = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - time_begin).count();
+        std::cerr << "Processor " << mpi_current << " (" << processor_name << ") of " << mpi_total << " checked " << stats.lines << " lines (" << stats.bytes << " bytes) with "
+            << hash_name << " in " << ms_count << " milliseconds, " << stats.matches << " matched" << std::endl;
+        phpmagic_config_free(config);
+#ifndef DISABLE_MPI
+        MPI_Finalize();
 #endif
+        return 0;
+    }
 
-    auto time_begin = std::chrono::high_resolution_clock::now();
+    SearchRun run;
+    run.config = config;
+    run.salt_prefix = salt_prefix;
+    run.salt_suffix = salt_suffix;
+    run.mpi_current = mpi_current;
+    run.mpi_total = mpi_total;
+    run.processor_name = processor_name;
+    run.batch = tune.batch;
+    run.node = 0;
+    run.validate = 0;
+    bool found = false;
+
+    // hybrid mode: the words of a wordlist, mutated by the rules, each followed by every tail of "tail_len" characters
+    if (!wordlist_path.empty())
+    {
+        MappedFile wordlist;
+        std::string wordlist_error;
+        if (!mapped_file_open(wordlist_path, &wordlist, &wordlist_error))
+        {
+            std::cerr << "Wordlist error: " << wordlist_error << std::endl;
+            return 1;
+        }
+        // the words are split between the processors by byte ranges, so no word is taken twice
+        size_t words_begin, words_end;
+        mapped_file_share(wordlist.size, mpi_current, mpi_total, &words_begin, &words_end);
+        std::cout << "Hybrid mode. Processor " << mpi_current << " (" << processor_name << ") takes the words from byte " << words_begin << " to " << words_end
+            << " of '" << wordlist_path << "', rules '" << rules_text << "', " << tail_len << "-character tails, " << hash_name << "." << std::endl;
+
+        run.time_begin = std::chrono::high_resolution_clock::now();
+        std::vector<std::string> bases;
+        uint64_t words = 0;
+        size_t pos = mapped_line_start(&wordlist, words_begin);
+        while (!found && (pos < words_end))
+        {
+            const char* line = (const char*)wordlist.data + pos;
+            const std::string word(line, mapped_line(&wordlist, pos, &pos));
+            if (word.empty()) continue;
+            ++words;
+            bases.clear();
+            wordlist_mutate(word, rules, &bases);
+            for (std::vector<std::string>::size_type b = 0; !found && (b < bases.size()); ++b)
+            {
+                char base_error[256];
+                if (phpmagic_config_set_base(config, bases[b].c_str(), base_error, sizeof(base_error)) != 0)
+                {
+                    std::cerr << "Skipping '" << bases[b] << "': " << base_error << std::endl;
+                    continue;
+                }
+                if (!search_keyspace(&run, 0, phpmagic_keyspace(config), 0, &found))
+                {
+                    return 1;
+                }
+            }
+        }
+        mapped_file_close(&wordlist);
+        auto ms_count = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - run.time_begin).count();
+        std::cout << "Processor " << mpi_current << " (" << processor_name << ") of " << mpi_total << " took " << words << " words in " << ms_count << " milliseconds" << std::endl;
+        phpmagic_config_free(config);
+#ifndef DISABLE_MPI
+        MPI_Finalize();
+#endif
+        return 0;
+    }
 
-    while (true)
+    // the messages of all the lengths from "min_length" to "max_length" at once, for the shortest solution
+    if (max_length > 0)
     {
-#ifdef hash_is_sha256
-        sha256.add(&(buf[0]), CMessageLen);
-        sha256.getHash(hash);
+        std::vector<phpmagic_config*> sweep_configs;
+        for (unsigned int length = min_length; length <= max_length; ++length)
+        {
+            phpmagic_options sweep_options = options;
+            sweep_options.length = length - (unsigned int)base.length();
+            char config_error[256];
+            phpmagic_config* sweep_config = phpmagic_config_new(&sweep_options, config_error, sizeof(config_error));
+            if (!sweep_config)
+            {
+                std::cerr << "Invalid options for the length " << length << ": " << config_error << std::endl;
+                return 1;
+            }
+            sweep_configs.push_back(sweep_config);
+        }
+        SweepJob sweep_job;
+        sweep_job.configs = &(sweep_configs[0]);
+        sweep_job.count = (unsigned int)sweep_configs.size();
+#ifdef mpi_continue
+        sweep_job.all_shortest = true;
+#else
+        sweep_job.all_shortest = false;
 #endif
-#ifdef hash_is_sha1
-        SHA1Init(&sha1ctx);
-        SHA1Update(&sha1ctx, &(buf[0]), CMessageLen);
-        SHA1Final(&(hash[0]), &sha1ctx);
+        sweep_job.batch = tune.batch;
+        sweep_job.poll = tune.poll;
+        sweep_job.report = report_sweep;
+        sweep_job.context = &run;
+        if (mpi_current == 0)
+        {
+            std::cout << "Sweep mode. Processor " << mpi_current << " (" << processor_name << ") hands out the messages of " << min_length << " to " << max_length
+                << " characters in units to " << ((mpi_total > 1) ? mpi_total - 1 : 1) << " processor(s), " << hash_name << " with the " << phpmagic_engine_name(sweep_configs[0]) << " engine." << std::endl;
+        }
+        run.time_begin = std::chrono::high_resolution_clock::now();
+        int shortest = -1;
+        if (!sweep_search(&sweep_job, mpi_current, mpi_total, &shortest))
+        {
+            return 1;
+        }
+        if (mpi_current == 0)
+        {
+            auto ms_count = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - run.time_begin).count();
+            if (shortest >= 0)
+            {
+                std::cout << "The shortest solution has " << min_length + shortest << " characters; the sweep took " << ms_count << " milliseconds" << std::endl;
+            }
+            else
+            {
+                std::cout << "No solution of " << min_length << " to " << max_length << " characters; the sweep took " << ms_count << " milliseconds" << std::endl;
+            }
+        }
+        for (std::vector<phpmagic_config*>::size_type i = 0; i < sweep_configs.size(); ++i)
+        {
+            phpmagic_config_free(sweep_configs[i]);
+        }
+        phpmagic_config_free(config);
+#ifndef DISABLE_MPI
+        MPI_Finalize();
 #endif
+        return 0;
+    }
 
-        if (is_phpmagic_buf(hash))
+    // the parts of a token one after the other, each split between the processors like the keyspace below
+    if (token_parts.size() > 1)
+    {
+        run.time_begin = std::chrono::high_resolution_clock::now();
+        for (std::vector<std::string>::size_type p = 0; !found && (p < token_parts.size()); ++p)
         {
-            auto time_end = std::chrono::high_resolution_clock::now();
-            auto duration_milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(time_end - time_begin);
-            auto ms_count = duration_milliseconds.count();
+            phpmagic_options part_options = options;
+            part_options.token = token_parts[p].c_str();
+            char config_error[256];
+            phpmagic_config* part_config = phpmagic_config_new(&part_options, config_error, sizeof(config_error));
+            if (!part_config)
             {
-                const char* charptr = (char*)&(buf[0]);
-                message.assign(charptr, CMessageLen);
+                std::cerr << "Invalid options for '" << token_parts[p] << "': " << config_error << std::endl;
+                return 1;
             }
-
-            std::cout << "PHP Magic string found!!!" << std::endl;
-            std::cout << "It took " << ms_count << " milliseconds" << std::endl;
-
-            // convert to hex string
-            std::string hash_code;
-            hash_code.reserve(2 * CDigestLength);
-            static const char dec2hex[16 + 1] = "0123456789abcdef";
-            for (int i = 0; i < CDigestLength; i++)
+            const uint64_t part_keyspace = phpmagic_keyspace(part_config);
+#ifdef stepover_run
+            const uint64_t part_begin = (uint64_t)mpi_current * CSearchChunk;
+            const uint64_t part_end = part_keyspace;
+            const uint64_t part_skip = (uint64_t)mpi_total - 1;
+#else
+            const uint64_t part_begin = (uint64_t)((unsigned __int128)part_keyspace * mpi_current / mpi_total);
+            const uint64_t part_end = (uint64_t)((unsigned __int128)part_keyspace * (mpi_current + 1) / mpi_total);
+            const uint64_t part_skip = 0;
+#endif
+            if (mpi_current == 0)
+            {
+                std::cout << "Token mode. The part '" << token_parts[p] << "' of '" << token_text << "', " << part_keyspace << " messages, " << hash_name
+                    << " with the " << phpmagic_engine_name(part_config) << " engine." << std::endl;
+            }
+            run.config = part_config;
+            const bool searched = search_keyspace(&run, part_begin, part_end, part_skip, &found);
+            phpmagic_config_free(part_config);
+            if (!searched)
             {
-                hash_code += dec2hex[(hash[i] >> 4) & 15];
-                hash_code += dec2hex[hash[i] & 15];
+                return 1;
             }
+        }
+        run.config = config;
+        auto ms_count = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - run.time_begin).count();
+        std::cout << "Processor " << mpi_current << " (" << processor_name << ") of " << mpi_total << (found ? " stopped at a hit after " : " has exhausted its part of every length in ")
+            << ms_count << " milliseconds" << std::endl;
+        phpmagic_config_free(config);
+#ifndef DISABLE_MPI
+        MPI_Finalize();
+#endif
+        return 0;
+    }
 
-            std::cout << "Solution: '" << message << "' found by the processor " << mpi_current << " ("<<processor_name<<") of " << mpi_total << ", hash: " << hash_code << std::endl;
+    const uint64_t keyspace = phpmagic_keyspace(config);
+    if (!token_parts.empty() && (mpi_current == 0))
+    {
+        char token_message[PHPMAGIC_MAX_MESSAGE + 1];
+        phpmagic_message(config, 0, token_message);
+        std::cout << "Token '" << token_text << "': " << keyspace << " messages from '" << token_message << "'." << std::endl;
+    }
 
-#ifndef mpi_continue
+    // processor 0 hands the keyspace out and the units of the processors that die go to the others
+    if (fault_tolerant)
+    {
+        TolerantJob tolerant_job;
+        tolerant_job.config = config;
+        tolerant_job.end = keyspace;
+        tolerant_job.timeout = heartbeat;
+        tolerant_job.batch = tune.batch;
+        tolerant_job.poll = tune.poll;
+        tolerant_job.report = report_tolerant;
+        tolerant_job.context = &run;
+        if (mpi_current == 0)
+        {
+            std::cout << "Fault-tolerant mode. Processor " << mpi_current << " (" << processor_name << ") hands out " << keyspace << " messages in units to "
+                << ((mpi_total > 1) ? mpi_total - 1 : 1) << " processor(s), taking a processor as failed after " << heartbeat << " seconds of silence" << std::endl;
+        }
+        run.time_begin = std::chrono::high_resolution_clock::now();
+        unsigned int failed = 0;
+        if (!tolerant_search(&tolerant_job, mpi_current, mpi_total, &found, &failed))
+        {
+            return 1;
+        }
+        if (mpi_current == 0)
+        {
+            auto ms_count = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - run.time_begin).count();
+            std::cout << (found ? "The search stopped at a solution after " : "The keyspace is exhausted after ") << ms_count << " milliseconds" << std::endl;
+        }
 #ifndef DISABLE_MPI
-            if (mpi_total > 1)
+        if (failed > 0)
+        {
+            // MPI_Finalize() would wait for the failed processors
+            int mpi_result = MPI_Abort(MPI_COMM_WORLD, CMpiAbortCode);
+            if (mpi_result != MPI_SUCCESS)
             {
-                mpi_result = MPI_Abort(MPI_COMM_WORLD, CMpiAbortCode);
-                if (mpi_result != MPI_SUCCESS)
-                {
-                    std::cerr << "MPI_Abort error " << mpi_result;
-                }
+                std::cerr << "MPI_Abort error " << mpi_result;
             }
+        }
+#endif
+        phpmagic_config_free(config);
+#ifndef DISABLE_MPI
+        MPI_Finalize();
 #endif
-            break;
+        return 0;
+    }
+
+    char first_message[PHPMAGIC_MAX_MESSAGE + 1];
+    char next_message[PHPMAGIC_MAX_MESSAGE + 1];
+
+    // the near misses of every processor, checked by processor 0
+    if (validate)
+    {
+        run.validate = validate_create(config, interval, processor_name);
+        if (mpi_current == 0)
+        {
+            std::cout << "Validation mode. Processor 0 checks the near misses of the processors, the digests matching '" << sample_text << "' (probability "
+                << phpmagic_sample_probability(config) << "), and a sample of them every " << interval << " second(s)." << std::endl;
+        }
+    }
 
+    // a contiguous range of the shard per processor, recorded with its hits in a file of its own
+    if (shard_count > 0)
+    {
+        ShardJob shard_job;
+        shard_job.config = config;
+        shard_job.fingerprint = shard_fingerprint(&options);
+        shard_range(keyspace, shard_index, shard_count, &shard_job.range.begin, &shard_job.range.end);
+        const uint64_t shard_size = shard_job.range.end - shard_job.range.begin;
+        shard_job.range.index = shard_index;
+        shard_job.range.count = shard_count;
+        shard_job.range.begin += (uint64_t)((unsigned __int128)shard_size * mpi_current / mpi_total);
+        shard_job.range.end = shard_job.range.end - shard_size + (uint64_t)((unsigned __int128)shard_size * (mpi_current + 1) / mpi_total);
+        shard_job.batch = tune.batch;
+        shard_job.interval = interval;
+#ifdef mpi_continue
+        shard_job.stop_at_hit = false;
+#else
+        shard_job.stop_at_hit = true;
 #endif
+        shard_job.report = report_shard;
+        shard_job.context = &run;
+        std::string shard_path = shard_prefix + "-" + std::to_string(shard_index) + "-of-" + std::to_string(shard_count);
+        if (mpi_total > 1)
+        {
+            shard_path += "-" + std::to_string(mpi_current);
+        }
+        shard_path += ".txt";
+        phpmagic_message(config, shard_job.range.begin, first_message);
+        std::cout << "Shard mode. Processor " << mpi_current << " (" << processor_name << ") of shard " << shard_index << "/" << shard_count << " takes "
+            << shard_job.range.end - shard_job.range.begin << " messages from '" << first_message << "', " << hash_name << " with the "
+            << phpmagic_engine_name(config) << " engine, recorded in '" << shard_path << "'." << std::endl;
+        run.time_begin = std::chrono::high_resolution_clock::now();
+        ShardStats shard_stats;
+        std::string shard_error;
+        if (!shard_search(&shard_job, shard_path, &shard_stats, &found, &shard_error))
+        {
+            std::cerr << "Shard error: " << shard_error << std::endl;
+            return 1;
         }
+        auto ms_count = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - run.time_begin).count();
+        if (shard_stats.resumed_at > shard_job.range.begin)
+        {
+            std::cout << "Processor " << mpi_current << " (" << processor_name << ") resumed '" << shard_path << "' after " << shard_stats.resumed_at - shard_job.range.begin
+                << " messages covered, with " << shard_stats.earlier_hits << " hit(s) found earlier" << std::endl;
+        }
+        std::cout << "Processor " << mpi_current << " (" << processor_name << ") hashed " << shard_stats.hashed << " messages in " << ms_count << " milliseconds"
+            << (found ? "" : " and has exhausted its part of the shard") << std::endl;
+        finish_validation(&run);
+        phpmagic_config_free(config);
+#ifndef DISABLE_MPI
+        MPI_Finalize();
+#endif
+        return 0;
+    }
+
 #ifdef stepover_run
-        for (int i = 0; i < mpi_total; ++i)
+    const uint64_t begin = (uint64_t)mpi_current * CSearchChunk;
+    const uint64_t end = keyspace;
+    const uint64_t skip = (uint64_t)mpi_total - 1;
+    phpmagic_message(config, 0, first_message);
+    phpmagic_message(config, begin, next_message);
+    std::cout << "Stepover mode. Common initial message: '" << first_message << "', initial message for processor " << mpi_current <<" ("<<processor_name<<"): '" << next_message << "', step: " << mpi_total << " chunks of " << CSearchChunk << " messages" << std::endl;
+#else
+    const uint64_t begin = (uint64_t)((unsigned __int128)keyspace * mpi_current / mpi_total);
+    const uint64_t end = (uint64_t)((unsigned __int128)keyspace * (mpi_current + 1) / mpi_total);
+    const uint64_t skip = 0;
+    phpmagic_message(config, begin, first_message);
+    phpmagic_message(config, begin + 1, next_message);
+    std::cout << "Quick sequential mode. Base message for processor " << mpi_current << " ("<<processor_name<<"): '" << first_message << "', next message: '" << next_message << "'."<<std::endl;
+#endif
+    // with "--smt-pair", the single-buffer engine with the SHA CPU instructions on one hardware thread of the core, the multi-buffer engine on the other
+    phpmagic_config* pair_configs[2] = { 0, 0 };
+    if (smt_pair)
+    {
+        for (unsigned int e = 0; e < 2; ++e)
         {
-            increment_char_short(&(buf[CMessageLen - 1]));
+            phpmagic_options pair_options = options;
+            pair_options.engine = (e == 0) ? PHPMAGIC_ENGINE_SINGLE : PHPMAGIC_ENGINE_MULTIBUFFER;
+            char config_error[256];
+            pair_configs[e] = phpmagic_config_new(&pair_options, config_error, sizeof(config_error));
+            if (!pair_configs[e])
+            {
+                std::cerr << "Invalid options: " << config_error << std::endl;
+                return 1;
+            }
         }
+        std::cout << "Processor " << mpi_current << " hashes " << hash_name << " with the " << phpmagic_engine_name(pair_configs[0]) << " engine, "
+            << phpmagic_lanes(pair_configs[0]) << " message(s) at a time, and the " << phpmagic_engine_name(pair_configs[1]) << " engine, "
+            << phpmagic_lanes(pair_configs[1]) << " message(s) at a time, on the two hardware threads of a core." << std::endl;
+    }
+    else
+    {
+        std::cout << "Processor " << mpi_current << " hashes " << hash_name << " with the " << phpmagic_engine_name(config) << " engine, " << phpmagic_lanes(config) << " message(s) at a time." << std::endl;
+    }
+
+    // the processors of a node report through their leader, and the leaders to processor 0
+    NodeJob node_job;
+    node_job.keyspace = keyspace;
+    node_job.interval = interval;
+#ifdef mpi_continue
+    node_job.stop_at_hit = false;
 #else
-        increment_char_short(&(buf[CMessageLen - 1]));
+    node_job.stop_at_hit = true;
 #endif
+    node_job.print = report_node;
+    node_job.context = &run;
+    if (hierarchical)
+    {
+        std::string node_error;
+        run.node = node_create(&node_job, processor_name, &node_error);
+        if (!run.node)
+        {
+            std::cerr << "Processor " << mpi_current << " (" << processor_name << "): " << node_error << std::endl;
+            return 1;
+        }
+        int nodes, node_rank, node_size;
+        node_layout(run.node, &nodes, &node_rank, &node_size);
+        if (mpi_current == 0)
+        {
+            std::cout << "Hierarchical mode. " << mpi_total << " processor(s) on " << nodes << " node(s); the leader of each node reports to processor 0 every "
+                << interval << " second(s)." << std::endl;
+        }
+    }
+
+    run.time_begin = std::chrono::high_resolution_clock::now();
+    if (smt_pair)
+    {
+        SmtJob smt_job;
+        smt_job.configs[0] = pair_configs[0];
+        smt_job.configs[1] = pair_configs[1];
+        smt_job.begin = begin;
+        smt_job.end = end;
+        smt_job.chunk = CSearchChunk;
+        smt_job.stride = (skip + 1) * CSearchChunk;
+        smt_job.batch = run.batch;
+        smt_job.report = report_smt;
+        smt_job.context = &run;
+        SmtStats smt_stats;
+        if (!smt_search(&smt_job, &smt_stats, &found))
+        {
+            return 1;
+        }
+        const uint64_t pair_hashed = smt_stats.hashed[0] + smt_stats.hashed[1];
+        for (unsigned int e = 0; e < 2; ++e)
+        {
+            std::cout << "Processor " << mpi_current << " (" << processor_name << "): the " << phpmagic_engine_name(pair_configs[e]) << " engine "
+                << ((smt_stats.cpu[e] >= 0) ? "on CPU " + std::to_string(smt_stats.cpu[e]) : std::string("unpinned (no SMT sibling in the affinity mask)"))
+                << " hashed " << smt_stats.hashed[e] << " messages (" << (pair_hashed ? 100 * smt_stats.hashed[e] / pair_hashed : 0) << "%), "
+                << (uint64_t)(smt_stats.hashed[e] / smt_stats.seconds[e] / 1000000) << " MH/s" << std::endl;
+            phpmagic_config_free(pair_configs[e]);
+        }
+    }
+    else if (!search_keyspace(&run, begin, end, skip, &found))
+    {
+        return 1;
+    }
+    if (!found)
+    {
+        std::cout << "Processor " << mpi_current << " (" << processor_name << ") has exhausted its keyspace" << std::endl;
+    }
+    finish_validation(&run);
+    if (run.node)
+    {
+        node_finish(run.node);
+        node_free(run.node);
     }
+    phpmagic_config_free(config);
 #ifndef DISABLE_MPI
 
     MPI_Finalize();
@@ -0,0 +1,403 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Sharded search, see "phpmagic_shard.h".
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include "phpmagic_shard.h"
+
+// hits stored per call of the engine when the shard goes on after a hit ("mpi_continue"); otherwise it stops at the first one
+const unsigned int CShardMaxHits = 16;
+
+typedef std::chrono::steady_clock ShardClock;
+
+static bool parse_number(const char* text, uint64_t* value)
+{
+    if ((text == 0) || (*text < '0') || (*text > '9')) return false;
+    char* end = 0;
+    *value = strtoull(text, &end, 10);
+    return *end == 0;
+}
+
+// The position of the array task in the range of the array, e.g. "SLURM_ARRAY_TASK" with "_ID", "_MIN", "_MAX" and "_STEP"
+static bool array_task(const char* id_name, const char* first_name, const char* last_name, const char* step_name, unsigned int* index, unsigned int* count)
+{
+    uint64_t id, first, last, step = 1;
+    if (!parse_number(getenv(id_name), &id) || !parse_number(getenv(first_name), &first) || !parse_number(getenv(last_name), &last)) return false;
+    if (getenv(step_name) && !parse_number(getenv(step_name), &step)) return false;
+    if ((step == 0) || (id < first) || (id > last) || ((id - first) % step != 0)) return false;
+    *index = (unsigned int)((id - first) / step);
+    *count = (unsigned int)((last - first) / step + 1);
+    return true;
+}
+
+bool shard_parse(const std::string& text, unsigned int* index, unsigned int* count, std::string* error)
+{
+    if (text == "auto")
+    {
+        if (getenv("PHPMAGIC_SHARD"))
+        {
+            const std::string shard(getenv("PHPMAGIC_SHARD"));
+            if ((shard != "auto") && shard_parse(shard, index, count, error)) return true;
+            *error = "PHPMAGIC_SHARD must be 'i/N' with i < N";
+            return false;
+        }
+        if (getenv("SLURM_ARRAY_TASK_ID"))
+        {
+            if (array_task("SLURM_ARRAY_TASK_ID", "SLURM_ARRAY_TASK_MIN", "SLURM_ARRAY_TASK_MAX", "SLURM_ARRAY_TASK_STEP", index, count)) return true;
+            *error = "the Slurm array task is not in a range of SLURM_ARRAY_TASK_MIN to SLURM_ARRAY_TASK_MAX";
+            return false;
+        }
+        if (getenv("SGE_TASK_ID") && (std::string(getenv("SGE_TASK_ID")) != "undefined"))
+        {
+            if (array_task("SGE_TASK_ID", "SGE_TASK_FIRST", "SGE_TASK_LAST", "SGE_TASK_STEPSIZE", index, count)) return true;
+            *error = "the Grid Engine array task is not in a range of SGE_TASK_FIRST to SGE_TASK_LAST";
+            return false;
+        }
+        *error = "no array task in the environment (PHPMAGIC_SHARD, SLURM_ARRAY_TASK_ID or SGE_TASK_ID)";
+        return false;
+    }
+    const std::string::size_type slash = text.find('/');
+    uint64_t i, n;
+    if ((slash == std::string::npos) || !parse_number(text.substr(0, slash).c_str(), &i) || !parse_number(text.substr(slash + 1).c_str(), &n)
+        || (n == 0) || (i >= n) || (n > 0xFFFFFFFFu))
+    {
+        *error = "a shard must be 'i/N' with i < N, or 'auto'";
+        return false;
+    }
+    *index = (unsigned int)i;
+    *count = (unsigned int)n;
+    return true;
+}
+
+void shard_range(const uint64_t keyspace, const unsigned int index, const unsigned int count, uint64_t* begin, uint64_t* end)
+{
+    *begin = (uint64_t)((unsigned __int128)keyspace * index / count);
+    *end = (uint64_t)((unsigned __int128)keyspace * (index + 1) / count);
+}
+
+// FNV-1a over the fields, each with a byte telling if it is set, so that an empty field differs from a missing one
+static void fingerprint_field(uint64_t* state, const char* text)
+{
+    const unsigned char set = text ? 1 : 0;
+    *state = (*state ^ set) * 0x100000001B3ull;
+    for (const char* p = text; p && *p; ++p)
+    {
+        *state = (*state ^ (unsigned char)*p) * 0x100000001B3ull;
+    }
+    *state = (*state ^ 0xFF) * 0x100000001B3ull;
+}
+
+std::string shard_fingerprint(const phpmagic_options* options)
+{
+    uint64_t state = 0xCBF29CE484222325ull;
+    fingerprint_field(&state, options->hash ? options->hash : "sha1");
+    fingerprint_field(&state, options->charset);
+    fingerprint_field(&state, std::to_string(options->length).c_str());
+    if (options->token)
+    {
+        fingerprint_field(&state, options->token);
+    }
+    fingerprint_field(&state, options->base ? options->base : "");
+    fingerprint_field(&state, options->salt_prefix ? options->salt_prefix : "");
+    fingerprint_field(&state, options->salt_suffix ? options->salt_suffix : "");
+    fingerprint_field(&state, options->hmac_key);
+    fingerprint_field(&state, options->hmac_message);
+    fingerprint_field(&state, options->targets);
+    for (unsigned int p = 0; p < options->pattern_count; ++p)
+    {
+        fingerprint_field(&state, options->patterns[p]);
+    }
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", (unsigned long long)state);
+    return text;
+}
+
+// The value of "key" in a line; "message" is the last field and may hold any character but the line end
+static bool line_field(const std::string& line, const std::string& key, std::string* value)
+{
+    const std::string::size_type pos = line.find("\t" + key + "=");
+    if (pos == std::string::npos) return false;
+    const std::string::size_type start = pos + key.length() + 2;
+    const std::string::size_type end = (key == "message") ? std::string::npos : line.find('\t', start);
+    *value = line.substr(start, (end == std::string::npos) ? std::string::npos : end - start);
+    return true;
+}
+
+static bool line_number(const std::string& line, const std::string& key, uint64_t* value)
+{
+    std::string text;
+    return line_field(line, key, &text) && parse_number(text.c_str(), value);
+}
+
+bool shard_read(const std::string& path, ShardFile* file, std::string* error)
+{
+    std::ifstream stream(path.c_str(), std::ios::binary);
+    if (!stream)
+    {
+        *error = "cannot open '" + path + "'";
+        return false;
+    }
+    std::ostringstream content;
+    content << stream.rdbuf();
+    const std::string text = content.str();
+    file->fingerprint.clear();
+    file->hash.clear();
+    file->keyspace = 0;
+    file->ranges.clear();
+    file->covered.clear();
+    file->hits.clear();
+    unsigned int number = 0;
+    std::string::size_type pos = 0;
+    // a last line without its end was cut short when the process was stopped
+    for (std::string::size_type end = text.find('\n'); end != std::string::npos; pos = end + 1, end = text.find('\n', pos))
+    {
+        const std::string line = text.substr(pos, end - pos);
+        ++number;
+        const std::string kind = line.substr(0, line.find('\t'));
+        bool valid = false;
+        if (kind == "run")
+        {
+            std::string fingerprint, hash;
+            uint64_t keyspace = 0;
+            valid = line_field(line, "fingerprint", &fingerprint) && line_field(line, "hash", &hash) && line_number(line, "keyspace", &keyspace)
+                && (file->fingerprint.empty() || ((fingerprint == file->fingerprint) && (keyspace == file->keyspace)));
+            file->fingerprint = fingerprint;
+            file->hash = hash;
+            file->keyspace = keyspace;
+        }
+        else if (kind == "shard")
+        {
+            uint64_t index = 0, count = 0;
+            ShardRange range;
+            valid = line_number(line, "index", &index) && line_number(line, "count", &count) && line_number(line, "begin", &range.begin)
+                && line_number(line, "end", &range.end) && (index < count) && (count <= 0xFFFFFFFFu) && (range.begin <= range.end);
+            range.index = (unsigned int)index;
+            range.count = (unsigned int)count;
+            if (valid) file->ranges.push_back(range);
+        }
+        else if (kind == "covered")
+        {
+            ShardCovered covered;
+            valid = line_number(line, "begin", &covered.begin) && line_number(line, "end", &covered.end) && (covered.begin <= covered.end);
+            if (valid) file->covered.push_back(covered);
+        }
+        else if (kind == "hit")
+        {
+            ShardHit hit;
+            uint64_t patterns = 0;
+            valid = line_number(line, "index", &hit.index) && line_number(line, "patterns", &patterns) && line_field(line, "digest", &hit.digest)
+                && line_field(line, "message", &hit.message);
+            hit.patterns = (uint32_t)patterns;
+            if (valid) file->hits.push_back(hit);
+        }
+        else if (line.empty() || (line[0] == '#'))
+        {
+            valid = true;
+        }
+        if (!valid)
+        {
+            *error = "invalid line " + std::to_string(number) + " of '" + path + "'";
+            return false;
+        }
+    }
+    if (file->fingerprint.empty())
+    {
+        *error = "'" + path + "' is not a shard file";
+        return false;
+    }
+    return true;
+}
+
+static std::string covered_line(const uint64_t begin, const uint64_t end)
+{
+    return "covered\tbegin=" + std::to_string(begin) + "\tend=" + std::to_string(end) + "\n";
+}
+
+static std::string hit_line(const ShardHit& hit)
+{
+    return "hit\tindex=" + std::to_string(hit.index) + "\tpatterns=" + std::to_string(hit.patterns) + "\tdigest=" + hit.digest + "\tmessage=" + hit.message + "\n";
+}
+
+static std::string head_lines(const ShardFile* file)
+{
+    std::string lines = "run\tfingerprint=" + file->fingerprint + "\thash=" + file->hash + "\tkeyspace=" + std::to_string(file->keyspace) + "\n";
+    for (std::vector<ShardRange>::size_type r = 0; r < file->ranges.size(); ++r)
+    {
+        const ShardRange& range = file->ranges[r];
+        lines += "shard\tindex=" + std::to_string(range.index) + "\tcount=" + std::to_string(range.count) + "\tbegin=" + std::to_string(range.begin)
+            + "\tend=" + std::to_string(range.end) + "\n";
+    }
+    return lines;
+}
+
+// Written to a temporary file and renamed into place, so a reader never sees half of it
+bool shard_write(const std::string& path, const ShardFile* file, std::string* error)
+{
+    std::ostringstream temp_path;
+    temp_path << path << "." << getpid();
+    {
+        std::ofstream stream(temp_path.str().c_str(), std::ios::binary | std::ios::trunc);
+        stream << head_lines(file);
+        for (std::vector<ShardCovered>::size_type c = 0; c < file->covered.size(); ++c)
+        {
+            stream << covered_line(file->covered[c].begin, file->covered[c].end);
+        }
+        for (std::vector<ShardHit>::size_type h = 0; h < file->hits.size(); ++h)
+        {
+            stream << hit_line(file->hits[h]);
+        }
+        if (!stream.good())
+        {
+            unlink(temp_path.str().c_str());
+            *error = "cannot write '" + temp_path.str() + "'";
+            return false;
+        }
+    }
+    if (rename(temp_path.str().c_str(), path.c_str()) != 0)
+    {
+        unlink(temp_path.str().c_str());
+        *error = "cannot replace '" + path + "'";
+        return false;
+    }
+    return true;
+}
+
+void shard_normalize(ShardFile* file)
+{
+    std::vector<ShardRange>& ranges = file->ranges;
+    std::sort(ranges.begin(), ranges.end(), [](const ShardRange& a, const ShardRange& b) {
+        return (a.count != b.count) ? (a.count < b.count) : (a.index != b.index) ? (a.index < b.index) : (a.begin < b.begin); });
+    ranges.erase(std::unique(ranges.begin(), ranges.end(), [](const ShardRange& a, const ShardRange& b) {
+        return (a.count == b.count) && (a.index == b.index) && (a.begin == b.begin) && (a.end == b.end); }), ranges.end());
+    std::vector<ShardCovered>& covered = file->covered;
+    std::sort(covered.begin(), covered.end(), [](const ShardCovered& a, const ShardCovered& b) { return a.begin < b.begin; });
+    std::vector<ShardCovered>::size_type kept = 0;
+    for (std::vector<ShardCovered>::size_type c = 0; c < covered.size(); ++c)
+    {
+        if (covered[c].begin == covered[c].end) continue;
+        if ((kept > 0) && (covered[c].begin <= covered[kept - 1].end))
+        {
+            covered[kept - 1].end = std::max(covered[kept - 1].end, covered[c].end);
+        }
+        else
+        {
+            covered[kept++] = covered[c];
+        }
+    }
+    covered.resize(kept);
+    std::vector<ShardHit>& hits = file->hits;
+    std::sort(hits.begin(), hits.end(), [](const ShardHit& a, const ShardHit& b) { return a.index < b.index; });
+    hits.erase(std::unique(hits.begin(), hits.end(), [](const ShardHit& a, const ShardHit& b) { return a.index == b.index; }), hits.end());
+}
+
+bool shard_search(const ShardJob* job, const std::string& path, ShardStats* stats, bool* found, std::string* error)
+{
+    *found = false;
+    stats->resumed_at = job->range.begin;
+    stats->hashed = 0;
+    stats->earlier_hits = 0;
+    const uint64_t keyspace = phpmagic_keyspace(job->config);
+    const unsigned int digest_nibbles = phpmagic_digest_nibbles(job->config);
+
+    uint64_t index = job->range.begin;
+    std::ofstream stream;
+    if (access(path.c_str(), F_OK) == 0)
+    {
+        ShardFile earlier;
+        if (!shard_read(path, &earlier, error)) return false;
+        if ((earlier.fingerprint != job->fingerprint) || (earlier.keyspace != keyspace) || (earlier.ranges.size() != 1)
+            || (earlier.ranges[0].index != job->range.index) || (earlier.ranges[0].count != job->range.count)
+            || (earlier.ranges[0].begin != job->range.begin) || (earlier.ranges[0].end != job->range.end))
+        {
+            *error = "'" + path + "' is the file of another search or shard";
+            return false;
+        }
+        shard_normalize(&earlier);
+        for (std::vector<ShardCovered>::size_type c = 0; c < earlier.covered.size(); ++c)
+        {
+            if ((earlier.covered[c].begin <= index) && (earlier.covered[c].end > index)) index = earlier.covered[c].end;
+        }
+        if (index > job->range.end) index = job->range.end;
+        stats->resumed_at = index;
+        stats->earlier_hits = earlier.hits.size();
+        if (job->stop_at_hit && !earlier.hits.empty())
+        {
+            *found = true;
+            return true;
+        }
+        stream.open(path.c_str(), std::ios::binary | std::ios::app);
+    }
+    else
+    {
+        ShardFile head;
+        head.fingerprint = job->fingerprint;
+        head.hash = phpmagic_hash_name(job->config);
+        head.keyspace = keyspace;
+        head.ranges.push_back(job->range);
+        stream.open(path.c_str(), std::ios::binary | std::ios::trunc);
+        stream << head_lines(&head) << std::flush;
+    }
+    if (!stream.good())
+    {
+        *error = "cannot write '" + path + "'";
+        return false;
+    }
+
+    phpmagic_hit hits[CShardMaxHits];
+    phpmagic_results results;
+    results.hits = hits;
+    results.capacity = job->stop_at_hit ? 1 : CShardMaxHits;
+    uint64_t recorded = index;
+    ShardClock::time_point last_record = ShardClock::now();
+    while (index < job->range.end)
+    {
+        const uint64_t batch = (job->range.end - index > job->batch) ? job->batch : job->range.end - index;
+        if (phpmagic_search_range(job->config, index, batch, &results) != 0)
+        {
+            *error = "the digest of '" + std::string(hits[results.count].message) + "' does not match the reference implementation";
+            return false;
+        }
+        for (unsigned int h = 0; h < results.count; ++h)
+        {
+            ShardHit hit;
+            hit.index = hits[h].index;
+            hit.patterns = hits[h].patterns;
+            hit.message = hits[h].message;
+            static const char dec2hex[16 + 1] = "0123456789abcdef";
+            for (unsigned int i = 0; i < digest_nibbles; i++)
+            {
+                hit.digest += dec2hex[(hits[h].digest[i / 8] >> (28 - 4 * (i % 8))) & 15];
+            }
+            stream << hit_line(hit);
+        }
+        if (results.count > 0) stream << std::flush;
+        *found = job->report(job->context, &results);
+        index += results.hashes;
+        stats->hashed += results.hashes;
+        const ShardClock::time_point now = ShardClock::now();
+        if (*found || (results.hashes == 0) || (index >= job->range.end)
+            || (std::chrono::duration_cast<std::chrono::seconds>(now - last_record).count() >= job->interval))
+        {
+            if (index > recorded) stream << covered_line(recorded, index) << std::flush;
+            recorded = index;
+            last_record = now;
+            if (!stream.good())
+            {
+                *error = "cannot write '" + path + "'";
+                return false;
+            }
+        }
+        if (*found || (results.hashes == 0)) break;
+    }
+    return true;
+}
@@ -0,0 +1,96 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Sharded search: "--shard i/N" searches the i-th of N equal contiguous ranges of the keyspace, so independent processes, e.g. the tasks of a
+job array of a batch scheduler, share a search without MPI between them. "--shard auto" takes i and N from the environment: PHPMAGIC_SHARD
+("i/N"), or the array task of Slurm (SLURM_ARRAY_TASK_ID, SLURM_ARRAY_TASK_MIN and SLURM_ARRAY_TASK_MAX) or of Grid Engine (SGE_TASK_ID,
+SGE_TASK_FIRST, SGE_TASK_LAST and SGE_TASK_STEPSIZE). The processors of an MPI run, if any, split the range of the shard between them.
+
+Each process writes a shard file of lines of tab-separated fields, the first being the kind of the line and the others "key=value":
+    run      fingerprint=... hash=... keyspace=...    the options of the search, so the files of different searches are not mixed
+    shard    index=... count=... begin=... end=...    the range the file is responsible for (several in a merged file)
+    covered  begin=... end=...                        a range hashed, appended every interval and at the end
+    hit      index=... patterns=... digest=... message=...
+The hits of a range are written before it is recorded as covered. A file that exists is resumed after the covered part of its range, e.g. when
+the scheduler requeues a preempted task; a line cut short by the preemption is ignored. "phpmagic_merge" combines the files into one file of
+the same format and reports the hits and the ranges that no file has covered.
+*/
+
+#ifndef PHPMAGIC_SHARD_H
+#define PHPMAGIC_SHARD_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "phpmagic_search.h"
+
+typedef struct {
+    unsigned int index;
+    unsigned int count;
+    uint64_t begin;
+    uint64_t end;
+} ShardRange;
+
+typedef struct {
+    uint64_t begin;
+    uint64_t end;
+} ShardCovered;
+
+typedef struct {
+    uint64_t index;
+    uint32_t patterns;
+    std::string digest;   // hexadecimal
+    std::string message;
+} ShardHit;
+
+typedef struct {
+    std::string fingerprint;
+    std::string hash;
+    uint64_t keyspace;
+    std::vector<ShardRange> ranges;
+    std::vector<ShardCovered> covered;   // sorted and disjoint after shard_normalize()
+    std::vector<ShardHit> hits;          // sorted by index and unique after shard_normalize()
+} ShardFile;
+
+// Prints the hits of a call of the engine; returns true if the search is to stop
+typedef bool (*ShardReport)(const void* context, const phpmagic_results* results);
+
+typedef struct {
+    const phpmagic_config* config;
+    std::string fingerprint;   // shard_fingerprint() of the options of "config"
+    ShardRange range;          // the part of the shard searched by this process
+    uint64_t batch;            // candidates per call of phpmagic_search_range()
+    unsigned int interval;     // seconds between the "covered" lines
+    bool stop_at_hit;          // the search stops at its first hit, and a resumed file with hits is not searched further
+    ShardReport report;
+    const void* context;
+} ShardJob;
+
+typedef struct {
+    uint64_t resumed_at;   // where the search started in the range
+    uint64_t hashed;       // candidates hashed by this run
+    size_t earlier_hits;   // hits already in the file
+} ShardStats;
+
+// "i/N" with i < N, or "auto" for the environment of an array task; false with the reason otherwise
+bool shard_parse(const std::string& text, unsigned int* index, unsigned int* count, std::string* error);
+
+// The part of the keyspace of the shard "index" of "count"
+void shard_range(const uint64_t keyspace, const unsigned int index, const unsigned int count, uint64_t* begin, uint64_t* end);
+
+// Identifies the options that set the messages and their matches: the hash, the message layout, the salts, HMAC, the patterns and targets
+std::string shard_fingerprint(const phpmagic_options* options);
+
+bool shard_read(const std::string& path, ShardFile* file, std::string* error);
+bool shard_write(const std::string& path, const ShardFile* file, std::string* error);
+
+// Sorts the shards, merges the covered ranges and sorts the hits, dropping the duplicates
+void shard_normalize(ShardFile* file);
+
+// Searches the range of the job, resuming the file at "path" if it exists, and records the hits and the coverage in it;
+// returns false with the reason on an engine or file error, sets "found" if the search stopped at a hit
+bool shard_search(const ShardJob* job, const std::string& path, ShardStats* stats, bool* found, std::string* error);
+
+#endif
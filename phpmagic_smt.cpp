@@ -0,0 +1,158 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+SMT pairing, see "phpmagic_smt.h".
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "phpmagic_smt.h"
+
+// hits stored per call of the engine; without "mpi_continue" the search stops at the first solution, as in the driver
+#ifdef mpi_continue
+const unsigned int CSmtMaxHits = 16;
+#else
+const unsigned int CSmtMaxHits = 1;
+#endif
+
+// "0,4" or "0-1" into the list of CPUs
+static std::vector<int> smt_siblings(const int cpu)
+{
+    std::vector<int> siblings;
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    std::ifstream file(path);
+    std::string list;
+    if (!std::getline(file, list)) return siblings;
+    int first = -1, last = -1;
+    const char* p = list.c_str();
+    while (*p)
+    {
+        int n = 0;
+        if (sscanf(p, "%d-%d%n", &first, &last, &n) == 2) {}
+        else if (sscanf(p, "%d%n", &first, &n) == 1) last = first;
+        else break;
+        for (int c = first; c <= last; ++c) siblings.push_back(c);
+        p += n;
+        if (*p == ',') ++p;
+    }
+    return siblings;
+}
+
+// The first CPU of the affinity mask of the process with a sibling also in the mask
+static bool smt_pick_pair(int cpu[2])
+{
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0) return false;
+    for (int c = 0; c < CPU_SETSIZE; ++c)
+    {
+        if (!CPU_ISSET(c, &mask)) continue;
+        const std::vector<int> siblings = smt_siblings(c);
+        for (std::vector<int>::size_type s = 0; s < siblings.size(); ++s)
+        {
+            if ((siblings[s] != c) && (siblings[s] < CPU_SETSIZE) && CPU_ISSET(siblings[s], &mask))
+            {
+                cpu[0] = c;
+                cpu[1] = siblings[s];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+typedef struct {
+    const SmtJob* job;
+    std::atomic<uint64_t> next_unit;
+    std::atomic<bool> stop;
+    std::atomic<bool> error;
+    std::mutex report_lock;
+} SmtShared;
+
+static void smt_thread(SmtShared* shared, const unsigned int engine, const int cpu, SmtStats* stats)
+{
+    const SmtJob* job = shared->job;
+    if (cpu >= 0)
+    {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(cpu, &mask);
+        pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+    }
+    phpmagic_hit hits[CSmtMaxHits];
+    phpmagic_results results;
+    results.hits = hits;
+    results.capacity = CSmtMaxHits;
+    const std::chrono::steady_clock::time_point time_begin = std::chrono::steady_clock::now();
+    uint64_t hashed = 0;
+    while (!shared->stop)
+    {
+        const uint64_t unit = shared->next_unit++;
+        if ((job->begin >= job->end) || ((job->end - job->begin) / job->stride < unit)) break;
+        const uint64_t start = job->begin + unit * job->stride;
+        if (start >= job->end) break;
+        const uint64_t unit_end = (job->end - start > job->chunk) ? start + job->chunk : job->end;
+        uint64_t index = start;
+        while ((index < unit_end) && !shared->stop)
+        {
+            const uint64_t batch = (unit_end - index > job->batch) ? job->batch : unit_end - index;
+            const int result = phpmagic_search_range(job->configs[engine], index, batch, &results);
+            std::lock_guard<std::mutex> guard(shared->report_lock);
+            // the other thread may have stopped the search at its solution while this one was hashing
+            if (shared->stop) break;
+            if (result != 0)
+            {
+                std::cerr << "Engine error: the digest of '" << hits[results.count].message << "' does not match the reference implementation" << std::endl;
+                shared->error = true;
+                shared->stop = true;
+                break;
+            }
+            if (job->report(job->context, &results))
+            {
+                shared->stop = true;
+            }
+            hashed += results.hashes;
+            if (results.hashes == 0) break;
+            index += results.hashes;
+        }
+    }
+    stats->hashed[engine] = hashed;
+    stats->seconds[engine] = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_begin).count();
+}
+
+bool smt_search(const SmtJob* job, SmtStats* stats, bool* found)
+{
+    SmtShared shared;
+    shared.job = job;
+    shared.next_unit = 0;
+    shared.stop = false;
+    shared.error = false;
+    if (!smt_pick_pair(stats->cpu))
+    {
+        stats->cpu[0] = stats->cpu[1] = -1;
+    }
+    // the calling thread runs the multi-buffer engine and gets its affinity back afterwards
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    const bool restore = pthread_getaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+    std::thread sha_thread(smt_thread, &shared, 0u, stats->cpu[0], stats);
+    smt_thread(&shared, 1, stats->cpu[1], stats);
+    sha_thread.join();
+    if (restore)
+    {
+        pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+    }
+    *found = shared.stop && !shared.error;
+    return !shared.error;
+}
@@ -0,0 +1,49 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+SMT pairing: "--smt-pair" runs two threads in a process, one per hardware thread of a core: the single-buffer engine, which uses the SHA
+CPU instructions, on one and the multi-buffer engine, which uses the vector units, on its sibling. The SHA unit and the vector ALUs are
+separate resources of the core, so the pair hashes more than either engine on both threads, which would compete for the same unit.
+
+The process is meant to be bound to a whole core ("mpirun --bind-to core", one process per core). The siblings are read from
+/sys/devices/system/cpu/cpuN/topology/thread_siblings_list, and the first CPU of the affinity mask of the process that has a sibling in it
+gets the pair; without one, the threads run unpinned.
+
+The work is split by the measured throughput: the range of the process is cut into units of "chunk" candidates, and each thread takes
+the next unit when it has finished its own, so each engine hashes in proportion to its rate on the shared core; the shares and rates are
+returned for the report.
+*/
+
+#ifndef PHPMAGIC_SMT_H
+#define PHPMAGIC_SMT_H
+
+#include <string>
+#include <stdint.h>
+#include "phpmagic_search.h"
+
+// Called for every call of an engine, serialized between the threads; returns true if the search is to stop
+typedef bool (*SmtReport)(const void* context, const phpmagic_results* results);
+
+typedef struct {
+    const phpmagic_config* configs[2];  // the single-buffer engine (SHA CPU instructions), then the multi-buffer engine
+    uint64_t begin;                     // the units start at "begin" + k * "stride" and have "chunk" candidates, up to "end"
+    uint64_t end;
+    uint64_t chunk;
+    uint64_t stride;
+    uint64_t batch;                     // candidates per call of phpmagic_search_range()
+    SmtReport report;
+    const void* context;
+} SmtJob;
+
+typedef struct {
+    int cpu[2];         // the hardware threads, -1 if unpinned
+    uint64_t hashed[2];
+    double seconds[2];
+} SmtStats;
+
+// Returns false on an engine error; sets "found" if a report stopped the search
+bool smt_search(const SmtJob* job, SmtStats* stats, bool* found);
+
+#endif
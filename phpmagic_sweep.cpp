@@ -0,0 +1,294 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Multi-length sweep, see "phpmagic_sweep.h".
+*/
+
+#ifndef DISABLE_MPI
+#include <mpi.h>
+#endif
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include "phpmagic_sweep.h"
+
+const uint64_t CSweepUnit = 1 << 24;  // candidates handed out at a time
+// hits stored per call of the engine when every solution of the shortest length is wanted ("mpi_continue"); otherwise the sweep stops at one
+const unsigned int CSweepMaxHits = 16;
+
+const int CSweepTagUnit = 21;
+const int CSweepTagStop = 22;
+const int CSweepTagLimit = 23;
+const int CSweepTagResult = 24;
+
+enum { sweep_done, sweep_found, sweep_dropped, sweep_error };
+
+// The end of a unit, as processor 0 learns it
+typedef struct {
+    uint64_t length;  // the index of the length
+    uint64_t start;
+    uint64_t count;
+    uint64_t hits;
+    uint64_t status;
+} SweepResult;
+
+// A length as processor 0 sees it
+typedef struct {
+    uint64_t next;      // the first candidate not handed out yet
+    uint64_t end;
+    uint64_t handed;    // out so far
+    unsigned int in_flight;
+    bool solved;
+    bool closed;        // exhausted or dropped, and reported
+} SweepLength;
+
+// Hashes a unit of a length; the processors other than 0 drop it if processor 0 lowers the limit of the lengths below its length
+static int hash_unit(const SweepJob* job, const SweepResult* unit, const int mpi_current, uint64_t* limit, uint64_t* hits_found)
+{
+    const phpmagic_config* config = job->configs[unit->length];
+    phpmagic_hit hits[CSweepMaxHits];
+    phpmagic_results results;
+    results.hits = hits;
+    results.capacity = job->all_shortest ? CSweepMaxHits : 1;
+    *hits_found = 0;
+    uint64_t hashed = 0;
+    while (hashed < unit->count)
+    {
+        const uint64_t chunk = (unit->count - hashed > job->poll) ? job->poll : unit->count - hashed;
+        uint64_t done = 0;
+        while (done < chunk)
+        {
+            const uint64_t batch = (chunk - done > job->batch) ? job->batch : chunk - done;
+            if (phpmagic_search_range(config, unit->start + hashed + done, batch, &results) != 0)
+            {
+                std::cerr << "Engine error: the digest of '" << hits[results.count].message << "' does not match the reference implementation" << std::endl;
+                return sweep_error;
+            }
+            if (results.count > 0)
+            {
+                job->report(job->context, config, &results);
+                *hits_found += results.count;
+                if (!job->all_shortest) return sweep_found;
+            }
+            if (results.hashes == 0) break;
+            done += results.hashes;
+        }
+        hashed += chunk;
+#ifndef DISABLE_MPI
+        if (mpi_current != 0)
+        {
+            int flag = 1;
+            while (flag)
+            {
+                MPI_Iprobe(0, CSweepTagLimit, MPI_COMM_WORLD, &flag, MPI_STATUS_IGNORE);
+                if (!flag) break;
+                uint64_t new_limit;
+                MPI_Recv(&new_limit, 1, MPI_UINT64_T, 0, CSweepTagLimit, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                if (new_limit < *limit) *limit = new_limit;
+            }
+        }
+#endif
+        if ((unit->length >= *limit) && (hashed < unit->count))
+        {
+            return (*hits_found > 0) ? sweep_found : sweep_dropped;
+        }
+    }
+    return (*hits_found > 0) ? sweep_found : sweep_done;
+}
+
+#ifndef DISABLE_MPI
+static bool sweep_worker(const SweepJob* job, const int mpi_current)
+{
+    uint64_t limit = job->count;
+    while (true)
+    {
+        MPI_Status status;
+        MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        if (status.MPI_TAG == CSweepTagStop)
+        {
+            MPI_Recv(0, 0, MPI_BYTE, 0, CSweepTagStop, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            return true;
+        }
+        if (status.MPI_TAG == CSweepTagLimit)
+        {
+            uint64_t new_limit;
+            MPI_Recv(&new_limit, 1, MPI_UINT64_T, 0, CSweepTagLimit, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            if (new_limit < limit) limit = new_limit;
+            continue;
+        }
+        SweepResult unit;
+        MPI_Recv(&unit, sizeof(unit), MPI_BYTE, 0, CSweepTagUnit, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        unit.status = hash_unit(job, &unit, mpi_current, &limit, &unit.hits);
+        MPI_Send(&unit, sizeof(unit), MPI_BYTE, 0, CSweepTagResult, MPI_COMM_WORLD);
+        if (unit.status == sweep_error) return false;
+    }
+}
+#endif
+
+static unsigned int message_length(const phpmagic_config* config)
+{
+    char message[PHPMAGIC_MAX_MESSAGE + 1];
+    phpmagic_message(config, 0, message);
+    return (unsigned int)strlen(message);
+}
+
+// The next unit: of the length with the least candidates handed out for its weight; false if no length is left below the limit
+static bool next_unit(const SweepJob* job, std::vector<SweepLength>& lengths, const uint64_t limit, SweepResult* unit)
+{
+    int best = -1;
+    double best_score = 0;
+    for (unsigned int i = 0; (i < job->count) && (i < limit); ++i)
+    {
+        const SweepLength& length = lengths[i];
+        if (length.next >= length.end) continue;
+        double weight = (double)(length.end - length.next) * phpmagic_hit_probability(job->configs[i]);
+        if (weight > 1) weight = 1;
+        if (weight < 1e-300) weight = 1e-300;
+        const double score = (double)length.handed / weight;
+        if ((best < 0) || (score < best_score))
+        {
+            best = (int)i;
+            best_score = score;
+        }
+    }
+    if (best < 0) return false;
+    SweepLength& length = lengths[best];
+    unit->length = (uint64_t)best;
+    unit->start = length.next;
+    unit->count = (length.end - length.next > CSweepUnit) ? CSweepUnit : length.end - length.next;
+    unit->hits = 0;
+    unit->status = sweep_done;
+    length.next += unit->count;
+    length.handed += unit->count;
+    ++length.in_flight;
+    return true;
+}
+
+// Reports the lengths that have come to an end
+static void close_lengths(const SweepJob* job, std::vector<SweepLength>& lengths, const uint64_t limit)
+{
+    for (unsigned int i = 0; i < job->count; ++i)
+    {
+        SweepLength& length = lengths[i];
+        if (length.closed || (length.in_flight > 0)) continue;
+        const unsigned int chars = message_length(job->configs[i]);
+        if (length.solved && (i >= limit))
+        {
+            std::cout << "Length " << chars << " has a solution" << std::endl;
+        }
+        else if (i >= limit)
+        {
+            std::cout << "Length " << chars << " is dropped after " << length.next << " of its " << length.end << " messages were handed out" << std::endl;
+        }
+        else if (length.next >= length.end)
+        {
+            std::cout << "Length " << chars << " is exhausted " << (length.solved ? "with" : "without") << " solutions" << std::endl;
+        }
+        else
+        {
+            continue;
+        }
+        length.closed = true;
+    }
+}
+
+static bool sweep_coordinator(const SweepJob* job, const int mpi_total, int* shortest)
+{
+    std::vector<SweepLength> lengths(job->count);
+    for (unsigned int i = 0; i < job->count; ++i)
+    {
+        memset(&lengths[i], 0, sizeof(lengths[i]));
+        lengths[i].end = phpmagic_keyspace(job->configs[i]);
+    }
+    uint64_t limit = job->count;
+    bool engine_error = false;
+    *shortest = -1;
+
+    // a hit lowers the limit: the lengths from its length on (or from the next one) are dropped
+    auto account = [&](const SweepResult* result) {
+        SweepLength& length = lengths[result->length];
+        --length.in_flight;
+        if (result->status == sweep_error)
+        {
+            engine_error = true;
+            limit = 0;
+        }
+        if (result->hits > 0)
+        {
+            length.solved = true;
+            if ((*shortest < 0) || ((int)result->length < *shortest)) *shortest = (int)result->length;
+            const uint64_t new_limit = job->all_shortest ? result->length + 1 : result->length;
+            if (new_limit < limit) limit = new_limit;
+        }
+    };
+
+#ifndef DISABLE_MPI
+    if (mpi_total > 1)
+    {
+        std::vector<bool> busy(mpi_total, false);
+        unsigned int busy_count = 0;
+        for (int w = 1; w < mpi_total; ++w)
+        {
+            SweepResult unit;
+            if (!next_unit(job, lengths, limit, &unit)) break;
+            MPI_Send(&unit, sizeof(unit), MPI_BYTE, w, CSweepTagUnit, MPI_COMM_WORLD);
+            busy[w] = true;
+            ++busy_count;
+        }
+        while (busy_count > 0)
+        {
+            SweepResult result;
+            MPI_Status status;
+            MPI_Recv(&result, sizeof(result), MPI_BYTE, MPI_ANY_SOURCE, CSweepTagResult, MPI_COMM_WORLD, &status);
+            busy[status.MPI_SOURCE] = false;
+            --busy_count;
+            const uint64_t old_limit = limit;
+            account(&result);
+            if (limit < old_limit)
+            {
+                for (int w = 1; w < mpi_total; ++w)
+                {
+                    if (busy[w]) MPI_Send(&limit, 1, MPI_UINT64_T, w, CSweepTagLimit, MPI_COMM_WORLD);
+                }
+            }
+            close_lengths(job, lengths, limit);
+            SweepResult unit;
+            if (next_unit(job, lengths, limit, &unit))
+            {
+                MPI_Send(&unit, sizeof(unit), MPI_BYTE, status.MPI_SOURCE, CSweepTagUnit, MPI_COMM_WORLD);
+                busy[status.MPI_SOURCE] = true;
+                ++busy_count;
+            }
+        }
+        for (int w = 1; w < mpi_total; ++w)
+        {
+            MPI_Send(0, 0, MPI_BYTE, w, CSweepTagStop, MPI_COMM_WORLD);
+        }
+        return !engine_error;
+    }
+#endif
+
+    // processor 0 alone
+    SweepResult unit;
+    while (next_unit(job, lengths, limit, &unit))
+    {
+        unit.status = hash_unit(job, &unit, 0, &limit, &unit.hits);
+        account(&unit);
+        close_lengths(job, lengths, limit);
+    }
+    return !engine_error;
+}
+
+bool sweep_search(const SweepJob* job, const int mpi_current, const int mpi_total, int* shortest)
+{
+    *shortest = -1;
+#ifndef DISABLE_MPI
+    if (mpi_current != 0)
+    {
+        return sweep_worker(job, mpi_current);
+    }
+#endif
+    return sweep_coordinator(job, mpi_total, shortest);
+}
@@ -0,0 +1,41 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Multi-length sweep: "--lengths MIN-MAX" searches the messages of all these lengths in one run, for the shortest solution.
+
+Every length has its own configuration, so its own message layout and kernel. Processor 0 hands the keyspaces out in units of at most
+CSweepUnit candidates, each time of the length that has got the least hashing for its weight: the chance that the rest of its keyspace holds
+a solution (the expected number of solutions, its size times phpmagic_hit_probability(), capped at 1). So the lengths that surely hold one share
+the processors equally and a length that probably holds none gets a share in proportion; a short keyspace is exhausted quickly either way.
+
+A solution of a length ends the lengths from it on (from the next one if all the solutions of the shortest length are wanted): processor 0
+tells the other processors, which drop their units of these lengths at the next check. The shorter lengths go on until they are exhausted,
+since they may still hold a shorter solution. The other processors do the hashing; a single processor does all of it itself.
+*/
+
+#ifndef PHPMAGIC_SWEEP_H
+#define PHPMAGIC_SWEEP_H
+
+#include <stdint.h>
+#include "phpmagic_search.h"
+
+// Prints the hits of a unit on the processor that found them
+typedef void (*SweepReport)(const void* context, const phpmagic_config* config, const phpmagic_results* results);
+
+typedef struct {
+    const phpmagic_config* const* configs;  // one per length, the shortest first
+    unsigned int count;
+    bool all_shortest;                      // keep the length of a solution for its other solutions
+    uint64_t batch;                         // candidates per call of phpmagic_search_range()
+    uint64_t poll;                          // candidates hashed between the checks for a new limit or a stop
+    SweepReport report;
+    const void* context;
+} SweepJob;
+
+// Runs on every processor; returns false on an engine error. On processor 0, "shortest" is the index of the shortest length
+// with a solution, or -1
+bool sweep_search(const SweepJob* job, const int mpi_current, const int mpi_total, int* shortest);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Target prefix sets, see "phpmagic_targets.h".
+*/
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include "phpmagic_targets.h"
+#include "phpmagic_wordlist.h"
+
+// The mask of the first "nibbles" nibbles of a word
+static uint32_t nibble_mask(const unsigned int nibbles)
+{
+    return (nibbles >= 8) ? 0xffffffff : ((nibbles == 0) ? 0 : ~0u << (32 - 4 * nibbles));
+}
+
+static int hex_value(const unsigned char c)
+{
+    if ((c >= '0') && (c <= '9')) return c - '0';
+    if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+    if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+    return -1;
+}
+
+// The prefixes of one length, as they are read
+typedef struct {
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> tails;
+} TargetPrefixes;
+
+static void build_group(const unsigned int nibbles, TargetPrefixes& prefixes, TargetGroup* group)
+{
+    group->nibbles = nibbles;
+    group->mask = (nibbles >= 16) ? ~(uint64_t)0 : ~(~(uint64_t)0 >> (4 * nibbles));
+    group->tail_words = (nibbles > 16) ? (nibbles - 16 + 7) / 8 : 0;
+    const unsigned int tail_words = group->tail_words;
+    if (tail_words == 0)
+    {
+        std::sort(prefixes.keys.begin(), prefixes.keys.end());
+        prefixes.keys.erase(std::unique(prefixes.keys.begin(), prefixes.keys.end()), prefixes.keys.end());
+        group->keys.swap(prefixes.keys);
+    }
+    else
+    {
+        // the keys are sorted together with their tails
+        std::vector<uint32_t> order(prefixes.keys.size());
+        for (uint32_t i = 0; i < order.size(); ++i) order[i] = i;
+        const uint64_t* keys = prefixes.keys.data();
+        const uint32_t* tails = prefixes.tails.data();
+        std::sort(order.begin(), order.end(), [keys, tails, tail_words](const uint32_t a, const uint32_t b) {
+            if (keys[a] != keys[b]) return keys[a] < keys[b];
+            return memcmp(&tails[a * tail_words], &tails[b * tail_words], tail_words * sizeof(uint32_t)) < 0;
+        });
+        for (uint32_t i = 0; i < order.size(); ++i)
+        {
+            const uint32_t k = order[i];
+            if ((i > 0) && (keys[k] == group->keys.back())
+                && (memcmp(&tails[k * tail_words], &group->tails[group->tails.size() - tail_words], tail_words * sizeof(uint32_t)) == 0)) continue;
+            group->keys.push_back(keys[k]);
+            group->tails.insert(group->tails.end(), &tails[k * tail_words], &tails[(k + 1) * tail_words]);
+        }
+    }
+    std::vector<uint64_t>().swap(prefixes.keys);
+    std::vector<uint32_t>().swap(prefixes.tails);
+
+    if (nibbles * 4 >= CTargetIndexBits)
+    {
+        group->offsets.assign(((size_t)1 << CTargetIndexBits) + 1, 0);
+        size_t k = 0;
+        for (size_t bucket = 0; bucket < ((size_t)1 << CTargetIndexBits); ++bucket)
+        {
+            group->offsets[bucket] = (uint32_t)k;
+            while ((k < group->keys.size()) && ((group->keys[k] >> (64 - CTargetIndexBits)) == bucket)) ++k;
+        }
+        group->offsets[(size_t)1 << CTargetIndexBits] = (uint32_t)k;
+    }
+}
+
+bool targets_load(TargetSet* targets, const std::string& path, const unsigned int digest_nibbles, std::string* error)
+{
+    targets->bitmap.assign(((size_t)1 << CTargetBitmapBits) / 32, 0);
+    targets->groups.clear();
+    targets->count = 0;
+    MappedFile file;
+    if (!mapped_file_open(path, &file, error))
+    {
+        return false;
+    }
+    std::map<unsigned int, TargetPrefixes> prefixes;
+    uint64_t line_number = 0;
+    size_t pos = 0;
+    while (pos < file.size)
+    {
+        const unsigned char* line = file.data + pos;
+        size_t len = mapped_line(&file, pos, &pos);
+        ++line_number;
+        // up to the first blank, so a prefix can be followed by a note; "#" starts a comment line
+        for (size_t i = 0; i < len; ++i)
+        {
+            if ((line[i] == ' ') || (line[i] == '\t'))
+            {
+                len = i;
+                break;
+            }
+        }
+        if ((len == 0) || (line[0] == '#')) continue;
+        if (len > digest_nibbles)
+        {
+            *error = "line " + std::to_string(line_number) + " of '" + path + "' is longer than the digest";
+            mapped_file_close(&file);
+            return false;
+        }
+        uint32_t words[CTargetMaxWords];
+        memset(words, 0, sizeof(words));
+        for (size_t i = 0; i < len; ++i)
+        {
+            const int value = hex_value(line[i]);
+            if (value < 0)
+            {
+                *error = "line " + std::to_string(line_number) + " of '" + path + "' is not hexadecimal";
+                mapped_file_close(&file);
+                return false;
+            }
+            words[i / 8] |= (uint32_t)value << (28 - 4 * (i % 8));
+        }
+        const unsigned int nibbles = (unsigned int)len;
+        TargetPrefixes& group = prefixes[nibbles];
+        group.keys.push_back(((uint64_t)words[0] << 32) | words[1]);
+        for (unsigned int w = 2; 8 * w < nibbles; ++w)
+        {
+            group.tails.push_back(words[w]);
+        }
+
+        // every first CTargetBitmapBits bits the prefix covers
+        const uint32_t first = words[0] >> (32 - CTargetBitmapBits);
+        const uint32_t covered = (4 * nibbles >= CTargetBitmapBits) ? 1 : 1u << (CTargetBitmapBits - 4 * nibbles);
+        for (uint32_t top = first; top < first + covered; ++top)
+        {
+            targets->bitmap[top >> 5] |= 1u << (top & 31);
+        }
+    }
+    mapped_file_close(&file);
+
+    for (std::map<unsigned int, TargetPrefixes>::iterator it = prefixes.begin(); it != prefixes.end(); ++it)
+    {
+        targets->groups.push_back(TargetGroup());
+        build_group(it->first, it->second, &targets->groups.back());
+        targets->count += targets->groups.back().keys.size();
+    }
+    if (targets->count == 0)
+    {
+        *error = "'" + path + "' has no prefixes";
+        return false;
+    }
+    return true;
+}
+
+bool targets_match(const TargetSet* targets, const uint32_t digest[])
+{
+    if ((targets->count == 0) || !targets_bitmap_test(targets, digest[0])) return false;
+    const uint64_t top = ((uint64_t)digest[0] << 32) | digest[1];
+    for (std::vector<TargetGroup>::const_iterator g = targets->groups.begin(); g != targets->groups.end(); ++g)
+    {
+        const uint64_t key = top & g->mask;
+        const uint64_t* begin = g->keys.data();
+        const uint64_t* end = begin + g->keys.size();
+        if (!g->offsets.empty())
+        {
+            const size_t bucket = (size_t)(key >> (64 - CTargetIndexBits));
+            end = begin + g->offsets[bucket + 1];
+            begin += g->offsets[bucket];
+        }
+        const uint64_t* k = std::lower_bound(begin, end, key);
+        for (; (k != end) && (*k == key); ++k)
+        {
+            if (g->tail_words == 0) return true;
+            const uint32_t* tail = &(g->tails[(k - g->keys.data()) * g->tail_words]);
+            bool equal = true;
+            for (unsigned int w = 0; equal && (w < g->tail_words); ++w)
+            {
+                equal = (digest[2 + w] & nibble_mask(g->nibbles - 16 - 8 * w)) == tail[w];
+            }
+            if (equal) return true;
+        }
+    }
+    return false;
+}
+
+double targets_probability(const TargetSet* targets)
+{
+    double probability = 0;
+    for (std::vector<TargetGroup>::const_iterator g = targets->groups.begin(); g != targets->groups.end(); ++g)
+    {
+        probability += g->keys.size() * pow(16.0, -(double)g->nibbles);
+    }
+    return (probability > 1) ? 1 : probability;
+}
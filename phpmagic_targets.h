@@ -0,0 +1,59 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Large sets of target digest prefixes, e.g. known weak tokens or hashes truncated in an audit, matched besides the patterns.
+
+A file of hexadecimal prefixes, one per line, of 1 to all the nibbles of the digest, is loaded into two levels:
+- a bitmap over the first CTargetBitmapBits bits of the digest (2 MiB, so it stays in the cache), with the bits of every prefix set;
+  a prefix shorter than that sets all the bits it covers. Almost every digest is rejected by one bit, probed for all the lanes at once
+  with gathers (predicate_gate_lanes in "phpmagic_predicate.h");
+- per prefix length, the first 64 bits of the prefixes, sorted and indexed by their first CTargetIndexBits bits, so a digest that passes
+  the bitmap is looked up in a bucket of a few keys; the nibbles after the first 16 are compared after that.
+The cost of a lookup thus hardly depends on the number of prefixes, up to tens of millions.
+*/
+
+#ifndef PHPMAGIC_TARGETS_H
+#define PHPMAGIC_TARGETS_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+const unsigned int CTargetBitmapBits = 24;
+const unsigned int CTargetIndexBits = 16;
+const unsigned int CTargetMaxWords = 8;
+
+// The prefixes of one length
+typedef struct {
+    unsigned int nibbles;
+    uint64_t mask;                  // of the first 64 bits of a digest
+    std::vector<uint32_t> offsets;  // into "keys" by the first CTargetIndexBits bits, if the prefixes have as many
+    std::vector<uint64_t> keys;     // the first 64 bits of the prefixes, sorted
+    std::vector<uint32_t> tails;    // the next words of the prefixes longer than 16 nibbles, "tail_words" per key, in the order of the keys
+    unsigned int tail_words;
+} TargetGroup;
+
+typedef struct {
+    std::vector<uint32_t> bitmap;
+    std::vector<TargetGroup> groups;
+    uint64_t count;
+} TargetSet;
+
+// Loads the prefixes of a file for digests of "digest_nibbles" nibbles; returns false and the reason, with the line, if one is invalid
+bool targets_load(TargetSet* targets, const std::string& path, const unsigned int digest_nibbles, std::string* error);
+
+// The digest is given as big-endian words
+bool targets_match(const TargetSet* targets, const uint32_t digest[]);
+
+// That a random digest starts with one of the prefixes, an upper bound
+double targets_probability(const TargetSet* targets);
+
+static inline bool targets_bitmap_test(const TargetSet* targets, const uint32_t first_word)
+{
+    const uint32_t top = first_word >> (32 - CTargetBitmapBits);
+    return (targets->bitmap[top >> 5] >> (top & 31)) & 1;
+}
+
+#endif
@@ -0,0 +1,328 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Structured tokens, see "phpmagic_token.h".
+*/
+
+#include <ctype.h>
+#include <stdlib.h>
+#include "phpmagic_token.h"
+
+const uint64_t CTokenUuidEpoch = 12219292800ULL;     // seconds from 1582-10-15, the UUID epoch, to 1970-01-01
+const uint64_t CTokenUuidTicks = 10000000;           // 100 ns intervals per second
+const uint64_t CTokenDateEnd = 253402300800ULL;      // 10000-01-01, the first date with more than 4 digits of the year
+const uint64_t CTokenDateDays = CTokenDateEnd / 86400;
+
+static bool parse_number(const std::string& text, const int base, uint64_t* value)
+{
+    if (text.empty() || (text.length() > 20)) return false;
+    for (std::string::size_type i = 0; i < text.length(); ++i)
+    {
+        const char c = text[i];
+        const bool digit = (c >= '0') && (c <= '9');
+        const bool hex = ((c >= 'a') && (c <= 'f')) || ((c >= 'A') && (c <= 'F'));
+        if (!digit && !((base == 16) && hex)) return false;
+    }
+    char* end = 0;
+    *value = strtoull(text.c_str(), &end, base);
+    return *end == 0;
+}
+
+// "FROM-TO" with FROM <= TO
+static bool parse_range(const std::string& text, uint64_t* from, uint64_t* to, std::string* error)
+{
+    const std::string::size_type dash = text.find('-');
+    if ((dash == std::string::npos) || !parse_number(text.substr(0, dash), 10, from) || !parse_number(text.substr(dash + 1), 10, to) || (*from > *to))
+    {
+        *error = "the range '" + text + "' is not FROM-TO with FROM <= TO";
+        return false;
+    }
+    return true;
+}
+
+static unsigned int decimal_digits(uint64_t value)
+{
+    unsigned int digits = 1;
+    while (value >= 10)
+    {
+        value /= 10;
+        ++digits;
+    }
+    return digits;
+}
+
+static TokenField number_field(const uint64_t radix, const TokenRender render, const unsigned int offset, const unsigned int width)
+{
+    TokenField field;
+    field.radix = radix;
+    field.render = render;
+    field.offset = offset;
+    field.width = width;
+    field.civil_count = 0;
+    return field;
+}
+
+// A number of fixed digits: a field per digit, so a step rewrites one character but for the carries
+static bool parse_integer(const std::string& range, TokenFormat* format, std::string* error)
+{
+    uint64_t from, to;
+    if (!parse_range(range, &from, &to, error)) return false;
+    const unsigned int digits = decimal_digits(to);
+    if (decimal_digits(from) != digits)
+    {
+        *error = "the range '" + range + "' has numbers of " + std::to_string(decimal_digits(from)) + " and " + std::to_string(digits)
+            + " digits; token_split() makes a part of each";
+        return false;
+    }
+    format->text = std::string(digits, '0');
+    for (unsigned int d = 0; d < digits; ++d)
+    {
+        format->fields.push_back(number_field(10, token_decimal, digits - 1 - d, 1));
+    }
+    format->first = from;
+    format->keyspace = to - from + 1;
+    return true;
+}
+
+// uniqid(): the seconds and the microseconds as "%08x%05x"
+static bool parse_uniqid(const std::string& range, TokenFormat* format, std::string* error)
+{
+    uint64_t from, to;
+    if (!parse_range(range, &from, &to, error)) return false;
+    if (to > 0xffffffffULL)
+    {
+        *error = "uniqid() has 8 hexadecimal digits of the seconds, up to 4294967295";
+        return false;
+    }
+    format->text = std::string(13, '0');
+    format->fields.push_back(number_field(1000000, token_hex, 8, 5));
+    format->fields.push_back(number_field(0x100000000ULL, token_hex, 0, 8));
+    format->first = from * 1000000;
+    format->keyspace = (to - from + 1) * 1000000;
+    return true;
+}
+
+// UUID version 1: "time_low-time_mid-1time_hi-clock_seq-node" of the 100 ns intervals since the UUID epoch
+static bool parse_uuid1(const std::string& rest, TokenFormat* format, std::string* error)
+{
+    const std::string::size_type colon = rest.find(':');
+    const std::string::size_type colon2 = (colon == std::string::npos) ? std::string::npos : rest.find(':', colon + 1);
+    if (colon2 == std::string::npos)
+    {
+        *error = "a UUID is 'uuid1:FROM-TO:CLOCKSEQ:NODE'";
+        return false;
+    }
+    uint64_t from, to, value;
+    if (!parse_range(rest.substr(0, colon), &from, &to, error)) return false;
+    std::string clock_seq = rest.substr(colon + 1, colon2 - colon - 1);
+    std::string node = rest.substr(colon2 + 1);
+    if ((clock_seq.length() != 4) || (node.length() != 12) || !parse_number(clock_seq, 16, &value) || !parse_number(node, 16, &value))
+    {
+        *error = "the clock sequence and the node of a UUID are 4 and 12 hexadecimal digits";
+        return false;
+    }
+    if ((to + 1 + CTokenUuidEpoch) > (1ULL << 60) / CTokenUuidTicks)
+    {
+        *error = "the time of a UUID has 60 bits";
+        return false;
+    }
+    for (std::string::size_type i = 0; i < clock_seq.length(); ++i) clock_seq[i] = (char)tolower(clock_seq[i]);
+    for (std::string::size_type i = 0; i < node.length(); ++i) node[i] = (char)tolower(node[i]);
+    format->text = "00000000-0000-1000-" + clock_seq + "-" + node;
+    format->fields.push_back(number_field(1ULL << 32, token_hex, 0, 8));
+    format->fields.push_back(number_field(1ULL << 16, token_hex, 9, 4));
+    format->fields.push_back(number_field(1ULL << 12, token_hex, 15, 3));
+    format->first = (from + CTokenUuidEpoch) * CTokenUuidTicks;
+    format->keyspace = (to - from + 1) * CTokenUuidTicks;
+    return true;
+}
+
+// date(): the seconds, minutes and hours that the format has, and the day below them
+static bool parse_date(const std::string& rest, TokenFormat* format, std::string* error)
+{
+    const std::string::size_type colon = rest.rfind(':');
+    if ((colon == std::string::npos) || (colon == 0))
+    {
+        *error = "a date is 'date:FORMAT:FROM-TO'";
+        return false;
+    }
+    uint64_t from, to;
+    if (!parse_range(rest.substr(colon + 1), &from, &to, error)) return false;
+    if (to >= CTokenDateEnd)
+    {
+        *error = "the dates end at 9999-12-31";
+        return false;
+    }
+    const std::string pattern = rest.substr(0, colon);
+    TokenField day = number_field(CTokenDateDays, token_days, 0, 0);
+    int time_offset[3] = { -1, -1, -1 };    // H, i, s
+    bool civil_seen[4] = { false, false, false, false };   // Y, y, m, d
+    for (std::string::size_type i = 0; i < pattern.length(); ++i)
+    {
+        const char c = pattern[i];
+        const std::string::size_type time = std::string("His").find(c);
+        const std::string::size_type civil = std::string("Yymd").find(c);
+        if ((c == '\\') && (i + 1 < pattern.length()))
+        {
+            format->text += pattern[++i];
+        }
+        else if (time != std::string::npos)
+        {
+            if (time_offset[time] >= 0)
+            {
+                *error = std::string("the date format has '") + c + "' more than once";
+                return false;
+            }
+            time_offset[time] = (int)format->text.length();
+            format->text += "00";
+        }
+        else if (civil != std::string::npos)
+        {
+            if (day.civil_count == CTokenMaxCivil)
+            {
+                *error = "the date format has more than " + std::to_string(CTokenMaxCivil) + " of Y, y, m and d";
+                return false;
+            }
+            civil_seen[civil] = true;
+            day.civil_code[day.civil_count] = c;
+            day.civil_offset[day.civil_count++] = (unsigned int)format->text.length();
+            format->text += (c == 'Y') ? "0000" : "00";
+        }
+        else if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')))
+        {
+            *error = std::string("the date format character '") + c + "' is not supported, only Y, y, m, d, H, i and s";
+            return false;
+        }
+        else
+        {
+            format->text += c;
+        }
+    }
+    if (!(civil_seen[0] || civil_seen[1]) || !civil_seen[2] || !civil_seen[3])
+    {
+        *error = "the date format needs the year (Y or y), the month (m) and the day (d)";
+        return false;
+    }
+    // the candidates step by the smallest unit, and the units down to it must all be there, or a step would repeat a date
+    static const uint64_t radix[3] = { 24, 60, 60 };
+    static const uint64_t unit[4] = { 86400, 3600, 60, 1 };
+    unsigned int units = 0;
+    while ((units < 3) && (time_offset[units] >= 0)) ++units;
+    for (unsigned int t = units; t < 3; ++t)
+    {
+        if (time_offset[t] >= 0)
+        {
+            *error = "the date format has '" + std::string(1, "His"[t]) + "' without '" + std::string(1, "His"[t - 1]) + "'";
+            return false;
+        }
+    }
+    for (unsigned int t = units; t > 0; --t)
+    {
+        format->fields.push_back(number_field(radix[t - 1], token_decimal, (unsigned int)time_offset[t - 1], 2));
+    }
+    format->fields.push_back(day);
+    format->first = from / unit[units];
+    format->keyspace = to / unit[units] - from / unit[units] + 1;
+    return true;
+}
+
+bool token_parse(const std::string& spec, TokenFormat* format, std::string* error)
+{
+    const std::string::size_type colon = spec.find(':');
+    const std::string rest = (colon == std::string::npos) ? std::string() : spec.substr(colon + 1);
+    format->family = spec.substr(0, colon);
+    format->text.clear();
+    format->fields.clear();
+    bool valid;
+    if ((format->family == "integer") || (format->family == "timestamp"))
+    {
+        valid = parse_integer(rest, format, error);
+    }
+    else if (format->family == "uniqid")
+    {
+        valid = parse_uniqid(rest, format, error);
+    }
+    else if (format->family == "uuid1")
+    {
+        valid = parse_uuid1(rest, format, error);
+    }
+    else if (format->family == "date")
+    {
+        valid = parse_date(rest, format, error);
+    }
+    else
+    {
+        *error = "unknown token '" + format->family + "', it is integer, timestamp, uniqid, uuid1 or date";
+        valid = false;
+    }
+    if (valid && (format->fields.size() > CTokenMaxFields))
+    {
+        *error = "the token has more than " + std::to_string(CTokenMaxFields) + " fields";
+        valid = false;
+    }
+    if (!valid)
+    {
+        *error = "token '" + spec + "': " + *error;
+    }
+    return valid;
+}
+
+bool token_split(const std::string& spec, std::vector<std::string>* parts, std::string* error)
+{
+    parts->clear();
+    const std::string::size_type colon = spec.find(':');
+    const std::string family = spec.substr(0, colon);
+    if ((colon != std::string::npos) && ((family == "integer") || (family == "timestamp")))
+    {
+        uint64_t from, to;
+        if (!parse_range(spec.substr(colon + 1), &from, &to, error))
+        {
+            *error = "token '" + spec + "': " + *error;
+            return false;
+        }
+        // [10^(d-1), 10^d - 1] for each number of digits d, 0 with the one-digit numbers
+        uint64_t begin = from;
+        for (;;)
+        {
+            const unsigned int digits = decimal_digits(begin);
+            uint64_t last = 9;
+            for (unsigned int d = 1; d < digits; ++d) last = last * 10 + 9;
+            const uint64_t end = (last < to) ? last : to;
+            parts->push_back(family + ":" + std::to_string(begin) + "-" + std::to_string(end));
+            if (end == to) break;
+            begin = end + 1;
+        }
+        return true;
+    }
+    TokenFormat format;
+    if (!token_parse(spec, &format, error)) return false;
+    parts->push_back(spec);
+    return true;
+}
+
+void token_civil(int64_t days, int64_t* year, unsigned int* month, unsigned int* day)
+{
+    days += 719468;
+    const int64_t era = ((days >= 0) ? days : days - 146096) / 146097;
+    const uint64_t day_of_era = (uint64_t)(days - era * 146097);
+    const uint64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    const uint64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    const uint64_t month_from_march = (5 * day_of_year + 2) / 153;
+    *day = (unsigned int)(day_of_year - (153 * month_from_march + 2) / 5 + 1);
+    *month = (unsigned int)((month_from_march < 10) ? month_from_march + 3 : month_from_march - 9);
+    *year = (int64_t)year_of_era + era * 400 + ((*month <= 2) ? 1 : 0);
+}
+
+void token_set(const TokenFormat* format, const uint64_t index, TokenCounter* counter, unsigned char* candidate)
+{
+    format->text.copy((char*)candidate, format->text.length());
+    uint64_t value = format->first + index;
+    for (std::vector<TokenField>::size_type f = 0; f < format->fields.size(); ++f)
+    {
+        counter->values[f] = value % format->fields[f].radix;
+        value /= format->fields[f].radix;
+        token_render(&format->fields[f], counter->values[f], candidate);
+    }
+}
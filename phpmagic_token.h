@@ -0,0 +1,150 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Structured tokens: candidates in the formats PHP applications hash, instead of all the strings of a character set.
+
+    integer:MIN-MAX                  decimal numbers, e.g. user IDs, without leading zeros
+    timestamp:FROM-TO                Unix timestamps, the same as integer
+    uniqid:FROM-TO                   uniqid() in the seconds FROM to TO, every microsecond: "%08x%05x" of the seconds and the microseconds
+    uuid1:FROM-TO:CLOCKSEQ:NODE      time-based UUIDs in the seconds FROM to TO, every 100 ns, with the clock sequence and the node as 4 and
+                                     12 hexadecimal digits, e.g. "uuid1:1700000000-1700000009:9f3c:0242ac110002"
+    date:FORMAT:FROM-TO              date() (gmdate(), UTC) in the seconds FROM to TO, FORMAT with Y, y, m, d, H, i and s; a character after
+                                     "\" is taken as is. The candidates step by the smallest unit of the format, a second, a minute, an hour or
+                                     a day, which must be there with the larger ones down from the day, e.g. "Y-m-d H:i" but not "Y-m-d s"
+
+A token is a counter over fields, the least significant first, each with its radix and its place in the token: e.g. uniqid() has the
+microseconds (radix 1000000, 5 hexadecimal characters from offset 8) and the seconds (radix 2^32, 8 characters from offset 0). The constant
+characters between the fields are in the template, which is copied into the message once, so the next candidate only rewrites the fields that
+changed, in place in the message. The range of a spec is a window of the counter, so a candidate index is an offset from its first candidate
+and the ranges are split between the processors by index, as for the character sets.
+
+The candidates of a format have a fixed length; integer and timestamp ranges over several numbers of digits are split into parts by
+token_split(), one configuration each.
+*/
+
+#ifndef PHPMAGIC_TOKEN_H
+#define PHPMAGIC_TOKEN_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+const unsigned int CTokenMaxFields = 20;
+const unsigned int CTokenMaxCivil = 8;
+
+enum TokenRender { token_decimal, token_hex, token_days };
+
+typedef struct {
+    uint64_t radix;
+    TokenRender render;
+    unsigned int offset;                    // decimal and hex: the characters of the field
+    unsigned int width;
+    unsigned int civil_count;               // days: the days since 1970-01-01 rendered as the Y, y, m and d of the format
+    char civil_code[CTokenMaxCivil];
+    unsigned int civil_offset[CTokenMaxCivil];
+} TokenField;
+
+typedef struct {
+    std::string family;
+    std::string text;                  // the template, the fields are written over it
+    std::vector<TokenField> fields;    // the least significant first
+    uint64_t first;                    // the counter of the candidate 0
+    uint64_t keyspace;
+} TokenFormat;
+
+typedef struct {
+    uint64_t values[CTokenMaxFields];
+} TokenCounter;
+
+// A spec of one fixed-width part; false with the reason otherwise
+bool token_parse(const std::string& spec, TokenFormat* format, std::string* error);
+
+// The parts of a spec of a fixed width each: integer and timestamp ranges by their numbers of digits, the other specs as they are
+bool token_split(const std::string& spec, std::vector<std::string>* parts, std::string* error);
+
+// Writes the whole candidate "index" of the format into "candidate" and sets the counter to it
+void token_set(const TokenFormat* format, const uint64_t index, TokenCounter* counter, unsigned char* candidate);
+
+// The date of the days since 1970-01-01, proleptic Gregorian
+void token_civil(int64_t days, int64_t* year, unsigned int* month, unsigned int* day);
+
+inline void token_render(const TokenField* field, uint64_t value, unsigned char* candidate)
+{
+    static const char digits[16 + 1] = "0123456789abcdef";
+    if (field->render == token_decimal)
+    {
+        for (unsigned int i = field->width; i > 0; --i)
+        {
+            candidate[field->offset + i - 1] = (unsigned char)('0' + value % 10);
+            value /= 10;
+        }
+    }
+    else if (field->render == token_hex)
+    {
+        for (unsigned int i = field->width; i > 0; --i)
+        {
+            candidate[field->offset + i - 1] = (unsigned char)digits[value & 15];
+            value >>= 4;
+        }
+    }
+    else
+    {
+        int64_t year;
+        unsigned int month, day;
+        token_civil((int64_t)value, &year, &month, &day);
+        for (unsigned int c = 0; c < field->civil_count; ++c)
+        {
+            unsigned char* out = candidate + field->civil_offset[c];
+            switch (field->civil_code[c])
+            {
+            case 'Y':
+                out[0] = (unsigned char)('0' + year / 1000); out[1] = (unsigned char)('0' + year / 100 % 10);
+                out[2] = (unsigned char)('0' + year / 10 % 10); out[3] = (unsigned char)('0' + year % 10);
+                break;
+            case 'y':
+                out[0] = (unsigned char)('0' + year / 10 % 10); out[1] = (unsigned char)('0' + year % 10);
+                break;
+            case 'm':
+                out[0] = (unsigned char)('0' + month / 10); out[1] = (unsigned char)('0' + month % 10);
+                break;
+            default:
+                out[0] = (unsigned char)('0' + day / 10); out[1] = (unsigned char)('0' + day % 10);
+                break;
+            }
+        }
+    }
+}
+
+// The next candidate: rewrites the fields that change, a number by adding 1 to its characters, which mostly changes the last one
+inline void token_next(const TokenFormat* format, TokenCounter* counter, unsigned char* candidate)
+{
+    const TokenField* fields = format->fields.data();
+    const unsigned int count = (unsigned int)format->fields.size();
+    for (unsigned int f = 0; f < count; ++f)
+    {
+        if (++counter->values[f] < fields[f].radix)
+        {
+            if (fields[f].render == token_days)
+            {
+                token_render(&fields[f], counter->values[f], candidate);
+                return;
+            }
+            const unsigned char last = (fields[f].render == token_hex) ? 'f' : '9';
+            for (unsigned char* c = candidate + fields[f].offset + fields[f].width - 1; ; --c)
+            {
+                if (*c != last)
+                {
+                    *c = (*c == '9') ? 'a' : *c + 1;
+                    return;
+                }
+                *c = '0';
+            }
+        }
+        counter->values[f] = 0;
+        token_render(&fields[f], 0, candidate);
+    }
+}
+
+#endif
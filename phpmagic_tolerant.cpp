@@ -0,0 +1,305 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Fault-tolerant search, see "phpmagic_tolerant.h".
+*/
+
+#ifndef DISABLE_MPI
+#include <mpi.h>
+#endif
+#include <unistd.h>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <vector>
+#include "phpmagic_tolerant.h"
+
+const uint64_t CTolerantUnit = 1 << 24;   // candidates handed out at a time
+// hits stored per call of the engine; without "mpi_continue" the search stops at the first solution, as in the other modes
+#ifdef mpi_continue
+const unsigned int CTolerantMaxHits = 16;
+#else
+const unsigned int CTolerantMaxHits = 1;
+#endif
+const unsigned int CTolerantIdleWait = 10000;  // microseconds processor 0 sleeps between its checks
+
+const int CTolerantTagUnit = 11;
+const int CTolerantTagStop = 12;
+const int CTolerantTagProgress = 13;
+
+enum { tolerant_running, tolerant_done, tolerant_found, tolerant_stopped, tolerant_error };
+
+// The heartbeat of a processor: how far it has got in its unit
+typedef struct {
+    uint64_t start;
+    uint64_t count;
+    uint64_t hashed;
+    uint64_t status;
+} TolerantProgress;
+
+typedef std::chrono::steady_clock TolerantClock;
+
+// Hashes a unit; the processors other than 0 report their progress and stop if processor 0 tells them to
+static int hash_unit(const TolerantJob* job, const uint64_t start, const uint64_t count, const int mpi_current)
+{
+    phpmagic_hit hits[CTolerantMaxHits];
+    phpmagic_results results;
+    results.hits = hits;
+    results.capacity = CTolerantMaxHits;
+#ifndef DISABLE_MPI
+    TolerantClock::time_point last_report = TolerantClock::now();
+#endif
+    uint64_t hashed = 0;
+    while (hashed < count)
+    {
+        const uint64_t chunk = (count - hashed > job->poll) ? job->poll : count - hashed;
+        uint64_t done = 0;
+        while (done < chunk)
+        {
+            const uint64_t batch = (chunk - done > job->batch) ? job->batch : chunk - done;
+            if (phpmagic_search_range(job->config, start + hashed + done, batch, &results) != 0)
+            {
+                std::cerr << "Engine error: the digest of '" << hits[results.count].message << "' does not match the reference implementation" << std::endl;
+                return tolerant_error;
+            }
+            if (job->report(job->context, &results))
+            {
+                return tolerant_found;
+            }
+            if (results.hashes == 0) break;
+            done += results.hashes;
+        }
+        hashed += chunk;
+#ifndef DISABLE_MPI
+        if ((mpi_current != 0) && (hashed < count))
+        {
+            int stop = 0;
+            MPI_Iprobe(0, CTolerantTagStop, MPI_COMM_WORLD, &stop, MPI_STATUS_IGNORE);
+            if (stop)
+            {
+                MPI_Recv(0, 0, MPI_BYTE, 0, CTolerantTagStop, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                return tolerant_stopped;
+            }
+            const TolerantClock::time_point now = TolerantClock::now();
+            if (std::chrono::duration_cast<std::chrono::milliseconds>(now - last_report).count() >= job->timeout * 250)
+            {
+                TolerantProgress progress = { start, count, hashed, tolerant_running };
+                MPI_Send(&progress, sizeof(progress), MPI_BYTE, 0, CTolerantTagProgress, MPI_COMM_WORLD);
+                last_report = now;
+            }
+        }
+#endif
+    }
+    return tolerant_done;
+}
+
+#ifndef DISABLE_MPI
+static bool tolerant_worker(const TolerantJob* job, const int mpi_current, bool* found)
+{
+    while (true)
+    {
+        MPI_Status status;
+        if (MPI_Probe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &status) != MPI_SUCCESS)
+        {
+            std::cerr << "Processor " << mpi_current << " has lost processor 0" << std::endl;
+            return false;
+        }
+        if (status.MPI_TAG == CTolerantTagStop)
+        {
+            MPI_Recv(0, 0, MPI_BYTE, 0, CTolerantTagStop, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            return true;
+        }
+        uint64_t unit[2];
+        MPI_Recv(unit, sizeof(unit), MPI_BYTE, 0, CTolerantTagUnit, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        const int result = hash_unit(job, unit[0], unit[1], mpi_current);
+        TolerantProgress progress = { unit[0], unit[1], (result == tolerant_done) ? unit[1] : 0, (uint64_t)result };
+        if (MPI_Send(&progress, sizeof(progress), MPI_BYTE, 0, CTolerantTagProgress, MPI_COMM_WORLD) != MPI_SUCCESS)
+        {
+            std::cerr << "Processor " << mpi_current << " has lost processor 0" << std::endl;
+            return false;
+        }
+        if (result == tolerant_found) *found = true;
+        if (result == tolerant_error) return false;
+        if (result == tolerant_stopped) return true;
+    }
+}
+#endif
+
+// A processor as processor 0 sees it
+typedef struct {
+    bool alive;
+    bool busy;
+    bool stop_sent;
+    uint64_t start;
+    uint64_t count;
+    uint64_t hashed;
+    TolerantClock::time_point last_seen;
+} TolerantPeer;
+
+static bool tolerant_coordinator(const TolerantJob* job, const int mpi_total, bool* found, unsigned int* failed)
+{
+    std::deque<std::pair<uint64_t, uint64_t> > ranges;  // not handed out yet, [begin, end)
+    if (job->end > 0)
+    {
+        ranges.push_back(std::make_pair((uint64_t)0, job->end));
+    }
+    std::vector<TolerantPeer> peers(mpi_total);
+    for (int w = 1; w < mpi_total; ++w)
+    {
+        peers[w].alive = true;
+        peers[w].busy = false;
+        peers[w].stop_sent = false;
+    }
+    bool stopping = false;
+    bool engine_error = false;
+    *failed = 0;
+
+    while (true)
+    {
+        // the heartbeats and the ends of the units
+#ifndef DISABLE_MPI
+        int flag = 1;
+        while (flag)
+        {
+            MPI_Status status;
+            if ((MPI_Iprobe(MPI_ANY_SOURCE, CTolerantTagProgress, MPI_COMM_WORLD, &flag, &status) != MPI_SUCCESS) || !flag) break;
+            TolerantProgress progress;
+            MPI_Recv(&progress, sizeof(progress), MPI_BYTE, status.MPI_SOURCE, CTolerantTagProgress, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            TolerantPeer& peer = peers[status.MPI_SOURCE];
+            if (!peer.alive)
+            {
+                // taken as failed but only slow: its unit has been handed out again, so it is stopped
+                if (!peer.stop_sent)
+                {
+                    MPI_Send(0, 0, MPI_BYTE, status.MPI_SOURCE, CTolerantTagStop, MPI_COMM_WORLD);
+                    peer.stop_sent = true;
+                }
+                continue;
+            }
+            peer.last_seen = TolerantClock::now();
+            if (!peer.busy || (progress.start != peer.start)) continue;
+            if (progress.status == tolerant_running)
+            {
+                peer.hashed = progress.hashed;
+                continue;
+            }
+            peer.busy = false;
+            if ((progress.status == tolerant_found) || (progress.status == tolerant_error))
+            {
+                *found = *found || (progress.status == tolerant_found);
+                engine_error = engine_error || (progress.status == tolerant_error);
+                stopping = true;
+            }
+            else if (progress.status == tolerant_stopped)
+            {
+                peer.stop_sent = true;
+            }
+        }
+#endif
+
+        // the processors not heard of for the timeout are taken as failed
+        const TolerantClock::time_point now = TolerantClock::now();
+        for (int w = 1; w < mpi_total; ++w)
+        {
+            TolerantPeer& peer = peers[w];
+            if (!peer.alive || !peer.busy) continue;
+            if (std::chrono::duration_cast<std::chrono::seconds>(now - peer.last_seen).count() < job->timeout) continue;
+            peer.alive = false;
+            peer.busy = false;
+            ++*failed;
+            std::cout << "Processor " << w << " has not been heard of for " << job->timeout << " seconds; its candidates from " << peer.start + peer.hashed
+                << " to " << peer.start + peer.count << " go back to the queue" << std::endl;
+            ranges.push_front(std::make_pair(peer.start + peer.hashed, peer.start + peer.count));
+        }
+
+        // the idle processors get the next units, or are stopped
+        bool any_alive = false;
+        bool any_busy = false;
+        for (int w = 1; w < mpi_total; ++w)
+        {
+            TolerantPeer& peer = peers[w];
+            if (!peer.alive) continue;
+            any_alive = true;
+#ifndef DISABLE_MPI
+            if (stopping && !peer.stop_sent)
+            {
+                // a busy processor answers with its last progress
+                MPI_Send(0, 0, MPI_BYTE, w, CTolerantTagStop, MPI_COMM_WORLD);
+                peer.stop_sent = true;
+            }
+            if (!stopping && !peer.busy && !ranges.empty())
+            {
+                std::pair<uint64_t, uint64_t>& range = ranges.front();
+                uint64_t unit[2];
+                unit[0] = range.first;
+                unit[1] = (range.second - range.first > CTolerantUnit) ? CTolerantUnit : range.second - range.first;
+                range.first += unit[1];
+                if (range.first == range.second) ranges.pop_front();
+                peer.start = unit[0];
+                peer.count = unit[1];
+                peer.hashed = 0;
+                peer.busy = true;
+                peer.last_seen = now;
+                if (MPI_Send(unit, sizeof(unit), MPI_BYTE, w, CTolerantTagUnit, MPI_COMM_WORLD) != MPI_SUCCESS)
+                {
+                    // the next round takes it as failed at once
+                    peer.last_seen = now - std::chrono::seconds(job->timeout);
+                }
+            }
+#endif
+            any_busy = any_busy || peer.busy;
+        }
+
+        if (!any_busy && (stopping || ranges.empty()))
+        {
+            break;
+        }
+        if (!any_alive && !ranges.empty())
+        {
+            // no processor is left, so processor 0 hashes the rest
+            std::pair<uint64_t, uint64_t>& range = ranges.front();
+            const uint64_t count = (range.second - range.first > CTolerantUnit) ? CTolerantUnit : range.second - range.first;
+            const int result = hash_unit(job, range.first, count, 0);
+            range.first += count;
+            if (range.first == range.second) ranges.pop_front();
+            if ((result == tolerant_found) || (result == tolerant_error))
+            {
+                *found = *found || (result == tolerant_found);
+                engine_error = engine_error || (result == tolerant_error);
+                stopping = true;
+            }
+            continue;
+        }
+        usleep(CTolerantIdleWait);
+    }
+
+#ifndef DISABLE_MPI
+    for (int w = 1; w < mpi_total; ++w)
+    {
+        if (!peers[w].stop_sent)
+        {
+            MPI_Send(0, 0, MPI_BYTE, w, CTolerantTagStop, MPI_COMM_WORLD);
+        }
+    }
+#endif
+    if (*failed > 0)
+    {
+        std::cout << *failed << " of " << mpi_total - 1 << " processor(s) failed; their candidates were hashed by the others" << std::endl;
+    }
+    return !engine_error;
+}
+
+bool tolerant_search(const TolerantJob* job, const int mpi_current, const int mpi_total, bool* found, unsigned int* failed)
+{
+    *failed = 0;
+#ifndef DISABLE_MPI
+    MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_RETURN);
+    if (mpi_current != 0)
+    {
+        return tolerant_worker(job, mpi_current, found);
+    }
+#endif
+    return tolerant_coordinator(job, mpi_total, found, failed);
+}
@@ -0,0 +1,41 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Fault-tolerant search: "--fault-tolerant" keeps the search going when processors die.
+
+Processor 0 hands the keyspace out in units of CTolerantUnit candidates and keeps the range of every unit in flight. The other processors hash
+their units and report their progress to processor 0 at least every quarter of the heartbeat timeout; a processor that has not been heard of
+for the whole timeout is taken as failed and the part of its unit it has not reported goes back to the queue for the survivors.
+If no processor is left, processor 0 hashes the rest itself.
+
+MPI_COMM_WORLD gets MPI_ERRORS_RETURN, so an error of a peer is returned rather than aborting the job; Open MPI also has to be told not to
+tear the job down when a process dies: "mpirun --mca orte_enable_recovery 1". Processor 0 itself must survive. MPI_Finalize() of Open MPI 4
+may wait for the dead processes forever, so the caller ends a run with failures by MPI_Abort() once the keyspace is done.
+*/
+
+#ifndef PHPMAGIC_TOLERANT_H
+#define PHPMAGIC_TOLERANT_H
+
+#include <stdint.h>
+#include "phpmagic_search.h"
+
+// Prints the hits of a unit on the processor that found them; returns true if the search is to stop
+typedef bool (*TolerantReport)(const void* context, const phpmagic_results* results);
+
+typedef struct {
+    const phpmagic_config* config;
+    uint64_t end;                 // the keyspace searched is from 0 to "end"
+    unsigned int timeout;         // seconds of silence after which a processor is taken as failed
+    uint64_t batch;               // candidates per call of phpmagic_search_range()
+    uint64_t poll;                // candidates hashed between the checks for a heartbeat or a stop
+    TolerantReport report;
+    const void* context;
+} TolerantJob;
+
+// Runs on every processor; returns false on an engine error, sets "found" if the search stopped at a hit and, on processor 0,
+// "failed" to the number of the processors taken as failed
+bool tolerant_search(const TolerantJob* job, const int mpi_current, const int mpi_total, bool* found, unsigned int* failed);
+
+#endif
@@ -0,0 +1,268 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Start-up tuning, see "phpmagic_tune.h".
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include "hash_mb.h"
+#include "phpmagic_tune.h"
+
+const unsigned int CTuneSampleMs = 150;     // of hashing per engine
+const unsigned int CTuneBatchSampleMs = 50; // of hashing per batch size
+const uint64_t CTuneEngineBatch = 1 << 18;
+const unsigned int CTunePollMs = 100;
+const double CTuneTolerance = 0.02;
+const uint64_t CTuneMinBatch = 1 << 10;
+const uint64_t CTuneMaxBatch = 1 << 22;
+const unsigned int CTuneMaxHits = 16;
+
+typedef std::chrono::steady_clock TuneClock;
+
+std::string tune_default_path(const std::string& processor_name)
+{
+    const char* home = getenv("HOME");
+    return std::string((home && *home) ? home : ".") + "/.phpmagic-tune-" + processor_name;
+}
+
+static std::string cpu_model()
+{
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line))
+    {
+        if (line.compare(0, 10, "model name") == 0)
+        {
+            const std::string::size_type colon = line.find(':');
+            if (colon != std::string::npos)
+            {
+                const std::string::size_type start = line.find_first_not_of(' ', colon + 1);
+                return (start == std::string::npos) ? std::string() : line.substr(start);
+            }
+        }
+    }
+    return "unknown CPU";
+}
+
+// The settings depend on the CPU, the build and the shape of the message, not on its contents
+static std::string tune_key(const phpmagic_options* options)
+{
+    std::ostringstream key;
+    key << cpu_model() << "|lanes " << CMbLanes << "|" << (options->hash ? options->hash : "sha1")
+        << "|prefix " << (options->salt_prefix ? strlen(options->salt_prefix) : 0)
+        << "|message " << (options->base ? strlen(options->base) : 0) + options->length
+        << "|suffix " << (options->salt_suffix ? strlen(options->salt_suffix) : 0)
+        << "|hmac " << (options->hmac_key ? "key" : (options->hmac_message ? "message" : "none"))
+        << "|engine " << options->engine;
+    return key.str();
+}
+
+static bool parse_profile(const std::string& fields, TuneProfile* profile)
+{
+    bool has_engine = false, has_batch = false, has_poll = false;
+    std::istringstream stream(fields);
+    std::string field;
+    while (std::getline(stream, field, '\t'))
+    {
+        const std::string::size_type eq = field.find('=');
+        if (eq == std::string::npos) continue;
+        const std::string name = field.substr(0, eq);
+        const std::string value = field.substr(eq + 1);
+        if (name == "engine")
+        {
+            has_engine = (value == "single") || (value == "multibuffer");
+            profile->engine = (value == "single") ? PHPMAGIC_ENGINE_SINGLE : PHPMAGIC_ENGINE_MULTIBUFFER;
+        }
+        else if (name == "jit")
+        {
+            profile->jit = (value == "1") ? 1 : 0;
+        }
+        else if (name == "batch")
+        {
+            profile->batch = strtoull(value.c_str(), 0, 10);
+            has_batch = profile->batch > 0;
+        }
+        else if (name == "poll")
+        {
+            profile->poll = strtoull(value.c_str(), 0, 10);
+            has_poll = profile->poll > 0;
+        }
+        else if (name == "rate")
+        {
+            profile->rate = strtod(value.c_str(), 0);
+        }
+    }
+    return has_engine && has_batch && has_poll;
+}
+
+static bool load_profile(const std::string& path, const std::string& key, TuneProfile* profile)
+{
+    std::ifstream file(path.c_str());
+    std::string line;
+    while (std::getline(file, line))
+    {
+        const std::string::size_type tab = line.find('\t');
+        if ((tab != std::string::npos) && (line.compare(0, tab, key) == 0) && (tab == key.length()))
+        {
+            return parse_profile(line.substr(tab + 1), profile);
+        }
+    }
+    return false;
+}
+
+// Replaces the line of the key; the file is renamed into place, so the processors of a host that tune at once do not mix their lines
+static bool save_profile(const std::string& path, const std::string& key, const TuneProfile* profile)
+{
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(path.c_str());
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.compare(0, key.length() + 1, key + "\t") != 0) lines.push_back(line);
+        }
+    }
+    std::ostringstream entry;
+    entry << key << "\tengine=" << ((profile->engine == PHPMAGIC_ENGINE_SINGLE) ? "single" : "multibuffer") << "\tjit=" << profile->jit
+        << "\tbatch=" << profile->batch << "\tpoll=" << profile->poll << "\trate=" << (uint64_t)profile->rate;
+    lines.push_back(entry.str());
+
+    std::ostringstream temp_path;
+    temp_path << path << "." << getpid();
+    {
+        std::ofstream file(temp_path.str().c_str());
+        for (std::vector<std::string>::size_type i = 0; i < lines.size(); ++i)
+        {
+            file << lines[i] << "\n";
+        }
+        if (!file.good()) return false;
+    }
+    if (rename(temp_path.str().c_str(), path.c_str()) != 0)
+    {
+        unlink(temp_path.str().c_str());
+        return false;
+    }
+    return true;
+}
+
+// Hashes in calls of "batch" candidates for about "milliseconds"; 0 if the engine disagrees with the reference implementation
+static double time_rate(const phpmagic_config* config, const uint64_t batch, const unsigned int milliseconds)
+{
+    phpmagic_hit hits[CTuneMaxHits];
+    phpmagic_results results;
+    results.hits = hits;
+    results.capacity = CTuneMaxHits;
+    const uint64_t keyspace = phpmagic_keyspace(config);
+    const TuneClock::time_point begin = TuneClock::now();
+    TuneClock::time_point now = begin;
+    uint64_t index = 0;
+    uint64_t hashed = 0;
+    while (std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count() < milliseconds)
+    {
+        if (phpmagic_search_range(config, index, batch, &results) != 0)
+        {
+            return 0;
+        }
+        // the keyspace may be smaller than a sample
+        index = ((results.hashes == 0) || (index + results.hashes >= keyspace)) ? 0 : index + results.hashes;
+        hashed += results.hashes;
+        now = TuneClock::now();
+    }
+    return hashed / std::chrono::duration<double>(now - begin).count();
+}
+
+bool tune_search(const phpmagic_options* options, const std::string& path, TuneProfile* profile, std::string* error)
+{
+    const std::string key = tune_key(options);
+    if (load_profile(path, key, profile))
+    {
+        profile->cached = true;
+        return true;
+    }
+    profile->cached = false;
+
+    // the engines, with and without the JIT; the one that falls back to the static engine is timed again, which does no harm
+    phpmagic_options trial = *options;
+    phpmagic_config* best = 0;
+    profile->rate = 0;
+    for (int engine = PHPMAGIC_ENGINE_SINGLE; engine <= PHPMAGIC_ENGINE_MULTIBUFFER; ++engine)
+    {
+        if ((options->engine != PHPMAGIC_ENGINE_AUTO) && (options->engine != engine)) continue;
+        for (int jit = 0; jit <= 1; ++jit)
+        {
+            trial.engine = engine;
+            trial.jit = jit;
+            char config_error[256];
+            phpmagic_config* config = phpmagic_config_new(&trial, config_error, sizeof(config_error));
+            if (!config)
+            {
+                *error = config_error;
+                continue;
+            }
+            const double rate = time_rate(config, CTuneEngineBatch, CTuneSampleMs);
+            if (rate > profile->rate)
+            {
+                profile->rate = rate;
+                profile->engine = engine;
+                profile->jit = jit;
+                if (best) phpmagic_config_free(best);
+                best = config;
+            }
+            else
+            {
+                phpmagic_config_free(config);
+            }
+        }
+    }
+    if (!best)
+    {
+        if (error->empty()) *error = "no engine agrees with the reference implementation";
+        return false;
+    }
+
+    // the fewest candidates per call that lose no more than CTuneTolerance, so the processors check for a stop often
+    std::vector<double> rates;
+    double best_rate = 0;
+    for (uint64_t batch = CTuneMinBatch; batch <= CTuneMaxBatch; batch *= 4)
+    {
+        rates.push_back(time_rate(best, batch, CTuneBatchSampleMs));
+        if (rates.back() > best_rate) best_rate = rates.back();
+    }
+    profile->batch = CTuneMaxBatch;
+    for (uint64_t batch = CTuneMinBatch, i = 0; batch <= CTuneMaxBatch; batch *= 4, ++i)
+    {
+        if (rates[i] >= best_rate * (1 - CTuneTolerance))
+        {
+            profile->batch = batch;
+            break;
+        }
+    }
+    phpmagic_config_free(best);
+    if (best_rate > profile->rate) profile->rate = best_rate;
+
+    // a power of two of candidates for about CTunePollMs
+    profile->poll = profile->batch;
+    while ((profile->poll < (uint64_t)1 << 40) && (profile->poll * 2 <= profile->rate * CTunePollMs / 1000))
+    {
+        profile->poll *= 2;
+    }
+
+    if (!save_profile(path, key, profile))
+    {
+        *error = "cannot write the profile '" + path + "'";
+    }
+    else
+    {
+        error->clear();
+    }
+    return true;
+}
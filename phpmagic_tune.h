@@ -0,0 +1,39 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Start-up tuning: "--autotune" picks the fastest settings of the search for the CPU it runs on.
+
+Each processor times short runs of its own search: the single-buffer and multi-buffer engines, each with and without the JIT, then the
+candidates per call of phpmagic_search_range() for the fastest of them (the smallest count within CTuneTolerance of the best rate, as each call
+sets the lanes up again) and the candidates between the checks for a stop or a heartbeat (about CTunePollMs of hashing). The lanes of the
+multi-buffer engine are fixed when the application is compiled, so they are not tuned.
+
+The result is kept in a per-host profile, one line per CPU model and message shape, so the next runs on the host load it instead of timing.
+*/
+
+#ifndef PHPMAGIC_TUNE_H
+#define PHPMAGIC_TUNE_H
+
+#include <stdint.h>
+#include <string>
+#include "phpmagic_search.h"
+
+typedef struct {
+    int engine;        // PHPMAGIC_ENGINE_SINGLE or PHPMAGIC_ENGINE_MULTIBUFFER
+    int jit;
+    uint64_t batch;    // candidates per call of phpmagic_search_range()
+    uint64_t poll;     // candidates between the checks for a stop or a heartbeat
+    double rate;       // hashes per second, as timed
+    bool cached;       // loaded from the profile rather than timed
+} TuneProfile;
+
+// The profile of the host if none is given: ".phpmagic-tune-HOST" in the home directory
+std::string tune_default_path(const std::string& processor_name);
+
+// Loads the settings for the options from the profile, or times them and stores them there; "options.engine" is kept if it is not
+// PHPMAGIC_ENGINE_AUTO. Returns false with the reason if no engine accepts the options; a profile that cannot be written is only reported.
+bool tune_search(const phpmagic_options* options, const std::string& path, TuneProfile* profile, std::string* error);
+
+#endif
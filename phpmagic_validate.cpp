@@ -0,0 +1,289 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Online validation, see "phpmagic_validate.h".
+*/
+
+#ifndef DISABLE_MPI
+#include <mpi.h>
+#endif
+#include <math.h>
+#include <string.h>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <vector>
+#include "phpmagic_validate.h"
+
+const unsigned int CValidateSamples = 4;          // near misses sent per report
+const double CValidateMinExpected = 1000;         // near misses expected before the rate of a processor is judged
+
+const int CValidateTagReport = 51;
+
+// The counts of a processor since it started, and the samples since its last report
+typedef struct {
+    uint64_t hashed;
+    uint64_t near_misses;
+    double seconds;
+    uint32_t final;
+    uint32_t sample_count;
+    phpmagic_hit samples[CValidateSamples];
+} ValidateReport;
+
+// What processor 0 knows of a processor
+typedef struct {
+    std::string name;
+    ValidateReport last;
+    uint64_t samples_checked;
+    uint64_t samples_wrong;
+    bool rate_flagged;
+} ValidateProcessor;
+
+typedef std::chrono::steady_clock ValidateClock;
+
+struct ValidateGroup {
+    const phpmagic_config* config;
+    unsigned int interval;
+    double probability;
+    int rank;
+    int size;
+#ifndef DISABLE_MPI
+    MPI_Comm comm;
+#endif
+    ValidateReport own;
+    ValidateClock::time_point begin;
+    ValidateClock::time_point last_report;
+    // on processor 0
+    std::vector<ValidateProcessor> processors;
+    unsigned int finished;
+    ValidateClock::time_point last_print;
+};
+
+static bool flagged(const ValidateProcessor* processor)
+{
+    return (processor->samples_wrong > 0) || processor->rate_flagged;
+}
+
+// Processor 0: the samples again with the reference implementation, and the near misses against those expected
+static void take_report(ValidateGroup* group, const int rank, const ValidateReport* report)
+{
+    ValidateProcessor* processor = &(group->processors[rank]);
+    processor->last = *report;
+    if (report->final) ++group->finished;
+    for (unsigned int s = 0; s < report->sample_count; ++s)
+    {
+        const phpmagic_hit* sample = &(report->samples[s]);
+        char message[PHPMAGIC_MAX_MESSAGE + 1];
+        phpmagic_message(group->config, sample->index, message);
+        ++processor->samples_checked;
+        std::string wrong;
+        if (strncmp(message, sample->message, sizeof(message)) != 0)
+        {
+            wrong = "hashed '" + std::string(sample->message, strnlen(sample->message, PHPMAGIC_MAX_MESSAGE)) + "' as the message " + std::to_string(sample->index)
+                + ", which is '" + message + "'";
+        }
+        else if (!phpmagic_check_hit(group->config, sample))
+        {
+            wrong = "gave a digest of '" + std::string(message) + "' that differs from the reference implementation";
+        }
+        if (!wrong.empty())
+        {
+            if (processor->samples_wrong == 0)
+            {
+                std::cout << "Validation: processor " << rank << " (" << processor->name << ") is flagged: it " << wrong << std::endl;
+            }
+            ++processor->samples_wrong;
+        }
+    }
+    const double expected = group->probability * report->hashed;
+    if (!processor->rate_flagged && (expected >= CValidateMinExpected))
+    {
+        const double deviation = ((double)report->near_misses - expected) / sqrt(expected * (1 - group->probability));
+        if (fabs(deviation) > CValidateMaxDeviation)
+        {
+            processor->rate_flagged = true;
+            std::cout << "Validation: processor " << rank << " (" << processor->name << ") is flagged: " << report->near_misses << " near misses in "
+                << report->hashed << " messages, " << (uint64_t)expected << " expected (" << deviation << " standard deviations)" << std::endl;
+        }
+    }
+}
+
+// Processor 0: the counts per node, and the effective hashrate from the near misses
+static void print_nodes(const ValidateGroup* group, const char* title)
+{
+    typedef struct {
+        unsigned int processors;
+        uint64_t hashed;
+        uint64_t near_misses;
+        double claimed_rate;
+        double effective_rate;
+        uint64_t samples_checked;
+        unsigned int flagged;
+    } NodeTotal;
+    std::map<std::string, NodeTotal> nodes;
+    for (std::vector<ValidateProcessor>::size_type p = 0; p < group->processors.size(); ++p)
+    {
+        const ValidateProcessor* processor = &(group->processors[p]);
+        NodeTotal& node = nodes[processor->name];
+        ++node.processors;
+        node.hashed += processor->last.hashed;
+        node.near_misses += processor->last.near_misses;
+        if (processor->last.seconds > 0)
+        {
+            node.claimed_rate += processor->last.hashed / processor->last.seconds;
+            node.effective_rate += processor->last.near_misses / group->probability / processor->last.seconds;
+        }
+        node.samples_checked += processor->samples_checked;
+        node.flagged += flagged(processor) ? 1 : 0;
+    }
+    for (std::map<std::string, NodeTotal>::const_iterator n = nodes.begin(); n != nodes.end(); ++n)
+    {
+        const NodeTotal& node = n->second;
+        std::cout << title << ", node " << n->first << ": " << node.processors << " processor(s), " << node.hashed << " messages at "
+            << (uint64_t)(node.claimed_rate / 1000000) << " MH/s, " << node.near_misses << " near misses of " << (uint64_t)(group->probability * node.hashed)
+            << " expected, effective " << (uint64_t)(node.effective_rate / 1000000) << " MH/s, " << node.samples_checked << " samples checked"
+            << (node.flagged ? ", " + std::to_string(node.flagged) + " processor(s) flagged" : std::string()) << std::endl;
+    }
+}
+
+static void receive_reports(ValidateGroup* group, const bool wait)
+{
+#ifndef DISABLE_MPI
+    for (;;)
+    {
+        int flag = 0;
+        MPI_Status status;
+        if (wait)
+        {
+            MPI_Probe(MPI_ANY_SOURCE, CValidateTagReport, group->comm, &status);
+        }
+        else
+        {
+            MPI_Iprobe(MPI_ANY_SOURCE, CValidateTagReport, group->comm, &flag, &status);
+            if (!flag) break;
+        }
+        ValidateReport report;
+        MPI_Recv(&report, sizeof(report), MPI_BYTE, status.MPI_SOURCE, CValidateTagReport, group->comm, MPI_STATUS_IGNORE);
+        take_report(group, status.MPI_SOURCE, &report);
+        if (wait) break;
+    }
+#endif
+}
+
+static void send_report(ValidateGroup* group, const bool final)
+{
+    const ValidateClock::time_point now = ValidateClock::now();
+    group->own.seconds = std::chrono::duration<double>(now - group->begin).count();
+    group->own.final = final ? 1 : 0;
+    if (group->rank == 0)
+    {
+        take_report(group, 0, &group->own);
+    }
+#ifndef DISABLE_MPI
+    else
+    {
+        MPI_Send(&group->own, sizeof(group->own), MPI_BYTE, 0, CValidateTagReport, group->comm);
+    }
+#endif
+    group->own.sample_count = 0;
+    group->last_report = now;
+}
+
+ValidateGroup* validate_create(const phpmagic_config* config, const unsigned int interval, const std::string& processor_name)
+{
+    ValidateGroup* group = new ValidateGroup;
+    group->config = config;
+    group->interval = interval;
+    group->probability = phpmagic_sample_probability(config);
+    group->rank = 0;
+    group->size = 1;
+    memset(&group->own, 0, sizeof(group->own));
+    group->finished = 0;
+    std::vector<std::string> names(1, processor_name);
+#ifndef DISABLE_MPI
+    MPI_Comm_dup(MPI_COMM_WORLD, &group->comm);
+    MPI_Comm_rank(group->comm, &group->rank);
+    MPI_Comm_size(group->comm, &group->size);
+    char name[MPI_MAX_PROCESSOR_NAME];
+    memset(name, 0, sizeof(name));
+    strncpy(name, processor_name.c_str(), sizeof(name) - 1);
+    std::vector<char> all_names((group->rank == 0) ? group->size * MPI_MAX_PROCESSOR_NAME : 1);
+    MPI_Gather(name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, &all_names[0], MPI_MAX_PROCESSOR_NAME, MPI_CHAR, 0, group->comm);
+    if (group->rank == 0)
+    {
+        names.resize(group->size);
+        for (int r = 0; r < group->size; ++r)
+        {
+            names[r] = std::string(&all_names[r * MPI_MAX_PROCESSOR_NAME]);
+        }
+    }
+#endif
+    if (group->rank == 0)
+    {
+        group->processors.resize(group->size);
+        for (int r = 0; r < group->size; ++r)
+        {
+            ValidateProcessor* processor = &(group->processors[r]);
+            processor->name = names[r];
+            memset(&processor->last, 0, sizeof(processor->last));
+            processor->samples_checked = 0;
+            processor->samples_wrong = 0;
+            processor->rate_flagged = false;
+        }
+    }
+    group->begin = ValidateClock::now();
+    group->last_report = group->begin;
+    group->last_print = group->begin;
+    return group;
+}
+
+void validate_publish(ValidateGroup* group, const phpmagic_results* results)
+{
+    group->own.hashed += results->hashes;
+    group->own.near_misses += results->samples;
+    if ((results->samples > 0) && (group->own.sample_count < CValidateSamples))
+    {
+        group->own.samples[group->own.sample_count++] = results->sample;
+    }
+    const ValidateClock::time_point now = ValidateClock::now();
+    if (std::chrono::duration_cast<std::chrono::seconds>(now - group->last_report).count() >= group->interval)
+    {
+        send_report(group, false);
+    }
+    if (group->rank == 0)
+    {
+        receive_reports(group, false);
+        if (std::chrono::duration_cast<std::chrono::seconds>(now - group->last_print).count() >= group->interval)
+        {
+            print_nodes(group, "Validation");
+            group->last_print = now;
+        }
+    }
+}
+
+unsigned int validate_finish(ValidateGroup* group)
+{
+    send_report(group, true);
+    if (group->rank != 0) return 0;
+    while (group->finished < (unsigned int)group->size)
+    {
+        receive_reports(group, true);
+    }
+    print_nodes(group, "Validation total");
+    unsigned int count = 0;
+    for (std::vector<ValidateProcessor>::size_type p = 0; p < group->processors.size(); ++p)
+    {
+        count += flagged(&(group->processors[p])) ? 1 : 0;
+    }
+    return count;
+}
+
+void validate_free(ValidateGroup* group)
+{
+#ifndef DISABLE_MPI
+    MPI_Comm_free(&group->comm);
+#endif
+    delete group;
+}
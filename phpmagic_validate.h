@@ -0,0 +1,43 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Online validation: "--validate" checks every processor against the output it should produce, while the solutions are still too rare to tell.
+
+The engines count the near misses, the digests that match a weak sample pattern ("0e[0-9][0-9].*" by default: the first 16 bits from 0x0e00
+to 0x0e99, 100 of 65536 digests), and keep the first of each call. The rate of the near misses is known exactly, so their count is an
+independent measure of the candidates really hashed. Every interval, each processor sends processor 0 its counts and a few of the near misses;
+processor 0 recomputes the message of each sample from its index and its digest with the reference implementation, and compares the near misses
+of each processor with those expected from its count of candidates. A processor is flagged when a sample is wrong, e.g. a build with a wrong
+"-march" or a failing core, or when its near misses deviate by more than CValidateMaxDeviation standard deviations, e.g. an engine that skips
+candidates or counts more than it hashes. Processor 0 prints each node's effective hashrate, the near misses divided by their probability.
+*/
+
+#ifndef PHPMAGIC_VALIDATE_H
+#define PHPMAGIC_VALIDATE_H
+
+#include <string>
+#include <stdint.h>
+#include "phpmagic_search.h"
+
+const char CValidateSample[] = "0e[0-9][0-9].*";
+const double CValidateMaxDeviation = 6;
+
+typedef struct ValidateGroup ValidateGroup;
+
+// Collective over MPI_COMM_WORLD; "config" has the sample pattern, "interval" is in seconds
+ValidateGroup* validate_create(const phpmagic_config* config, const unsigned int interval, const std::string& processor_name);
+
+// After each call of the engine: counts the candidates and the near misses and keeps the sample; sends them to processor 0 every interval,
+// and on processor 0 checks what the processors have sent
+void validate_publish(ValidateGroup* group, const phpmagic_results* results);
+
+// At the end of the search of this processor: processor 0 waits for the others and prints the totals; returns the processors flagged on
+// processor 0, 0 on the others
+unsigned int validate_finish(ValidateGroup* group);
+
+// Collective over MPI_COMM_WORLD
+void validate_free(ValidateGroup* group);
+
+#endif
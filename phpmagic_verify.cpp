@@ -0,0 +1,285 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Bulk verification of candidate files, see "phpmagic_verify.h".
+*/
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "phpmagic_verify.h"
+#include "phpmagic_layout.h"
+#include "phpmagic_wordlist.h"
+
+// A line that fits in one block with the padding and the length
+const unsigned int CVerifyMaxBlockLine = 55;
+// The matches are written in whole lines, in chunks that mpirun forwards in one piece (4096 bytes are split by Open MPI 4.1),
+// so the lines of the processes and threads do not interleave
+const std::string::size_type CVerifyOutputChunk = 1024;
+
+typedef struct {
+    const VerifyJob* job;
+    const MappedFile* file;
+    bool block_lines;      // the lines of up to CVerifyMaxBlockLine bytes go through the engine
+    uint32_t midstate[5];  // the state before the line's block: the initial one, or after the K ^ ipad block of a fixed HMAC key
+    uint32_t prefix_bits;  // the length of what was hashed into the midstate
+} VerifyContext;
+
+static void verify_flush(std::string* output)
+{
+    std::string::size_type done = 0;
+    while (done < output->length())
+    {
+        const ssize_t written = write(STDOUT_FILENO, output->data() + done, output->length() - done);
+        if (written <= 0)
+        {
+            if ((written < 0) && (errno == EINTR)) continue;
+            break;
+        }
+        done += (std::string::size_type)written;
+    }
+    output->clear();
+}
+
+static void verify_report(const VerifyContext* ctx, const unsigned char* line, const size_t len, const uint32_t digest[CChainMaxDigestWords], std::string* output)
+{
+    static const char dec2hex[16 + 1] = "0123456789abcdef";
+    const unsigned int digest_nibbles = ctx->job->predicate->digest_nibbles;
+    if (output->length() + len + 1 + digest_nibbles + 1 > CVerifyOutputChunk)
+    {
+        verify_flush(output);
+    }
+    output->append((const char*)line, len);
+    output->push_back('\t');
+    for (unsigned int i = 0; i < digest_nibbles; i++)
+    {
+        output->push_back(dec2hex[(digest[i / 8] >> (28 - 4 * (i % 8))) & 15]);
+    }
+    output->push_back('\n');
+}
+
+static void verify_reference(const VerifyContext* ctx, const unsigned char* line, const size_t len, uint32_t digest[CChainMaxDigestWords])
+{
+    const VerifyJob* job = ctx->job;
+    const std::string candidate((const char*)line, len);
+    if (job->chain->hmac == hmac_fixed_key)
+    {
+        hmac_reference(job->chain->algorithm[0], job->hmac_key, job->salt_prefix + candidate + job->salt_suffix, digest);
+    }
+    else if (job->chain->hmac == hmac_varying_key)
+    {
+        hmac_reference(job->chain->algorithm[0], candidate, job->hmac_message, digest);
+    }
+    else
+    {
+        const std::string salted = job->salt_prefix + candidate + job->salt_suffix;
+        chain_reference(job->chain, (const unsigned char*)salted.data(), (uint32_t)salted.length(), digest);
+    }
+}
+
+// Word i of the padded block of a line: whole words are read from the mapping and the bytes after the line are masked off,
+// unless the line is too close to the end of the mapping
+static inline uint32_t verify_load_word(const unsigned char* line, const unsigned int len, const bool readable, const unsigned int i, const bool big_endian)
+{
+    const int valid = (int)len - (int)(4 * i);
+    if (valid >= 4)
+    {
+        return layout_load_word(line + 4 * i, big_endian);
+    }
+    if (valid < 0)
+    {
+        return 0;
+    }
+    uint32_t word = 0;
+    if (readable)
+    {
+        word = layout_load_word(line + 4 * i, big_endian);
+    }
+    else
+    {
+        for (int k = 0; k < valid; ++k)
+        {
+            word |= big_endian ? (uint32_t)line[4 * i + k] << (24 - 8 * k) : (uint32_t)line[4 * i + k] << (8 * k);
+        }
+    }
+    if (big_endian)
+        return (valid ? word & (0xffffffffu << (32 - 8 * valid)) : 0) | (0x80u << (24 - 8 * valid));
+    else
+        return (word & ((1u << (8 * valid)) - 1)) | (0x80u << (8 * valid));
+}
+
+// Hashes "count" lines of up to CVerifyMaxBlockLine bytes, one per lane
+template <typename V>
+static void verify_batch(const VerifyContext* ctx, const unsigned char* const line[], const unsigned int len[], const unsigned int count,
+    uint32_t digest[CChainMaxDigestWords][CMbLanes])
+{
+    const HashChain* chain = ctx->job->chain;
+    const bool big_endian = chain_big_endian(chain);
+    alignas(64) uint32_t message[16][CMbLanes];
+    memset(message, 0, sizeof(message));
+    for (unsigned int lane = 0; lane < count; ++lane)
+    {
+        const bool readable = line[lane] + 64 <= ctx->file->data + ctx->file->size;
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            message[i][lane] = verify_load_word(line[lane], len[lane], readable, i, big_endian);
+        }
+        message[big_endian ? 15 : 14][lane] = ctx->prefix_bits + 8 * len[lane];
+    }
+    V state[5];
+    V block[16];
+    V result[CChainMaxDigestWords];
+    for (unsigned int i = 0; i < 5; ++i)
+    {
+        state[i] = V() + ctx->midstate[i];
+    }
+    for (unsigned int i = 0; i < 16; ++i)
+    {
+        block[i] = mb_load<V>(&message[i][0]);
+    }
+    chain_compress(chain->algorithm[0], state, block);
+    chain_finish(chain, state, result);
+    for (unsigned int i = 0; i < CChainMaxDigestWords; ++i)
+    {
+        mb_store(&digest[i][0], result[i]);
+    }
+}
+
+// Checks the lines that start in [begin, end)
+static void verify_range(const VerifyContext* ctx, const size_t begin, const size_t end, VerifyStats* stats)
+{
+    const unsigned int lanes = ctx->job->multibuffer ? CMbLanes : 1;
+    std::string output;
+    const unsigned char* batch_line[CMbLanes];
+    unsigned int batch_len[CMbLanes];
+    unsigned int batch_count = 0;
+    alignas(64) uint32_t lane_digest[CChainMaxDigestWords][CMbLanes];
+    uint64_t lines = 0;
+    uint64_t matches = 0;
+
+    auto check_batch = [&]()
+    {
+        if (batch_count == 0) return;
+        if (ctx->job->multibuffer)
+            verify_batch<mb_u32>(ctx, batch_line, batch_len, batch_count, lane_digest);
+        else
+            verify_batch<uint32_t>(ctx, batch_line, batch_len, batch_count, lane_digest);
+        for (unsigned int lane = 0; lane < batch_count; ++lane)
+        {
+            uint32_t digest[CChainMaxDigestWords];
+            for (unsigned int i = 0; i < CChainMaxDigestWords; ++i)
+            {
+                digest[i] = lane_digest[i][lane];
+            }
+            if (predicate_match(ctx->job->predicate, digest))
+            {
+                ++matches;
+                verify_report(ctx, batch_line[lane], batch_len[lane], digest, &output);
+            }
+        }
+        batch_count = 0;
+    };
+
+    // the line that crosses "begin" belongs to the previous range
+    const unsigned char* data = ctx->file->data;
+    size_t pos = mapped_line_start(ctx->file, begin);
+    while (pos < end)
+    {
+        const unsigned char* line = data + pos;
+        // the candidate is the line up to the first tab, e.g. the message column of the README tables
+        size_t len = mapped_line(ctx->file, pos, &pos);
+        const void* tab = memchr(line, '\t', len);
+        if (tab)
+            len = (const unsigned char*)tab - line;
+        ++lines;
+        if (ctx->block_lines && (len <= CVerifyMaxBlockLine))
+        {
+            batch_line[batch_count] = line;
+            batch_len[batch_count] = (unsigned int)len;
+            if (++batch_count == lanes) check_batch();
+        }
+        else
+        {
+            uint32_t digest[CChainMaxDigestWords] = { 0 };
+            verify_reference(ctx, line, len, digest);
+            if (predicate_match(ctx->job->predicate, digest))
+            {
+                ++matches;
+                verify_report(ctx, line, len, digest, &output);
+            }
+        }
+    }
+    check_batch();
+    verify_flush(&output);
+    stats->lines = lines;
+    stats->matches = matches;
+    stats->bytes = end - begin;
+}
+
+bool verify_file(const std::string& path, const VerifyJob* job, const int rank, const int ranks, VerifyStats* stats, std::string* error)
+{
+    memset(stats, 0, sizeof(*stats));
+    MappedFile file;
+    if (!mapped_file_open(path, &file, error))
+    {
+        return false;
+    }
+    if (file.size == 0)
+    {
+        return true;
+    }
+
+    VerifyContext ctx;
+    ctx.job = job;
+    ctx.file = &file;
+    // the engine hashes a line as a single block after a constant midstate, so only the salts and a varying HMAC key take the reference path
+    ctx.block_lines = job->salt_prefix.empty() && job->salt_suffix.empty() && (job->chain->hmac != hmac_varying_key);
+    const HashAlgorithm algorithm = job->chain->algorithm[0];
+    memset(ctx.midstate, 0, sizeof(ctx.midstate));
+    if (algorithm == hash_sha1)
+        memcpy(ctx.midstate, CSha1Init, sizeof(CSha1Init));
+    else
+        memcpy(ctx.midstate, CMd5Init, sizeof(CMd5Init));
+    ctx.prefix_bits = 0;
+    if (job->chain->hmac == hmac_fixed_key)
+    {
+        const std::string block = hmac_key_block(algorithm, job->hmac_key);
+        uint32_t words[16];
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            words[i] = layout_load_word((const unsigned char*)block.data() + 4 * i, chain_big_endian(job->chain)) ^ CHmacIpad;
+        }
+        if (algorithm == hash_sha1)
+            SHA1TransformWords(ctx.midstate, words);
+        else
+            MD5TransformWords(ctx.midstate, words);
+        ctx.prefix_bits = 64 * 8;
+    }
+
+    // this process' share of the file, split again between the threads
+    size_t rank_begin, rank_end;
+    mapped_file_share(file.size, rank, ranks, &rank_begin, &rank_end);
+    const unsigned int threads = (job->threads > 0) ? job->threads : 1;
+    std::vector<VerifyStats> thread_stats(threads);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        size_t begin, end;
+        mapped_file_share(rank_end - rank_begin, t, threads, &begin, &end);
+        workers.push_back(std::thread(verify_range, &ctx, rank_begin + begin, rank_begin + end, &thread_stats[t]));
+    }
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        workers[t].join();
+        stats->lines += thread_stats[t].lines;
+        stats->matches += thread_stats[t].matches;
+        stats->bytes += thread_stats[t].bytes;
+    }
+    mapped_file_close(&file);
+    return true;
+}
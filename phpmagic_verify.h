@@ -0,0 +1,42 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Bulk verification of candidate files.
+
+The file is memory-mapped and split by byte ranges, first between the processes, then between the threads of each process;
+a line belongs to the range where it starts. Each line (up to the first tab, so the README tables can be given as they are)
+is hashed with the job's hash chain and the lines whose digests match the predicate are written to the standard output
+as "line<tab>digest". Lines of up to 55 bytes are loaded straight from the mapping into the lanes of the engine;
+longer lines, salts and HMAC go through the reference implementation.
+*/
+
+#ifndef PHPMAGIC_VERIFY_H
+#define PHPMAGIC_VERIFY_H
+
+#include <string>
+#include <stdint.h>
+#include "phpmagic_chain.h"
+#include "phpmagic_predicate.h"
+
+typedef struct {
+    const HashChain* chain;
+    const Predicate* predicate;
+    bool multibuffer;
+    unsigned int threads;
+    std::string salt_prefix;
+    std::string salt_suffix;
+    std::string hmac_key;
+    std::string hmac_message;
+} VerifyJob;
+
+typedef struct {
+    uint64_t lines;
+    uint64_t matches;
+    uint64_t bytes;
+} VerifyStats;
+
+bool verify_file(const std::string& path, const VerifyJob* job, const int rank, const int ranks, VerifyStats* stats, std::string* error);
+
+#endif
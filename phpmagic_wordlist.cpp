@@ -0,0 +1,196 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Memory-mapped files and mutation rules, see "phpmagic_wordlist.h".
+*/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <algorithm>
+#include "phpmagic_wordlist.h"
+
+bool mapped_file_open(const std::string& path, MappedFile* file, std::string* error)
+{
+    file->data = 0;
+    file->size = 0;
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        *error = "cannot open '" + path + "': " + strerror(errno);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        *error = "cannot stat '" + path + "': " + strerror(errno);
+        close(fd);
+        return false;
+    }
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+    void* mapping = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        *error = "cannot map '" + path + "': " + strerror(errno);
+        return false;
+    }
+    madvise(mapping, (size_t)st.st_size, MADV_SEQUENTIAL);
+    file->data = (const unsigned char*)mapping;
+    file->size = (size_t)st.st_size;
+    return true;
+}
+
+void mapped_file_close(MappedFile* file)
+{
+    if (file->data)
+    {
+        munmap((void*)file->data, file->size);
+    }
+    file->data = 0;
+    file->size = 0;
+}
+
+void mapped_file_share(const size_t size, const unsigned int part, const unsigned int parts, size_t* begin, size_t* end)
+{
+    *begin = size / parts * part + std::min(size % parts, (size_t)part);
+    *end = *begin + size / parts + ((part < size % parts) ? 1 : 0);
+}
+
+size_t mapped_line_start(const MappedFile* file, const size_t pos)
+{
+    if ((pos == 0) || (pos >= file->size) || (file->data[pos - 1] == '\n'))
+    {
+        return std::min(pos, file->size);
+    }
+    const void* newline = memchr(file->data + pos, '\n', file->size - pos);
+    return newline ? (const unsigned char*)newline - file->data + 1 : file->size;
+}
+
+size_t mapped_line(const MappedFile* file, const size_t pos, size_t* next)
+{
+    const void* newline = memchr(file->data + pos, '\n', file->size - pos);
+    const size_t line_end = newline ? (const unsigned char*)newline - file->data : file->size;
+    *next = line_end + 1;
+    size_t len = line_end - pos;
+    if ((len > 0) && (file->data[pos + len - 1] == '\r'))
+    {
+        --len;
+    }
+    return len;
+}
+
+bool wordlist_parse_rules(const std::string& text, unsigned int* rules, std::string* error)
+{
+    static const struct { const char* name; unsigned int rule; } CRules[] = {
+        { "none", rule_none }, { "capitalize", rule_capitalize }, { "upper", rule_upper },
+        { "toggle", rule_toggle }, { "leet", rule_leet }, { "digits", rule_digits } };
+    *rules = 0;
+    std::string::size_type i = 0;
+    while (i <= text.length())
+    {
+        std::string::size_type j = text.find(',', i);
+        if (j == std::string::npos) j = text.length();
+        const std::string name = text.substr(i, j - i);
+        unsigned int rule = 0;
+        for (unsigned int k = 0; k < sizeof(CRules) / sizeof(CRules[0]); ++k)
+        {
+            if (name == CRules[k].name) rule = CRules[k].rule;
+        }
+        if (rule == 0)
+        {
+            *error = "unknown rule '" + name + "', use none, capitalize, upper, toggle, leet or digits";
+            return false;
+        }
+        *rules |= rule;
+        i = j + 1;
+    }
+    if ((*rules & ~rule_digits) == 0)
+    {
+        // "digits" alone appends the digits to the word as it is
+        *rules |= rule_none;
+    }
+    return true;
+}
+
+static void add_base(const std::string& base, std::vector<std::string>* bases, const std::vector<std::string>::size_type first)
+{
+    if (std::find(bases->begin() + first, bases->end(), base) == bases->end())
+    {
+        bases->push_back(base);
+    }
+}
+
+void wordlist_mutate(const std::string& word, const unsigned int rules, std::vector<std::string>* bases)
+{
+    const std::vector<std::string>::size_type first = bases->size();
+    if (rules & rule_none)
+    {
+        add_base(word, bases, first);
+    }
+    if (rules & rule_capitalize)
+    {
+        std::string form = word;
+        for (std::string::size_type i = 0; i < form.length(); ++i)
+        {
+            form[i] = (i == 0) ? toupper((unsigned char)form[i]) : tolower((unsigned char)form[i]);
+        }
+        add_base(form, bases, first);
+    }
+    if (rules & rule_upper)
+    {
+        std::string form = word;
+        for (std::string::size_type i = 0; i < form.length(); ++i)
+        {
+            form[i] = toupper((unsigned char)form[i]);
+        }
+        add_base(form, bases, first);
+    }
+    if (rules & rule_toggle)
+    {
+        std::string form = word;
+        for (std::string::size_type i = 0; i < form.length(); ++i)
+        {
+            const unsigned char c = (unsigned char)form[i];
+            form[i] = isupper(c) ? tolower(c) : toupper(c);
+        }
+        add_base(form, bases, first);
+    }
+    if (rules & rule_leet)
+    {
+        static const char CLeetFrom[] = "aeiostAEIOST";
+        static const char CLeetTo[] = "431057431057";
+        std::string form = word;
+        for (std::string::size_type i = 0; i < form.length(); ++i)
+        {
+            const char* p = strchr(CLeetFrom, form[i]);
+            if (p && *p) form[i] = CLeetTo[p - CLeetFrom];
+        }
+        add_base(form, bases, first);
+    }
+    if (rules & rule_digits)
+    {
+        const std::vector<std::string>::size_type forms_end = bases->size();
+        for (std::vector<std::string>::size_type f = first; f < forms_end; ++f)
+        {
+            const std::string form = (*bases)[f];
+            for (unsigned int n = 0; n < 110; ++n)
+            {
+                // 0-9, then 00-99
+                const std::string digits = (n < 10) ? std::string(1, (char)('0' + n)) : std::string(1, (char)('0' + (n - 10) / 10)) + (char)('0' + (n - 10) % 10);
+                // the forms have the same length and are distinct, so are these
+                bases->push_back(form + digits);
+            }
+        }
+    }
+}
@@ -0,0 +1,52 @@
+/*
+PHP-magic-hashes-Open-MPI
+Copyright 2021 Maxim Masiutin <maxim@masiutin.com>
+All rights reserved
+
+Memory-mapped newline-delimited files (wordlists and candidate files) and the mutation rules of the hybrid mode.
+
+A file is split between the processes (and threads) by equal byte ranges, and a line belongs to the range where it starts,
+so every line is processed exactly once whatever the line lengths are. The rules turn a word into the bases of the hybrid mode,
+e.g. "password" into "Password", "p4ssw0rd" or "password7"; each base is then followed by a brute-forced tail.
+*/
+
+#ifndef PHPMAGIC_WORDLIST_H
+#define PHPMAGIC_WORDLIST_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+} MappedFile;
+
+bool mapped_file_open(const std::string& path, MappedFile* file, std::string* error);
+void mapped_file_close(MappedFile* file);
+
+// The byte range of part "part" of "parts"
+void mapped_file_share(const size_t size, const unsigned int part, const unsigned int parts, size_t* begin, size_t* end);
+
+// The start of the first line that starts at "pos" or after it
+size_t mapped_line_start(const MappedFile* file, const size_t pos);
+
+// The length of the line at "pos" without the line break (LF or CRLF); "next" is set to the start of the next line
+size_t mapped_line(const MappedFile* file, const size_t pos, size_t* next);
+
+enum WordRule {
+    rule_none = 1,       // the word as it is
+    rule_capitalize = 2, // the first letter in uppercase, the rest in lowercase
+    rule_upper = 4,
+    rule_toggle = 8,     // the case of every letter toggled
+    rule_leet = 16,      // a->4, e->3, i->1, o->0, s->5, t->7
+    rule_digits = 32     // every form above also followed by 0-9 and 00-99
+};
+
+// Parses a comma-separated list such as "none,capitalize,leet,digits"
+bool wordlist_parse_rules(const std::string& text, unsigned int* rules, std::string* error);
+
+// Appends the bases derived from "word" by the rules, without duplicates
+void wordlist_mutate(const std::string& word, const unsigned int rules, std::vector<std::string>* bases);
+
+#endif
@@ -35,6 +35,7 @@ A million repetitions of "a"
 #include <stdio.h>
 #include <string.h>
 #include "sha1.h"
+#include "hash_mb.h"
 
 #ifndef BYTE_ORDER
 #if (BSD >= 199103)
@@ -169,6 +170,27 @@ CHAR64LONG16* block = (const CHAR64LONG16*)buffer;
 #endif
 }
 
+/* Hash a single 512-bit block given as 16 words already in host order, see "hash_mb.h" */
+
+void SHA1TransformWords(uint32_t state[5], const uint32_t words[16])
+{
+    sha1_compress_mb<uint32_t>(state, words);
+}
+
+/* Hash consecutive blocks, loading their words directly rather than copying each block and wiping the copy */
+
+void SHA1TransformBlocks(uint32_t state[5], const unsigned char* data, size_t blocks)
+{
+uint32_t words[16];
+
+    for ( ; blocks != 0; --blocks, data += 64) {
+        for (unsigned int i = 0; i < 16; i++) {
+            words[i] = ((uint32_t)data[4*i] << 24) | ((uint32_t)data[4*i+1] << 16) | ((uint32_t)data[4*i+2] << 8) | data[4*i+3];
+        }
+        sha1_compress_mb<uint32_t>(state, words);
+    }
+}
+
 #endif
 
 /* SHA1Init - Initialize new context */
@@ -199,9 +221,8 @@ uint32_t j;
     if ((j + len) > 63) {
         memcpy(&context->buffer[j], data, (i = 64-j));
         SHA1Transform(context->state, context->buffer);
-        for ( ; i + 63 < len; i += 64) {
-            SHA1Transform(context->state, &data[i]);
-        }
+        SHA1TransformBlocks(context->state, &data[i], (len - i) / 64);
+        i += (len - i) & ~63U;
         j = 0;
     }
     else i = 0;
@@ -214,7 +235,8 @@ void SHA1Final(unsigned char digest[20], SHA1_CTX* context)
 {
 unsigned i;
 unsigned char finalcount[8];
-unsigned char c;
+unsigned char padding[64];
+uint32_t j;
 
 #if 0	/* untested "improvement" by DHR */
     /* Convert context->count to a sequence of bytes
@@ -238,12 +260,11 @@ unsigned char c;
          >> ((3-(i & 3)) * 8) ) & 255);  /* Endian independent */
     }
 #endif
-    c = 0200;
-    SHA1Update(context, &c, 1);
-    while ((context->count[0] & 504) != 448) {
-	c = 0000;
-        SHA1Update(context, &c, 1);
-    }
+    /* 0x80 and the zeros up to 56 bytes modulo 64, in one write */
+    memset(padding, 0, sizeof(padding));
+    padding[0] = 0200;
+    j = (context->count[0] >> 3) & 63;
+    SHA1Update(context, padding, (j < 56) ? 56 - j : 120 - j);
     SHA1Update(context, finalcount, 8);  /* Should cause a SHA1Transform() */
     for (i = 0; i < 20; i++) {
         digest[i] = (unsigned char)
@@ -253,6 +274,74 @@ unsigned char c;
     memset(context, '\0', sizeof(*context));
     memset(&finalcount, '\0', sizeof(finalcount));
 }
+
+/* SHA1StreamInit - Initialize a streaming context */
+
+void SHA1StreamInit(SHA1_STREAM* stream, int wipe)
+{
+    stream->state[0] = 0x67452301;
+    stream->state[1] = 0xEFCDAB89;
+    stream->state[2] = 0x98BADCFE;
+    stream->state[3] = 0x10325476;
+    stream->state[4] = 0xC3D2E1F0;
+    stream->length = 0;
+    stream->used = 0;
+    stream->wipe = wipe;
+}
+
+/* The buffer is only filled to complete a block; the whole blocks after it are hashed from the input */
+
+void SHA1StreamUpdate(SHA1_STREAM* stream, const unsigned char* data, size_t len)
+{
+    stream->length += len;
+    if (stream->used != 0) {
+        size_t take = 64 - stream->used;
+        if (take > len)
+            take = len;
+        memcpy(&stream->buffer[stream->used], data, take);
+        stream->used += (unsigned int)take;
+        data += take;
+        len -= take;
+        if (stream->used < 64)
+            return;
+        SHA1TransformBlocks(stream->state, stream->buffer, 1);
+        stream->used = 0;
+    }
+    if (len >= 64) {
+        SHA1TransformBlocks(stream->state, data, len / 64);
+        data += len & ~(size_t)63;
+        len &= 63;
+    }
+    memcpy(stream->buffer, data, len);
+    stream->used = (unsigned int)len;
+}
+
+/* The padding and the bit length are written into the buffer, which then takes one or two blocks */
+
+void SHA1StreamFinal(unsigned char digest[20], SHA1_STREAM* stream)
+{
+unsigned int i;
+unsigned int used = stream->used;
+const uint64_t bits = stream->length << 3;
+
+    stream->buffer[used++] = 0200;
+    if (used > 56) {
+        memset(&stream->buffer[used], 0, 64 - used);
+        SHA1TransformBlocks(stream->state, stream->buffer, 1);
+        used = 0;
+    }
+    memset(&stream->buffer[used], 0, 56 - used);
+    for (i = 0; i < 8; i++) {
+        stream->buffer[56 + i] = (unsigned char)(bits >> ((7 - i) * 8));
+    }
+    SHA1TransformBlocks(stream->state, stream->buffer, 1);
+    for (i = 0; i < 20; i++) {
+        digest[i] = (unsigned char)
+         ((stream->state[i>>2] >> ((3-(i & 3)) * 8) ) & 255);
+    }
+    if (stream->wipe)
+        memset(stream, '\0', sizeof(*stream));
+}
 /* ================ end of sha1.c ================ */
 
 
@@ -277,39 +366,28 @@ typedef UINT8 uint8_t;
 /*   Based on code from Intel, and by Sean Gulley for      */
 /*   the miTLS project.                                    */
 
-void SHA1Transform(uint32_t state[5], const unsigned char data[64])
+/* One block on the state held in registers: ABCD with A in the top lane, E in the top lane of E0 (the others zero, as sha1nexte leaves them);
+   the message words are given in the order expected by sha1rnds4, i.e., the first word of each group of four in the top lane */
+static inline void sha1_ni_rounds(__m128i& ABCD, __m128i& E0, __m128i MSG0, __m128i MSG1, __m128i MSG2, __m128i MSG3)
 {
-    __m128i ABCD, ABCD_SAVE, E0, E0_SAVE, E1;
-    __m128i MSG0, MSG1, MSG2, MSG3;
-    const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
-
-    /* Load initial values */
-    ABCD = _mm_loadu_si128((const __m128i*) state);
-    E0 = _mm_set_epi32(state[4], 0, 0, 0);
-    ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+    __m128i ABCD_SAVE, E0_SAVE, E1;
 
     /* Save current state  */
     ABCD_SAVE = ABCD;
     E0_SAVE = E0;
 
     /* Rounds 0-3 */
-    MSG0 = _mm_loadu_si128((const __m128i*)(data + 0));
-    MSG0 = _mm_shuffle_epi8(MSG0, MASK);
     E0 = _mm_add_epi32(E0, MSG0);
     E1 = ABCD;
     ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
 
     /* Rounds 4-7 */
-    MSG1 = _mm_loadu_si128((const __m128i*)(data + 16));
-    MSG1 = _mm_shuffle_epi8(MSG1, MASK);
     E1 = _mm_sha1nexte_epu32(E1, MSG1);
     E0 = ABCD;
     ABCD = _mm_sha1rnds4_epu32(ABCD, E1, 0);
     MSG0 = _mm_sha1msg1_epu32(MSG0, MSG1);
 
     /* Rounds 8-11 */
-    MSG2 = _mm_loadu_si128((const __m128i*)(data + 32));
-    MSG2 = _mm_shuffle_epi8(MSG2, MASK);
     E0 = _mm_sha1nexte_epu32(E0, MSG2);
     E1 = ABCD;
     ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
@@ -317,8 +395,6 @@ void SHA1Transform(uint32_t state[5], const unsigned char data[64])
     MSG0 = _mm_xor_si128(MSG0, MSG2);
 
     /* Rounds 12-15 */
-    MSG3 = _mm_loadu_si128((const __m128i*)(data + 48));
-    MSG3 = _mm_shuffle_epi8(MSG3, MASK);
     E1 = _mm_sha1nexte_epu32(E1, MSG3);
     E0 = ABCD;
     MSG0 = _mm_sha1msg2_epu32(MSG0, MSG3);
@@ -451,11 +527,59 @@ void SHA1Transform(uint32_t state[5], const unsigned char data[64])
     /* Combine state */
     E0 = _mm_sha1nexte_epu32(E0, E0_SAVE);
     ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+}
 
+static inline void sha1_ni_compress(uint32_t state[5], __m128i MSG0, __m128i MSG1, __m128i MSG2, __m128i MSG3)
+{
+    /* Load initial values */
+    __m128i ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) state), 0x1B);
+    __m128i E0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+    sha1_ni_rounds(ABCD, E0, MSG0, MSG1, MSG2, MSG3);
 
     /* Save state */
     ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
     _mm_storeu_si128((__m128i*) state, ABCD);
     state[4] = _mm_extract_epi32(E0, 3);
 }
-#endif
\ No newline at end of file
+
+void SHA1Transform(uint32_t state[5], const unsigned char data[64])
+{
+    const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    sha1_ni_compress(state,
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), MASK),
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), MASK),
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), MASK),
+        _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), MASK));
+}
+
+/* The words are already in host order, so only the order of the words within each group of four is reversed */
+void SHA1TransformWords(uint32_t state[5], const uint32_t words[16])
+{
+    sha1_ni_compress(state,
+        _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(words + 0)), 0x1B),
+        _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(words + 4)), 0x1B),
+        _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(words + 8)), 0x1B),
+        _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(words + 12)), 0x1B));
+}
+
+/* The state is loaded once and stored once for all the blocks */
+void SHA1TransformBlocks(uint32_t state[5], const unsigned char* data, size_t blocks)
+{
+    const __m128i MASK = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i ABCD = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) state), 0x1B);
+    __m128i E0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+    for ( ; blocks != 0; --blocks, data += 64) {
+        sha1_ni_rounds(ABCD, E0,
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 0)), MASK),
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), MASK),
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), MASK),
+            _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), MASK));
+    }
+    _mm_storeu_si128((__m128i*) state, _mm_shuffle_epi32(ABCD, 0x1B));
+    state[4] = _mm_extract_epi32(E0, 3);
+}
+
+#endif
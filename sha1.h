@@ -16,7 +16,11 @@ By Steve Reid <steve@edmweb.com>
 100% Public Domain
 */
 
+#ifndef SHA1_H
+#define SHA1_H
+
 #include <string>
+#include <stddef.h>
 
 #ifndef DISABLE_SHA_CPU_EXTENSIONS
 #define USE_SHA_CPU_EXTENSIONS
@@ -42,6 +46,27 @@ typedef struct {
 } SHA1_CTX;
 
 void SHA1Transform(uint32_t state[5], const unsigned char buffer[64]);
+// The block is given as 16 big-endian words, already loaded into host order
+void SHA1TransformWords(uint32_t state[5], const uint32_t words[16]);
 void SHA1Init(SHA1_CTX* context);
 void SHA1Update(SHA1_CTX* context, const unsigned char* data, uint32_t len);
 void SHA1Final(unsigned char digest[20], SHA1_CTX* context);
+
+// Hashes "blocks" consecutive 64-byte blocks; with the SHA instructions the state stays in registers between them
+void SHA1TransformBlocks(uint32_t state[5], const unsigned char* data, size_t blocks);
+
+// Streaming SHA-1 for long messages: a 64-bit length, the whole blocks of the input hashed in place
+// and the padding written into the buffer at once. Unless "wipe" was given, the context is not cleared after the digest.
+typedef struct {
+    uint32_t state[5];
+    uint64_t length;          // in bytes
+    unsigned char buffer[64];
+    unsigned int used;        // bytes in the buffer
+    int wipe;
+} SHA1_STREAM;
+
+void SHA1StreamInit(SHA1_STREAM* stream, int wipe);
+void SHA1StreamUpdate(SHA1_STREAM* stream, const unsigned char* data, size_t len);
+void SHA1StreamFinal(unsigned char digest[20], SHA1_STREAM* stream);
+
+#endif
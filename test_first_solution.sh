@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# Without "mpi_continue", every mode of a single processor must stop at its first solution and print it once, as the plain driver does,
+# rather than printing the whole batch of hits of the call that found it.
+#   ./compile.sh && ./test_first_solution.sh
+# The pattern matches one message in 2^16, so a batch of the engine holds several solutions.
+
+MPIRUN_FLAGS="--oversubscribe"
+if [ "$(id -u)" = "0" ]
+then
+    MPIRUN_FLAGS="--allow-run-as-root $MPIRUN_FLAGS"
+fi
+
+FAILED=0
+
+# $1: the name of the case, the rest: the options of the application
+check()
+{
+    local name=$1
+    shift
+    local output
+    output=$(timeout 600 mpirun $MPIRUN_FLAGS -np 1 ./phpmagic_sha1_openmpi --pattern '0000.*' "$@" 2>&1)
+    local status=$?
+    local solutions
+    solutions=$(echo "$output" | grep -c "^Solution: ")
+    if [ $status -ne 0 ]
+    then
+        echo "$output"
+        echo "FAIL: $name: mpirun exited with $status"
+        FAILED=1
+    elif [ "$solutions" != "1" ]
+    then
+        echo "$output"
+        echo "FAIL: $name: $solutions solutions printed, 1 expected"
+        FAILED=1
+    else
+        echo "PASS: $name"
+    fi
+}
+
+check "plain"
+check "smt-pair" --smt-pair
+check "fault-tolerant" --fault-tolerant
+check "sweep" --lengths 10-11
+
+# the shard must also record that one solution only, so "phpmagic_merge" reports the same
+SHARD_DIR=$(mktemp -d)
+check "shard" --shard 0/1 --shard-prefix "$SHARD_DIR/shard"
+RECORDED=$(cat "$SHARD_DIR"/shard-* 2>/dev/null | grep -c "^hit")
+if [ "$RECORDED" != "1" ]
+then
+    echo "FAIL: shard: $RECORDED solutions recorded, 1 expected"
+    FAILED=1
+fi
+rm -rf "$SHARD_DIR"
+
+exit $FAILED
@@ -0,0 +1,88 @@
+#!/bin/bash
+
+# The fault-tolerant mode under mpirun, in two runs:
+#   - no processor dies: the solution must be printed once, processor 0 must stop the others, and every process must exit cleanly, rather
+#     than the finder aborting and its unit being searched again as if it had failed; the pattern matches one message in 2^28, so the run
+#     takes seconds;
+#   - processor 2 is killed with "kill -9" while it hashes: processor 0 must take it as failed, put its candidates back in the queue and still
+#     finish the keyspace (or stop at a solution); the keyspace is 5*10^8 integers, which no pattern matches, so the run takes a few seconds
+#     more than the heartbeat.
+#   ./compile.sh && ./test_tolerant.sh
+
+NP=${NP:-3}
+MPIRUN_FLAGS="--oversubscribe --mca orte_enable_recovery 1"
+if [ "$(id -u)" = "0" ]
+then
+    MPIRUN_FLAGS="--allow-run-as-root $MPIRUN_FLAGS"
+fi
+
+FAILED=0
+
+# no processor dies
+OUTPUT=$(timeout 600 mpirun $MPIRUN_FLAGS -np $NP ./phpmagic_sha1_openmpi --fault-tolerant --heartbeat 4 --pattern '0000000.*' 2>&1)
+STATUS=$?
+echo "$OUTPUT"
+
+if [ $STATUS -ne 0 ]
+then
+    echo "FAIL: mpirun exited with $STATUS"
+    FAILED=1
+fi
+SOLUTIONS=$(echo "$OUTPUT" | grep -c "^Solution: ")
+if [ "$SOLUTIONS" != "1" ]
+then
+    echo "FAIL: $SOLUTIONS solutions printed, 1 expected"
+    FAILED=1
+fi
+if echo "$OUTPUT" | grep -q "has not been heard of"
+then
+    echo "FAIL: a processor was taken as failed"
+    FAILED=1
+fi
+if ! echo "$OUTPUT" | grep -q "^The search stopped at a solution"
+then
+    echo "FAIL: processor 0 did not stop the search at the solution"
+    FAILED=1
+fi
+
+# processor 2 dies; the run ends with MPI_Abort(), since MPI_Finalize() would wait for it, so its exit status is not checked
+KILLED_OUTPUT=$(mktemp)
+timeout 600 mpirun $MPIRUN_FLAGS -np 3 ./phpmagic_sha1_openmpi --fault-tolerant --heartbeat 2 --token integer:1000000000-1499999999 \
+    --pattern 'ffffffffff.*' >"$KILLED_OUTPUT" 2>&1 &
+TIMEOUT_PID=$!
+sleep 3
+# the processes of the ranks are the children of mpirun, which is the child of timeout
+MPIRUN_PID=$(pgrep -P $TIMEOUT_PID -x mpirun)
+KILLED=0
+for PID in $(ps --ppid "$MPIRUN_PID" -o pid= 2>/dev/null)
+do
+    if [ "$(tr '\0' '\n' < /proc/$PID/environ 2>/dev/null | sed -n 's/^OMPI_COMM_WORLD_RANK=//p')" = "2" ]
+    then
+        kill -9 $PID && KILLED=1
+    fi
+done
+wait $TIMEOUT_PID
+cat "$KILLED_OUTPUT"
+
+if [ $KILLED -eq 0 ]
+then
+    echo "FAIL: processor 2 was not found among the children of mpirun"
+    FAILED=1
+fi
+if ! grep -q "^Processor 2 has not been heard of for .* go back to the queue" "$KILLED_OUTPUT"
+then
+    echo "FAIL: the killed processor was not taken as failed"
+    FAILED=1
+fi
+if ! grep -q -e "^The keyspace is exhausted" -e "^The search stopped at a solution" "$KILLED_OUTPUT"
+then
+    echo "FAIL: the search did not finish after a processor was killed"
+    FAILED=1
+fi
+rm -f "$KILLED_OUTPUT"
+
+if [ $FAILED -eq 0 ]
+then
+    echo "PASS"
+fi
+exit $FAILED